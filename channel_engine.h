@@ -0,0 +1,124 @@
+/**
+ * @brief Channel state engine: the per-channel arrays and the batched control step.
+ *
+ * Every channel is one lane of a set of parallel arrays (structure of arrays).
+ * step() advances all lanes by one control tick in a single loop without
+ * per-phase branches: each transition is computed as a condition and applied
+ * with a select, so the same instructions run for every channel. On the host
+ * the compiler turns this loop into SIMD code; on the ESP it is a short
+ * straight-line loop over the populated channels.
+ *
+ * step() only updates state. What changed is left in events[] (one
+ * ChannelEventBit per transition) for the caller to turn into heater writes,
+ * trace records and log lines in a separate pass.
+ *
+ * The header has no Arduino dependencies; tools/channel_bench.cpp builds it on
+ * the host.
+ */
+
+#ifndef CHANNEL_ENGINE_H
+#define CHANNEL_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+const float CHANNEL_NO_READING = -127.0f; // lastTemperatures value of a failed or missing read
+
+/** @brief Transitions of one step, as bits of ChannelEngine::events. */
+enum ChannelEventBit : uint8_t {
+  CHANNEL_HEATER_ON        = 1 << 0,
+  CHANNEL_HEATER_OFF       = 1 << 1,
+  CHANNEL_HOLD_STARTED     = 1 << 2, // Idle -> Hold, when the heater first switches off
+  CHANNEL_COOLING_STARTED  = 1 << 3, // Hold -> Cooling, when the hold time is over
+  CHANNEL_COOLING_FINISHED = 1 << 4  // Cooling -> Idle, when the ramp reaches the lower limit
+};
+
+/**
+ * @brief Settings and real-time state of N channel lanes.
+ */
+template <size_t N>
+struct ChannelEngine {
+  // --- Process Parameters (Ustawienia użytkownika) ---
+  // The user-configurable settings for each channel.
+  float setting_HoldTemps[N];         // Target temperature setpoint (°C); the "live" setpoint is liveSetpoints[]
+  float setting_CoolingSpeeds[N];     // Rate of temperature decrease during the cooling phase (°C / minute)
+  float setting_LowerLimits[N];       // The minimum temperature setpoint to reach during the cooling ramp
+  uint32_t setting_HoldDurations[N];  // Duration (in minutes) to hold the temperature after reaching the threshold
+
+  // --- System State ---
+  // The real-time operational state of each channel.
+  // The flags are 0/1 bytes rather than bool: the vectorizer cannot widen bool.
+  float lastTemperatures[N];     // Stores the last valid temperature read, or CHANNEL_NO_READING
+  uint8_t outputState[N];        // Current state of the output pin (HIGH/LOW)
+  uint8_t holdPhaseActive[N];    // 1 if the 'Hold' phase is active
+  uint8_t coolingPhaseActive[N]; // 1 if the 'Cooling' phase is active
+  uint32_t phaseStartMillis[N];  // Timestamp (millis()) when the last phase started
+  uint32_t sensorErrorCounts[N]; // Failed reads since boot
+  float liveSetpoints[N];        // Setpoint used by the control logic; lowered by the cooling ramp, reset from setting_HoldTemps
+  uint8_t laneEnabled[N];        // 1: step() advances the lane; 0: the lane keeps its state
+  uint8_t events[N];             // ChannelEventBits of the last step()
+
+  /**
+   * @brief Advances lanes 0..count-1 by one control tick.
+   * @param now Current millis().
+   * @param elapsed Milliseconds since the previous tick, for the cooling ramp.
+   * @param heatAllowed False keeps every heater that is off switched off.
+   * @param hysteresis The heater switches off above liveSetpoints + hysteresis.
+   * @return The OR of all lanes' events, 0 when nothing changed.
+   */
+  uint8_t step(uint32_t now, uint32_t elapsed, bool heatAllowed, float hysteresis, size_t count = N) {
+    // The conditions are 0/1 integers combined with & and |, not bools and
+    // && / ||, so that no branches appear and every lane takes the same path.
+    const float rampMinutes = elapsed / 60000.0f;
+    const uint32_t heat = heatAllowed;
+    uint32_t any = 0;
+    for (size_t i = 0; i < count; i++) {
+      float temp = lastTemperatures[i];
+      float setpoint = liveSetpoints[i];
+      float lower = setting_LowerLimits[i];
+      float holdTemp = setting_HoldTemps[i];
+      uint32_t out = outputState[i];
+      uint32_t hold = holdPhaseActive[i];
+      uint32_t cooling = coolingPhaseActive[i];
+      uint32_t start = phaseStartMillis[i];
+      // Lanes without a sensor reading are left untouched.
+      uint32_t run = laneEnabled[i] & (temp != CHANNEL_NO_READING);
+
+      // 1. Heater with hysteresis. The first switch-off starts the Hold phase.
+      uint32_t on = run & (out ^ 1) & heat & (temp < setpoint);
+      uint32_t off = run & out & (temp > setpoint + hysteresis);
+      uint32_t holdStarted = off & ((hold | cooling) ^ 1);
+      hold |= holdStarted;
+      start = holdStarted ? now : start;
+
+      // 2. Hold timer (elapsed whole seconds >= minutes * 60, without the division).
+      uint32_t coolingStarted = run & hold & (now - start >= setting_HoldDurations[i] * 60000u);
+      hold &= coolingStarted ^ 1;
+      cooling |= coolingStarted;
+      start = coolingStarted ? now : start;
+
+      // 3. Cooling ramp down to the lower limit, then back to Idle.
+      uint32_t above = setpoint > lower;
+      uint32_t ramping = run & cooling & above;
+      uint32_t coolingFinished = run & cooling & (above ^ 1);
+      float ramped = setpoint - setting_CoolingSpeeds[i] * rampMinutes;
+      ramped = ramped < lower ? lower : ramped;
+      float next = coolingFinished ? holdTemp : ramped;
+      setpoint = (ramping | coolingFinished) ? next : setpoint;
+      cooling &= coolingFinished ^ 1;
+
+      outputState[i] = (out | on) & (off ^ 1);
+      holdPhaseActive[i] = hold;
+      coolingPhaseActive[i] = cooling;
+      phaseStartMillis[i] = start;
+      liveSetpoints[i] = setpoint;
+      uint32_t changed = on * CHANNEL_HEATER_ON | off * CHANNEL_HEATER_OFF | holdStarted * CHANNEL_HOLD_STARTED |
+                         coolingStarted * CHANNEL_COOLING_STARTED | coolingFinished * CHANNEL_COOLING_FINISHED;
+      events[i] = changed;
+      any |= changed;
+    }
+    return any;
+  }
+};
+
+#endif
@@ -26,73 +26,269 @@
 #endif
 #include <ESPAsyncWebServer.h>
 #include <Wire.h>
+#include <SPI.h>
 #include <OneWire.h>
 #include <DallasTemperature.h>
 #include <ArduinoJson.h>
+#include <DNSServer.h>
+#ifdef ESP32
+  #include <Update.h>
+#else
+  #include <Updater.h>
+#endif
+#ifdef ESP32
+  #include <soc/gpio_struct.h>
+  #include <Preferences.h>
+#else
+  #include <LittleFS.h>
+#endif
+#ifdef HOST_BUILD
+  #include <new>
+#endif
+#include <atomic>
+#include "channel_engine.h"
 
 //==============================================================================
 // Configuration
 //==============================================================================
 const char* ssid = "WIFI SSID";       // <--- CHANGE TO YOUR WIFI SSID
 const char* password = "PASSWORD"; // <--- CHANGE TO YOUR WIFI PASSWORD
+const char* ap_password = "gellan3000"; // <--- Fallback access point password (8-63 characters)
+const char* ota_password = "";          // <--- Firmware upload password (user "admin"); empty: updates refused
 
-const int NUM_SENSORS = 7;           // Number of sensors/channels to control
 const float HYSTERESIS = 0.5;      // Hysteresis (in °C) to prevent output chattering
 
+// Log levels. Events above LOG_LEVEL are removed at compile time.
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+#ifndef LOG_LEVEL
+  #define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
 //==============================================================================
-// Pin Definitions
+// Channel Configuration
 //==============================================================================
+// Every channel is one row of CHANNELS: its name, heater output pin, sensor
+// address and default process settings. The channel count and all
+// per-channel storage (see Controller) follow from this table, and pin
+// mistakes are reported when compiling (see "Pin Checks").
+//
+// Sensor addresses: replace them with the addresses of your DS18B20 sensors.
+// Use a "OneWireScanner" sketch to find them.
+
+/**
+ * @brief Fixed description of one channel.
+ */
+struct ChannelDescriptor {
+  const char *name;            // Shown in the web interface
+  uint8_t outputPin;           // Heater/relay output: GPIO, or expander bit
+  uint8_t address[8];          // DS18B20 ROM code
+  float holdTemp;              // Default hold setpoint (°C)
+  float coolingSpeed;          // Default cooling ramp (°C / minute)
+  float lowerLimit;            // Default end of the cooling ramp (°C)
+  unsigned long holdDuration;  // Default hold time (minutes)
+};
+
+// With OUTPUT_DRIVER_GPIO the pin column is a GPIO number. Pins 1 (TX) and
+// 3 (RX) are avoided as they conflict with Serial debug. With an I/O expander
+// driver it is the output's bit on the expanders instead (see "Output Drivers").
+constexpr ChannelDescriptor CHANNELS[] = {
+  // name      pin  sensor address (<--- CHANGE THESE)                   hold °C  °C/min  lower °C  min
+  {"Syringe",   2, {0x28, 0x3F, 0x4C, 0xDA, 0x05, 0x00, 0x00, 0x30}, 60.0f, 1.0f, 37.0f, 60},
+  {"Sample 1",  5, {0x28, 0x70, 0x40, 0x43, 0xD4, 0xAF, 0x15, 0xD4}, 60.0f, 1.0f, 37.0f, 60},
+  {"Sample 2", 14, {0x28, 0xAC, 0xDC, 0x46, 0xD4, 0xB9, 0x2B, 0x9D}, 60.0f, 1.0f, 37.0f, 60},
+  {"Sample 3", 12, {0x28, 0x0E, 0x2A, 0x45, 0xD4, 0x8D, 0x3A, 0xC8}, 60.0f, 1.0f, 37.0f, 60},
+  {"Sample 4", 16, {0x28, 0xC5, 0x53, 0x46, 0xD4, 0xB0, 0x37, 0xE0}, 60.0f, 1.0f, 37.0f, 60},
+  {"Sample 5", 15, {0x28, 0xDF, 0x12, 0x45, 0xD4, 0xC1, 0x1A, 0x74}, 60.0f, 1.0f, 37.0f, 60}, // 15=D8 on NodeMCU
+  {"Sample 6", 13, {0x28, 0xCD, 0x11, 0x46, 0xD4, 0xBF, 0x64, 0x0A}, 60.0f, 1.0f, 37.0f, 60}  // 13=D7 on NodeMCU
+};
 
-// Output pins for controlling heaters/relays.
-// NOTE: Pins 1 (TX) and 3 (RX) are avoided as they conflict with Serial debug.
-// These pins (15=D8, 13=D7 on NodeMCU) are safe alternatives.
-int outputPins[NUM_SENSORS] = {2, 5, 14, 12, 16, 15, 13};
+constexpr int NUM_SENSORS = sizeof(CHANNELS) / sizeof(CHANNELS[0]); // Number of sensors/channels to control
 
 // Input pin for the OneWire bus (all DS18B20 sensors connected here)
-const int oneWireBus = 4; // D2 on NodeMCU
+constexpr int oneWireBus = 4; // D2 on NodeMCU
+
+// Boot-strapping pins used as outputs. The relay input on such a pin must not
+// pull it away from its boot level while the chip starts (see README); list a
+// pin here once its wiring has been checked.
+#ifdef ESP32
+constexpr uint8_t STRAP_PINS_ACKNOWLEDGED[] = {2, 5, 12, 15};
+#else
+constexpr uint8_t STRAP_PINS_ACKNOWLEDGED[] = {2, 15};
+#endif
+
+// How the heater outputs are driven. The expanders free the GPIOs for up to
+// 32 channels: 74HC595 shift registers are chained on SPI (bit 0 is QA of
+// the register nearest the controller), MCP23017s sit on I2C at 0x20, 0x21...
+// (bit 0 is GPA0 of the first, bit 16 GPA0 of the second).
+#define OUTPUT_DRIVER_GPIO     0
+#define OUTPUT_DRIVER_74HC595  1
+#define OUTPUT_DRIVER_MCP23017 2
+#ifndef OUTPUT_DRIVER
+  #define OUTPUT_DRIVER OUTPUT_DRIVER_GPIO
+#endif
+
+// Expander wiring. The disable pin switches every heater off without a bus
+// transfer (74HC595 /OE, MCP23017 /RESET); it needs a pull-up (/OE) or
+// pull-down (/RESET) so the heaters stay off until the firmware runs, and the
+// relay inputs need pull-downs.
+#ifdef ESP32
+constexpr int OUTPUT_LATCH_PIN = 5;      // 74HC595 RCLK; data on MOSI 23, clock on SCK 18
+constexpr int OUTPUT_DISABLE_PIN = 17;
+constexpr int OUTPUT_SDA_PIN = 21;       // MCP23017
+constexpr int OUTPUT_SCL_PIN = 22;
+#else
+constexpr int OUTPUT_LATCH_PIN = 15;     // 74HC595 RCLK (D8); data on MOSI 13 (D7), clock on SCK 14 (D5)
+constexpr int OUTPUT_DISABLE_PIN = 5;    // D1
+constexpr int OUTPUT_SDA_PIN = 12;       // MCP23017 (D6)
+constexpr int OUTPUT_SCL_PIN = 14;       // D5
+#endif
 
 //==============================================================================
-// Global Variables - Process Parameters (Ustawienia użytkownika)
+// Pin Checks
 //==============================================================================
-// These arrays hold the user-configurable settings for each channel.
+#ifdef ESP32
+constexpr int MAX_OUTPUT_PIN = 33; // 34-39 are input-only
+constexpr bool pinIsStrap(int pin) { return pin == 0 || pin == 2 || pin == 5 || pin == 12 || pin == 15; }
+constexpr bool pinSupportsOneWire(int pin) { return pin <= MAX_OUTPUT_PIN; }
+#else
+constexpr int MAX_OUTPUT_PIN = 16;
+constexpr bool pinIsStrap(int pin) { return pin == 0 || pin == 2 || pin == 15; }
+constexpr bool pinSupportsOneWire(int pin) { return pin < 16; } // GPIO 16 has no open-drain mode
+#endif
+constexpr bool pinIsSerial(int pin) { return pin == 1 || pin == 3; }
+constexpr bool pinIsFlash(int pin) { return pin >= 6 && pin <= 11; }
 
-/**
- * @brief Target temperature setpoint (°C).
- * @note This is the *user-configured setting*. The "live" setpoint is stored in liveSetpoints[].
- */
-float setting_HoldTemps[NUM_SENSORS] = {60.0, 60.0, 60.0, 60.0, 60.0, 60.0, 60.0}; // <--- CHANGE THIS FOR YOUR TEMPERATURE
+constexpr bool strapPinAcknowledged(int pin, size_t i = 0) {
+  return i < sizeof(STRAP_PINS_ACKNOWLEDGED) && (STRAP_PINS_ACKNOWLEDGED[i] == pin || strapPinAcknowledged(pin, i + 1));
+}
 
-/**
- * @brief Rate of temperature decrease during the cooling phase (°C / minute).
- */
-float setting_CoolingSpeeds[NUM_SENSORS] = {1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0}; // <--- CHANGE THIS FOR YOUR TEMPERATURE
+typedef bool (*PinRule)(int pin);
+constexpr bool outputPinUsable(int pin) { return pin <= MAX_OUTPUT_PIN; }
+constexpr bool outputPinNotSerial(int pin) { return !pinIsSerial(pin); }
+constexpr bool outputPinNotFlash(int pin) { return !pinIsFlash(pin); }
+constexpr bool outputPinNotOneWire(int pin) { return pin != oneWireBus; }
+constexpr bool outputPinStrapChecked(int pin) { return !pinIsStrap(pin) || strapPinAcknowledged(pin); }
 
-/**
- * @brief The minimum temperature setpoint to reach during the cooling ramp.
- */
-float setting_LowerLimits[NUM_SENSORS] = {37.0, 37.0, 37.0, 37.0, 37.0, 37.0, 37.0}; // <--- CHANGE THIS FOR YOUR TEMPERATURE
+/** @brief True if rule holds for the output pin of every channel from i on. */
+constexpr bool everyOutputPin(PinRule rule, int i = 0) {
+  return i >= NUM_SENSORS || (rule(CHANNELS[i].outputPin) && everyOutputPin(rule, i + 1));
+}
 
-/**
- * @brief Duration (in minutes) to hold the temperature after reaching the threshold.
- */
-unsigned long setting_HoldDurations[NUM_SENSORS] = {60, 60, 60, 60, 60, 60, 60}; // <--- CHANGE THIS FOR YOUR TIME
+/** @brief True if no two channels from i on share an output pin. */
+constexpr bool outputPinsDistinct(int i = 0, int j = 1) {
+  return i >= NUM_SENSORS ? true
+       : j >= NUM_SENSORS ? outputPinsDistinct(i + 1, i + 2)
+       : CHANNELS[i].outputPin != CHANNELS[j].outputPin && outputPinsDistinct(i, j + 1);
+}
+
+/** @brief True if pin can be driven by the firmware without disturbing Serial, flash or the sensors. */
+constexpr bool pinFree(int pin) {
+  return pin >= 0 && pin <= MAX_OUTPUT_PIN && !pinIsSerial(pin) && !pinIsFlash(pin) && pin != oneWireBus;
+}
+
+/** @brief Highest output bit used by any channel from i on. */
+constexpr int highestOutputBit(int i = 0) {
+  return i >= NUM_SENSORS ? 0
+       : CHANNELS[i].outputPin > highestOutputBit(i + 1) ? CHANNELS[i].outputPin : highestOutputBit(i + 1);
+}
+
+static_assert(NUM_SENSORS > 0 && NUM_SENSORS <= 32, "CHANNELS must have 1 to 32 rows (channel masks are 32 bits)");
+static_assert(outputPinsDistinct(), "Two channels share an output pin");
+#if OUTPUT_DRIVER == OUTPUT_DRIVER_GPIO
+static_assert(everyOutputPin(outputPinUsable), "An output pin does not exist or is input-only");
+static_assert(everyOutputPin(outputPinNotSerial), "Output pins 1 (TX) and 3 (RX) conflict with Serial");
+static_assert(everyOutputPin(outputPinNotFlash), "Output pins 6-11 are connected to the flash chip");
+static_assert(everyOutputPin(outputPinNotOneWire), "An output pin is also the OneWire bus pin");
+static_assert(everyOutputPin(outputPinStrapChecked),
+              "An output is on a boot-strapping pin; check its wiring, then add it to STRAP_PINS_ACKNOWLEDGED");
+#elif OUTPUT_DRIVER == OUTPUT_DRIVER_74HC595
+static_assert(highestOutputBit() < 32, "Output bits must be 0-31 (at most four 74HC595)");
+static_assert(pinFree(OUTPUT_LATCH_PIN) && pinFree(OUTPUT_DISABLE_PIN) && OUTPUT_LATCH_PIN != OUTPUT_DISABLE_PIN,
+              "OUTPUT_LATCH_PIN and OUTPUT_DISABLE_PIN must be distinct free pins");
+#elif OUTPUT_DRIVER == OUTPUT_DRIVER_MCP23017
+static_assert(highestOutputBit() < 32, "Output bits must be 0-31 (at most two MCP23017)");
+static_assert(pinFree(OUTPUT_SDA_PIN) && pinFree(OUTPUT_SCL_PIN) && pinFree(OUTPUT_DISABLE_PIN) &&
+              OUTPUT_SDA_PIN != OUTPUT_SCL_PIN && OUTPUT_DISABLE_PIN != OUTPUT_SDA_PIN && OUTPUT_DISABLE_PIN != OUTPUT_SCL_PIN,
+              "OUTPUT_SDA_PIN, OUTPUT_SCL_PIN and OUTPUT_DISABLE_PIN must be distinct free pins");
+#else
+  #error "Unknown OUTPUT_DRIVER"
+#endif
+static_assert(pinSupportsOneWire(oneWireBus) && !pinIsSerial(oneWireBus) && !pinIsFlash(oneWireBus),
+              "oneWireBus cannot drive a OneWire bus");
 
 //==============================================================================
-// Global Variables - System State
+// Channel State
 //==============================================================================
-// These arrays track the real-time operational state of each channel.
 
-float lastTemperatures[NUM_SENSORS];       // Stores the last valid temperature read
-bool outputState[NUM_SENSORS] = {false};     // Current state of the output pin (HIGH/LOW)
-bool holdPhaseActive[NUM_SENSORS] = {false};   // True if the 'Hold' phase is active
-bool coolingPhaseActive[NUM_SENSORS] = {false}; // True if the 'Cooling' phase is active
-unsigned long phaseStartMillis[NUM_SENSORS] = {0}; // Timestamp (millis()) when the last phase started
+/**
+ * @brief Calls step(i) for channel indices I..N-1 without a loop.
+ * @details Each call sees its channel index as a constant, so the compiler
+ * can fold the per-channel array offsets, even at -Os.
+ */
+template <int I, int N>
+struct ChannelLoop {
+  template <typename Step>
+  static inline __attribute__((always_inline)) void run(const Step &step) {
+    step(I);
+    ChannelLoop<I + 1, N>::run(step);
+  }
+};
+
+template <int N>
+struct ChannelLoop<N, N> {
+  template <typename Step>
+  static inline __attribute__((always_inline)) void run(const Step &) {}
+};
 
 /**
- * @brief The "live" setpoint used by the control logic.
- * @note This array is MODIFIED by the cooling ramp. It is reset from setting_HoldTemps.
+ * @brief Settings and real-time state of N channels, initialised from CHANNELS.
+ * @details The per-channel arrays and the control step live in ChannelEngine
+ * (channel_engine.h); this adds the channel enable mask and the unrolled loop.
  */
-float liveSetpoints[NUM_SENSORS];
+template <int N>
+struct Controller : ChannelEngine<N> {
+  uint32_t enabled; // Bit i: channel i is populated (see "Channel Selection")
+
+  Controller() {
+    for (int i = 0; i < N; i++) {
+      this->setting_HoldTemps[i] = CHANNELS[i].holdTemp;
+      this->setting_CoolingSpeeds[i] = CHANNELS[i].coolingSpeed;
+      this->setting_LowerLimits[i] = CHANNELS[i].lowerLimit;
+      this->setting_HoldDurations[i] = CHANNELS[i].holdDuration;
+      this->lastTemperatures[i] = 0;
+      this->outputState[i] = false;
+      this->holdPhaseActive[i] = false;
+      this->coolingPhaseActive[i] = false;
+      this->phaseStartMillis[i] = 0;
+      this->sensorErrorCounts[i] = 0;
+      this->liveSetpoints[i] = 0;
+      this->events[i] = 0;
+    }
+    setEnabled(0xFFFFFFFFUL >> (32 - N));
+  }
+
+  /** @brief Sets the enable mask and the engine's matching per-lane flags. */
+  void setEnabled(uint32_t mask) {
+    enabled = mask;
+    for (int i = 0; i < N; i++) this->laneEnabled[i] = mask >> i & 1;
+  }
+
+  bool channelEnabled(int i) const { return enabled >> i & 1; }
+  int activeChannels() const { return __builtin_popcount(enabled); }
+
+  /** @brief Calls step(i) for every channel, fully unrolled. */
+  template <typename Step>
+  static inline __attribute__((always_inline)) void forEachChannel(const Step &step) {
+    ChannelLoop<0, N>::run(step);
+  }
+};
+
+Controller<NUM_SENSORS> controller;
+
+constexpr uint32_t ALL_CHANNELS = 0xFFFFFFFFUL >> (32 - NUM_SENSORS); // Mask of every channel
 
 //==============================================================================
 // Global Objects
@@ -101,31 +297,13 @@ AsyncWebServer server(80);
 OneWire oneWire(oneWireBus);
 DallasTemperature sensors(&oneWire);
 
-//==============================================================================
-// Sensor Configuration
-//==============================================================================
-// Unique 64-bit addresses for each DS18B20 sensor.
-// IMPORTANT: You must replace these with the addresses of your specific sensors.
-// Use a "OneWireScanner" sketch to find these addresses.
-DeviceAddress sensorAddresses[NUM_SENSORS] = {
-  {0x28, 0x3F, 0x4C, 0xDA, 0x05, 0x00, 0x00, 0x30}, // <--- CHANGE THIS ADDRESS
-  {0x28, 0x70, 0x40, 0x43, 0xD4, 0xAF, 0x15, 0xD4}, // <--- CHANGE THIS ADDRESS
-  {0x28, 0xAC, 0xDC, 0x46, 0xD4, 0xB9, 0x2B, 0x9D}, // <--- CHANGE THIS ADDRESS
-  {0x28, 0x0E, 0x2A, 0x45, 0xD4, 0x8D, 0x3A, 0xC8}, // <--- CHANGE THIS ADDRESS
-  {0x28, 0xC5, 0x53, 0x46, 0xD4, 0xB0, 0x37, 0xE0}, // <--- CHANGE THIS ADDRESS
-  {0x28, 0xDF, 0x12, 0x45, 0xD4, 0xC1, 0x1A, 0x74}, // <--- CHANGE THIS ADDRESS
-  {0x28, 0xCD, 0x11, 0x46, 0xD4, 0xBF, 0x64, 0x0A}  // <--- CHANGE THIS ADDRESS
-};
-
-// User-friendly names for the web interface
-String sensorNames[NUM_SENSORS] = {"Syringe", "Sample 1", "Sample 2", "Sample 3", "Sample 4", "Sample 5", "Sample 6"};
-
-
 //==============================================================================
 // Web Interface (HTML/CSS/JS)
 //==============================================================================
 // Stored in PROGMEM (Flash) to save precious RAM.
-const char HTML_CONTENT[] PROGMEM = R"rawliteral(
+// The page is split in two halves so the table rows can be streamed between
+// them without ever assembling the full document in RAM.
+const char HTML_HEAD[] PROGMEM = R"rawliteral(
 <!DOCTYPE HTML>
 <html>
 <head>
@@ -159,16 +337,46 @@ const char HTML_CONTENT[] PROGMEM = R"rawliteral(
           <th>Time Remaining</th>
           <th>Status</th>
         </tr>
-```html
-            </thead>
+      </thead>
       <tbody id="sensor-table">
-              </tbody>
+)rawliteral";
+
+// The second half of the page, streamed after the generated table rows.
+const char HTML_TAIL[] PROGMEM = R"rawliteral(
+      </tbody>
     </table>
-      ```
     <input type="submit" value="Save Changes">
     <div id="saveStatus" class="status"></div>
   </form>
 
+  <h3>Presets</h3>
+  <form id="presetForm">
+    <select id="presetName"></select>
+    <span id="presetChannels"></span>
+    <button type="button" onclick="applyPreset()">Apply</button>
+    <br><br>
+    Save channel <select id="presetSource"></select>
+    as <input type="text" id="presetNewName" maxlength="15" placeholder="name">
+    <button type="button" onclick="savePreset()">Save Preset</button>
+    <button type="button" onclick="deletePreset()">Delete Selected</button>
+    <div id="presetStatus" class="status"></div>
+  </form>
+
+  <h3>Channels</h3>
+  <form id="channelsForm">
+    <span id="channelList"></span>
+    <input type="submit" value="Save Channels">
+    <div id="channelsStatus" class="status"></div>
+  </form>
+
+  <h3>WiFi</h3>
+  <form id="wifiForm">
+    Network <input type="text" name="ssid" id="wifiSsid" maxlength="32">
+    Password <input type="password" name="password" maxlength="63">
+    <input type="submit" value="Connect">
+    <div id="wifiStatus" class="status"></div>
+  </form>
+
 <script>
   /**
    * Fetches the latest data from the /data endpoint and updates the table.
@@ -178,7 +386,8 @@ const char HTML_CONTENT[] PROGMEM = R"rawliteral(
       .then(response => response.json())
       .then(data => {
         if (Array.isArray(data)) {
-            data.forEach((sensor, i) => {
+            data.forEach(sensor => {
+            const i = sensor.ch;
             const tempEl = document.getElementById(`temp${i}`);
             const timeEl = document.getElementById(`time${i}`);
             const statusEl = document.getElementById(`status${i}`);
@@ -213,18 +422,155 @@ const char HTML_CONTENT[] PROGMEM = R"rawliteral(
         statusDiv.textContent = 'Changes saved successfully!';
         statusDiv.className = 'status status-ok';
       } else {
-        throw new Error('Server responded with an error');
+        return response.text().then(text => { throw new Error(text); });
       }
       // Clear status message after 3 seconds
       setTimeout(() => { statusDiv.textContent = ''; statusDiv.className = 'status'; }, 3000);
     })
     .catch(error => {
       console.error('Error submitting form:', error);
-      statusDiv.textContent = 'Error saving changes.';
+      statusDiv.textContent = 'Error saving changes: ' + error.message;
       statusDiv.className = 'status status-error';
     });
   }
 
+  /**
+   * Shows the outcome of a preset request; reloads the page after an apply so
+   * the form shows the new settings.
+   */
+  function presetRequest(url, fields, reload) {
+    const statusDiv = document.getElementById('presetStatus');
+    const body = new FormData();
+    Object.keys(fields).forEach(key => body.append(key, fields[key]));
+    fetch(url, { method: 'POST', body: body })
+      .then(response => {
+        if (!response.ok) return response.text().then(text => { throw new Error(text); });
+        statusDiv.textContent = 'Done';
+        statusDiv.className = 'status status-ok';
+        if (reload) setTimeout(() => location.reload(), 500);
+        else setTimeout(loadPresets, 500);
+      })
+      .catch(error => {
+        statusDiv.textContent = 'Preset error: ' + error.message;
+        statusDiv.className = 'status status-error';
+      });
+  }
+
+  /**
+   * Fills the preset list and the channel choices.
+   */
+  function loadPresets() {
+    fetch('/api/presets')
+      .then(response => response.json())
+      .then(data => {
+        const select = document.getElementById('presetName');
+        select.innerHTML = '';
+        data.presets.forEach(p => {
+          const option = document.createElement('option');
+          option.value = p.name;
+          option.textContent = `${p.name} (${p.threshold.toFixed(2)} / ${p.cooling.toFixed(2)} / ${p.lower.toFixed(2)} / ${p.hold})`;
+          select.appendChild(option);
+        });
+      })
+      .catch(error => console.error('Error fetching presets:', error));
+  }
+
+  function buildPresetChannels() {
+    const boxes = document.getElementById('presetChannels');
+    const source = document.getElementById('presetSource');
+    document.querySelectorAll('#sensor-table tr').forEach(row => {
+      const i = row.dataset.ch;
+      const name = row.cells[0].innerText;
+      boxes.insertAdjacentHTML('beforeend', `<label><input type="checkbox" value="${i}" checked> ${name}</label> `);
+      source.insertAdjacentHTML('beforeend', `<option value="${i}">${name}</option>`);
+    });
+  }
+
+  function applyPreset() {
+    const channels = Array.from(document.querySelectorAll('#presetChannels input:checked')).map(box => box.value);
+    if (channels.length === 0) return;
+    presetRequest('/api/presets/apply', { name: document.getElementById('presetName').value, channels: channels.join(',') }, true);
+  }
+
+  function savePreset() {
+    presetRequest('/api/presets/save', { name: document.getElementById('presetNewName').value,
+                                        channel: document.getElementById('presetSource').value }, false);
+  }
+
+  function deletePreset() {
+    presetRequest('/api/presets/delete', { name: document.getElementById('presetName').value }, false);
+  }
+
+  /**
+   * Lists every channel with its enable checkbox. Saving reloads the page so
+   * the table shows the enabled channels only.
+   */
+  function loadChannels() {
+    fetch('/api/channels')
+      .then(response => response.json())
+      .then(data => {
+        const list = document.getElementById('channelList');
+        list.innerHTML = '';
+        data.channels.forEach(c => {
+          list.insertAdjacentHTML('beforeend',
+            `<label><input type="checkbox" value="${c.channel}"${c.enabled ? ' checked' : ''}> ${c.name}</label> `);
+        });
+      })
+      .catch(error => console.error('Error fetching channels:', error));
+  }
+
+  function handleChannelsSubmit(event) {
+    event.preventDefault();
+    const statusDiv = document.getElementById('channelsStatus');
+    const channels = Array.from(document.querySelectorAll('#channelList input:checked')).map(box => box.value);
+    const body = new FormData();
+    body.append('enabled', channels.join(','));
+    fetch('/api/channels', { method: 'POST', body: body })
+      .then(response => {
+        if (!response.ok) return response.text().then(text => { throw new Error(text); });
+        statusDiv.textContent = 'Saved';
+        statusDiv.className = 'status status-ok';
+        setTimeout(() => location.reload(), 500);
+      })
+      .catch(error => {
+        statusDiv.textContent = 'Channel error: ' + error.message;
+        statusDiv.className = 'status status-error';
+      });
+  }
+
+  /**
+   * Shows the network in use and submits new credentials to /api/wifi.
+   */
+  function loadWifi() {
+    fetch('/api/wifi')
+      .then(response => response.json())
+      .then(data => {
+        document.getElementById('wifiSsid').value = data.ssid;
+        if (data.ap_active) {
+          const statusDiv = document.getElementById('wifiStatus');
+          statusDiv.textContent = data.connected ? `Connected to ${data.ssid}` : `Not connected to ${data.ssid}`;
+          statusDiv.className = data.connected ? 'status status-ok' : 'status status-error';
+        }
+      })
+      .catch(error => console.error('Error fetching WiFi state:', error));
+  }
+
+  function handleWifiSubmit(event) {
+    event.preventDefault();
+    const statusDiv = document.getElementById('wifiStatus');
+    fetch('/api/wifi', { method: 'POST', body: new FormData(event.target) })
+      .then(response => {
+        if (!response.ok) return response.text().then(text => { throw new Error(text); });
+        statusDiv.textContent = 'Saved. Connecting...';
+        statusDiv.className = 'status status-saving';
+        setTimeout(loadWifi, 10000);
+      })
+      .catch(error => {
+        statusDiv.textContent = 'WiFi error: ' + error.message;
+        statusDiv.className = 'status status-error';
+      });
+  }
+
   // --- Page Load Initialization ---
   window.addEventListener('load', () => {
     // Fetch initial data as soon as the page loads
@@ -235,6 +581,15 @@ const char HTML_CONTENT[] PROGMEM = R"rawliteral(
     
     // Attach the submit handler to the form
     document.getElementById('controlForm').addEventListener('submit', handleFormSubmit);
+
+    buildPresetChannels();
+    loadPresets();
+
+    document.getElementById('channelsForm').addEventListener('submit', handleChannelsSubmit);
+    loadChannels();
+
+    document.getElementById('wifiForm').addEventListener('submit', handleWifiSubmit);
+    loadWifi();
   });
 </script>
 </body>
@@ -242,295 +597,4201 @@ const char HTML_CONTENT[] PROGMEM = R"rawliteral(
 )rawliteral";
 
 //==============================================================================
-// Function: generateTableRows
+// Heap Accounting
 //==============================================================================
+// After setup() the firmware does not allocate from the heap in loop() or in
+// any of its web handlers: String concatenation fragments the small ESP8266
+// heap until large responses can no longer find a contiguous block. Responses
+// are rendered straight into the TCP send buffer (see WindowWriter) and log
+// lines are printed piecewise. The AsyncWebServer library still allocates its
+// own per-request objects; those are released as soon as the request ends.
+
 /**
- * @brief  Dynamically generates the HTML table rows for the web interface.
- * @return A String object containing the complete HTML for all table rows.
+ * @brief Heap statistics, refreshed from loop() and before status reports.
  */
-String generateTableRows() {
-  String rows = "";
-  for (int i = 0; i < NUM_SENSORS; i++) {
-    rows += "<tr>";
-    rows += "<td>" + sensorNames[i] + "</td>";
-    rows += "<td id='temp" + String(i) + "'>-</td>"; // Placeholder for live temperature
-    // Populate inputs with *user settings*, not live values
-    rows += "<td><input type='number' step='0.1' name='threshold" + String(i) + "' value='" + String(setting_HoldTemps[i]) + "'></td>";
-    rows += "<td><input type='number' step='0.1' name='cooling" + String(i) + "' value='" + String(setting_CoolingSpeeds[i]) + "'></td>";
-    rows += "<td><input type='number' step='0.1' name='lower" + String(i) + "' value='" + String(setting_LowerLimits[i]) + "'></td>";
-    rows += "<td><input type='number' step='1' name='hold" + String(i) + "' value='" + String(setting_HoldDurations[i]) + "'></td>";
-    rows += "<td id='time" + String(i) + "'>-</td>";  // Placeholder for remaining time
-    rows += "<td id='status" + String(i) + "'>-</td>"; // Placeholder for current status
-    rows += "</tr>";
+struct HeapStats {
+  uint32_t freeHeap;    // Free heap at the last sample (bytes)
+  uint32_t maxBlock;    // Largest contiguous free block at the last sample (bytes)
+  uint32_t minFreeHeap; // Lowest free heap observed since boot (bytes)
+};
+HeapStats heapStats = {0, 0, UINT32_MAX};
+
+/**
+ * @brief Returns the size of the largest block the heap can currently hand out.
+ */
+uint32_t heapMaxBlock() {
+#ifdef ESP32
+  return ESP.getMaxAllocHeap();
+#else
+  return ESP.getMaxFreeBlockSize();
+#endif
+}
+
+/**
+ * @brief Samples the free heap and tracks its low-water mark.
+ * @param withMaxBlock Also walk the free list for the largest block (slower).
+ */
+void sampleHeap(bool withMaxBlock) {
+  heapStats.freeHeap = ESP.getFreeHeap();
+  if (heapStats.freeHeap < heapStats.minFreeHeap) {
+    heapStats.minFreeHeap = heapStats.freeHeap;
+  }
+  if (withMaxBlock) {
+    heapStats.maxBlock = heapMaxBlock();
   }
-  return rows;
 }
 
+#ifdef HOST_BUILD
+// Host-build allocation hook. While a HeapGuardScope is active any call to
+// operator new aborts the process, so host runs of the firmware fail on the
+// first steady-state allocation instead of silently fragmenting the heap.
+// Every replaceable form of new and delete is defined, so each allocation and
+// its release go through the same pair of functions below. Those are kept out
+// of line, so the compiler never pairs an inlined free() with the built-in new.
+bool heapGuardArmed = false;
+
+/** @brief The allocation behind every operator new; nullptr when the heap is exhausted. */
+__attribute__((noinline)) void *hostAllocate(size_t size, size_t alignment) {
+  if (heapGuardArmed) {
+    fprintf(stderr, "heap guard: %u-byte allocation in steady state\n", (unsigned)size);
+    abort();
+  }
+  if (size == 0) size = 1;
+  if (alignment <= alignof(max_align_t)) return malloc(size);
+  void *block = nullptr;
+  return posix_memalign(&block, alignment, size) == 0 ? block : nullptr;
+}
+
+/** @brief The release behind every operator delete. */
+__attribute__((noinline)) void hostRelease(void *block) { free(block); }
+
+void *hostAllocateOrThrow(size_t size, size_t alignment) {
+  void *block = hostAllocate(size, alignment);
+  if (block == nullptr) throw std::bad_alloc();
+  return block;
+}
+
+void *operator new(size_t size) { return hostAllocateOrThrow(size, 0); }
+void *operator new[](size_t size) { return hostAllocateOrThrow(size, 0); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return hostAllocate(size, 0); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return hostAllocate(size, 0); }
+void operator delete(void *block) noexcept { hostRelease(block); }
+void operator delete[](void *block) noexcept { hostRelease(block); }
+void operator delete(void *block, size_t) noexcept { hostRelease(block); }
+void operator delete[](void *block, size_t) noexcept { hostRelease(block); }
+void operator delete(void *block, const std::nothrow_t &) noexcept { hostRelease(block); }
+void operator delete[](void *block, const std::nothrow_t &) noexcept { hostRelease(block); }
+#ifdef __cpp_aligned_new
+void *operator new(size_t size, std::align_val_t alignment) { return hostAllocateOrThrow(size, (size_t)alignment); }
+void *operator new[](size_t size, std::align_val_t alignment) { return hostAllocateOrThrow(size, (size_t)alignment); }
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  return hostAllocate(size, (size_t)alignment);
+}
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  return hostAllocate(size, (size_t)alignment);
+}
+void operator delete(void *block, std::align_val_t) noexcept { hostRelease(block); }
+void operator delete[](void *block, std::align_val_t) noexcept { hostRelease(block); }
+void operator delete(void *block, size_t, std::align_val_t) noexcept { hostRelease(block); }
+void operator delete[](void *block, size_t, std::align_val_t) noexcept { hostRelease(block); }
+void operator delete(void *block, std::align_val_t, const std::nothrow_t &) noexcept { hostRelease(block); }
+void operator delete[](void *block, std::align_val_t, const std::nothrow_t &) noexcept { hostRelease(block); }
+#endif
+#endif
 
-//==============================================================================
-// Function: setup
-//==============================================================================
 /**
- * @brief Main initialization function. Runs once on boot.
- * @details Initializes Serial, WiFi, Pins, Sensors, and configures
- * all web server endpoints.
+ * @brief Marks a steady-state region that must not allocate.
+ * @note Compiles to nothing on the device; arms the allocation hook on the host.
  */
-void setup() {
-  Serial.begin(115200);
+class HeapGuardScope {
+#ifdef HOST_BUILD
+ public:
+  HeapGuardScope() : wasArmed(heapGuardArmed) { heapGuardArmed = true; }
+  ~HeapGuardScope() { heapGuardArmed = wasArmed; }
+ private:
+  bool wasArmed;
+#endif
+};
 
-  // --- WiFi Connection ---
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid, password);
-  if (WiFi.waitForConnectResult() != WL_CONNECTED) {
-    Serial.println("WiFi Failed!");
-    return; // Halt execution if WiFi fails
-  }
-  Serial.print("ESP IP Address: http://");
-  Serial.println(WiFi.localIP());
 
-  // --- Hardware Initialization ---
-  for (int i = 0; i < NUM_SENSORS; i++) {
-    pinMode(outputPins[i], OUTPUT);
-    digitalWrite(outputPins[i], LOW); // Ensure all outputs are off on boot
-    liveSetpoints[i] = setting_HoldTemps[i]; // Initialize live setpoint from settings
-  }
-  sensors.begin(); // Initialize the DallasTemperature library
-  // Set to non-blocking mode
-  sensors.setWaitForConversion(false);
-  // Send the first temperature request
-  sensors.requestTemperatures();
+//==============================================================================
+// Profiling
+//==============================================================================
+// Sections of loop() and the web handlers are timed with the CPU cycle
+// counter and fed into fixed log2-bucket histograms: recording a sample is
+// two counter reads, a count-leading-zeros and three additions, cheap enough
+// to stay enabled in production. The 500 ms and 2000 ms tasks also record how
+// late they ran. /profile reports count, p50, p99 and max for every section.
 
+/**
+ * @brief Profiled sections: identifier, name and whether samples are cycles.
+ * @details Cycle samples are reported in microseconds; the task lateness
+ * samples are recorded in microseconds directly.
+ */
+#define PROFILE_SECTIONS(X) \
+  X(PROFILE_LOOP,           "loop",           true)  \
+  X(PROFILE_ACQUISITION,    "acquisition",    true)  \
+  X(PROFILE_CONTROL,        "control",        true)  \
+  X(PROFILE_HTTP_INDEX,     "http_index",     true)  \
+  X(PROFILE_HTTP_DATA,      "http_data",      true)  \
+  X(PROFILE_HTTP_UPDATE,    "http_update",    true)  \
+  X(PROFILE_HTTP_METRICS,   "http_metrics",   true)  \
+  X(PROFILE_FLASH_WRITE,    "flash_write",    true)  \
+  X(PROFILE_OUTPUT_COMMIT,  "output_commit",  true)  \
+  X(PROFILE_SENSOR_LATENESS, "sensor_task_lateness", false) \
+  X(PROFILE_LOGIC_LATENESS,  "logic_task_lateness",  false) \
+  X(PROFILE_WAKE_LATENESS,   "wake_lateness",        false)
 
-  //=======================================
-  // --- Web Server Endpoints ---
-  //=======================================
+#define PROFILE_SECTION_ENUM(id, name, cycles) id,
+#define PROFILE_SECTION_NAME(id, name, cycles) name,
+#define PROFILE_SECTION_CYCLES(id, name, cycles) cycles,
 
-  /**
-   * @brief Serves the main HTML page.
-   * This endpoint constructs the page by taking the PROGMEM template
-   * and injecting the dynamically generated table rows.
-   */
-  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-    String html = FPSTR(HTML_CONTENT);
-    // Find the placeholder and replace it with actual HTML
-    html.replace("", generateTableRows());
-    request->send(200, "text/html", html);
-  });
+enum ProfileSection : uint8_t { PROFILE_SECTIONS(PROFILE_SECTION_ENUM) PROFILE_SECTION_COUNT, PROFILE_NONE = 0xFF };
+const char *const PROFILE_SECTION_NAMES[PROFILE_SECTION_COUNT] = { PROFILE_SECTIONS(PROFILE_SECTION_NAME) };
+const bool PROFILE_SECTION_IN_CYCLES[PROFILE_SECTION_COUNT] = { PROFILE_SECTIONS(PROFILE_SECTION_CYCLES) };
 
-  /**
-   * @brief Serves real-time sensor data as a JSON array.
-   * This endpoint is called by the JavaScript 'fetch' function every 2 seconds.
-   * It builds a JSON array where each object represents a sensor's current state.
-   */
-  server.on("/data", HTTP_GET, [](AsyncWebServerRequest *request) {
-    // Use StaticJsonDocument for fixed size, preventing memory fragmentation
-    StaticJsonDocument<1536> doc;
-    // The root of the response must be an array for 'data.forEach' in JS
-    JsonArray sensors_array = doc.to<JsonArray>();
+const int HISTOGRAM_BUCKETS = 33; // Bucket 0 holds zeros; bucket b holds [2^(b-1), 2^b)
 
-    for (int i = 0; i < NUM_SENSORS; i++) {
-      JsonObject sensor = sensors_array.add<JsonObject>();
-      sensor["temp"] = lastTemperatures[i];
-      
-      String remainingStr = "-";
-      String statusStr = "Idle";
-      
-      if (holdPhaseActive[i]) {
-        unsigned long holdDurationSecs = setting_HoldDurations[i] * 60;
-        unsigned long elapsedSecs = (millis() - phaseStartMillis[i]) / 1000;
-        
-        if (elapsedSecs < holdDurationSecs) {
-          unsigned long remainingSecs = holdDurationSecs - elapsedSecs;
-          // Format time as M:SS for better readability
-          unsigned long remMinutes = remainingSecs / 60;
-          unsigned long remSeconds = remainingSecs % 60;
-          remainingStr = String(remMinutes) + ":" + (remSeconds < 10 ? "0" : "") + String(remSeconds);
-        }
-        statusStr = "Holding";
-        
-      } else if (coolingPhaseActive[i]) {
-        statusStr = "Cooling";
-      }
+/**
+ * @brief A fixed-size log2 histogram of 32-bit samples.
+ */
+struct LatencyHistogram {
+  uint32_t buckets[HISTOGRAM_BUCKETS];
+  uint32_t count;
+  uint32_t max;
+  uint64_t sum;
 
-      sensor["time_rem"] = remainingStr;
-      sensor["status"] = statusStr;
-    }
+  void record(uint32_t value) {
+    buckets[value ? 32 - __builtin_clz(value) : 0]++;
+    count++;
+    sum += value;
+    if (value > max) max = value;
+  }
 
-    // Serialize and send the JSON response
-    String json_response;
-    serializeJson(doc, json_response);
-    request->send(200, "application/json", json_response);
-  });
+  /** @brief Upper bound of bucket b (inclusive). */
+  static uint32_t bucketLimit(int b) { return b >= 32 ? UINT32_MAX : (1UL << b) - 1; }
 
   /**
-   * @brief Handles POST requests from the form to update settings.
-   * This endpoint parses the form data submitted by the user and updates
-   * the global process parameter arrays.
+   * @brief Approximates a percentile as the upper bound of its bucket.
+   * @param permille The percentile in tenths of a percent (500 = p50, 990 = p99).
    */
-  server.on("/update", HTTP_POST, [](AsyncWebServerRequest *request) {
-    // Iterate through all possible parameters
-    for (int i = 0; i < NUM_SENSORS; i++) {
-      if (request->hasParam("threshold" + String(i), true)) {
-        setting_HoldTemps[i] = request->getParam("threshold" + String(i), true)->value().toFloat();
-      }
-      if (request->hasParam("cooling" + String(i), true)) {
-        setting_CoolingSpeeds[i] = request->getParam("cooling" + String(i), true)->value().toFloat();
-      }
-      if (request->hasParam("lower" + String(i), true)) {
-        setting_LowerLimits[i] = request->getParam("lower" + String(i), true)->value().toFloat();
-      }
-      if (request->hasParam("hold" + String(i), true)) {
-        setting_HoldDurations[i] = request->getParam("hold" + String(i), true)->value().toInt();
-      }
-    }
-    
-    // Optional: Reset all logic to IDLE state after settings are saved.
-    // This ensures a clean start with the new parameters.
-    for(int i=0; i < NUM_SENSORS; i++) {
-        holdPhaseActive[i] = false;
-        coolingPhaseActive[i] = false;
-        liveSetpoints[i] = setting_HoldTemps[i]; // Reset live setpoint to new setting
-        Serial.println("Sensor " + String(i) + ": Settings updated, cycle reset to Idle.");
+  uint32_t percentile(uint32_t permille) const {
+    if (count == 0) return 0;
+    uint64_t rank = ((uint64_t)count * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+      seen += buckets[b];
+      if (seen >= rank) return bucketLimit(b) < max ? bucketLimit(b) : max;
     }
-    
-    request->send(200, "text/plain", "OK"); // Send a simple 'OK' response
-  });
+    return max;
+  }
+};
 
-  // Handle 404 Not Found errors
-  server.onNotFound([](AsyncWebServerRequest *request){
-    request->send(404, "text/plain", "Not found");
-  });
+LatencyHistogram profileHistograms[PROFILE_SECTION_COUNT];
 
-  // Start the web server
-  server.begin();
+/** @brief Adds one sample to a section's histogram. */
+inline void profileRecord(ProfileSection section, uint32_t value) {
+  profileHistograms[section].record(value);
 }
 
-
-//==============================================================================
-// Function: loop
-//==============================================================================
 /**
- * @brief Main execution loop.
- * @details This loop is non-blocking. It uses millis() to schedule two
- * main tasks:
- * 1. Reading sensor data (infrequent, every 2s).
- * 2. Running the control logic state machine (frequent, every 500ms).
+ * @brief Times the enclosing block in CPU cycles.
  */
-void loop() {
-  unsigned long currentMillis = millis();
-  static unsigned long lastSensorRead = 0;
-  static unsigned long lastLogicUpdate = 0;
+class ProfileScope {
+ public:
+  explicit ProfileScope(ProfileSection section) : section(section), start(ESP.getCycleCount()) {}
+  ~ProfileScope() {
+    if (section != PROFILE_NONE) profileRecord(section, ESP.getCycleCount() - start);
+  }
 
-  // --- Task 1: Read Sensors (Interval: 2000ms) ---
-  // This task reads the results from the *previous* request
-  // and issues a new non-blocking request for the *next* cycle.
-  if (currentMillis - lastSensorRead >= 2000) {
-    lastSensorRead = currentMillis;
-    
-    // Retrieve the temperature for each sensor by its address
-    for (int i = 0; i < NUM_SENSORS; i++) {
-      float temp = sensors.getTempC(sensorAddresses[i]);
-      
-      // 85.0 is a power-on reset value, -127 is disconnected
-      if(temp != DEVICE_DISCONNECTED_C && temp != 85.0) {
-        lastTemperatures[i] = temp;
-      } else {
-        lastTemperatures[i] = -127.0; // Use error value
-        Serial.println("Error reading sensor " + String(i));
-      }
-    }
+ private:
+  ProfileSection section;
+  uint32_t start;
+};
 
-    // Issue a non-blocking request for all sensors on the bus for the next read cycle
-    sensors.requestTemperatures(); 
+/**
+ * @brief Records how late a periodic task ran, in microseconds.
+ * @param lastRunMicros micros() of the task's previous run (0 before the first run); updated.
+ */
+void profileLateness(ProfileSection section, uint32_t &lastRunMicros, uint32_t intervalMicros) {
+  uint32_t now = micros();
+  if (lastRunMicros != 0) {
+    uint32_t elapsed = now - lastRunMicros;
+    profileRecord(section, elapsed > intervalMicros ? elapsed - intervalMicros : 0);
   }
+  lastRunMicros = now;
+}
 
-  // --- Task 2: Control Logic (Interval: 500ms) ---
-  // Run logic more frequently than sensor reads for better responsiveness.
-  if (currentMillis - lastLogicUpdate >= 500) {
-    unsigned long elapsedSinceUpdate = currentMillis - lastLogicUpdate;
-    lastLogicUpdate = currentMillis;
 
-    for (int i = 0; i < NUM_SENSORS; i++) {
-      float temp = lastTemperatures[i];
-      
-      // Skip logic for this sensor if it's disconnected
-      if (temp == -127.0) continue; 
+//==============================================================================
+// Output Drivers
+//==============================================================================
+// The control step only records the wanted heater states (outputSet); at the
+// end of the tick outputCommit() applies all of them at once. With the
+// 74HC595 driver that is one SPI transfer followed by one latch pulse, so all
+// outputs switch together; with the MCP23017 driver one I2C write per chip;
+// with the GPIO driver one write to the GPIO clear register and one to the set
+// register (gpioWrite), so the heaters of a tick also switch within a few
+// cycles of each other. The time a commit takes is profiled as "output_commit".
+//
+// The watchdog interrupt cannot use the bus, so with an expander it switches
+// the outputs off through OUTPUT_DISABLE_PIN instead (outputForceOff).
 
-      //===============================================
-      // --- State Machine Logic for Sensor [i] ---
-      //===============================================
+#if OUTPUT_DRIVER == OUTPUT_DRIVER_GPIO
+const char *const OUTPUT_DRIVER_NAME = "gpio";
+#elif OUTPUT_DRIVER == OUTPUT_DRIVER_74HC595
+const char *const OUTPUT_DRIVER_NAME = "74hc595";
+#else
+const char *const OUTPUT_DRIVER_NAME = "mcp23017";
+#endif
+const uint32_t OUTPUT_SPI_HZ = 4000000;  // 74HC595 shift clock
+const uint32_t OUTPUT_I2C_HZ = 400000;   // MCP23017 bus clock
+const uint8_t MCP23017_ADDRESS = 0x20;   // First chip, A2..A0 = 0
+const uint8_t MCP23017_IODIRA = 0x00;    // Register addresses with IOCON.BANK = 0
+const uint8_t MCP23017_OLATA = 0x14;
 
-      // --- 1. HEATING/HOLDING LOGIC (Output Control) ---
-      // This logic controls the physical output pin (heater).
-      
-      // Condition: Turn ON output (Heater ON)
-      // If temp is below the "live" setpoint, turn on the heater.
-      if (temp < liveSetpoints[i] && !outputState[i]) {
-        digitalWrite(outputPins[i], HIGH);
-        outputState[i] = true;
-        Serial.println("Sensor " + String(i) + ": Temp below setpoint. Output ON.");
-
-      // Condition: Turn OFF output (Heater OFF, with Hysteresis)
-      // If temp rises *above* the setpoint + hysteresis, turn off.
-      } else if (temp > (liveSetpoints[i] + HYSTERESIS) && outputState[i]) {
-        digitalWrite(outputPins[i], LOW);
-        outputState[i] = false;
-        Serial.println("Sensor " + String(i) + ": Temp above setpoint+hysteresis. Output OFF.");
-        
-        // --- State Transition: IDLE -> HOLD ---
-        // If we just reached the temp (heater turned off) and are not already in a phase,
-        // start the HOLD phase.
-        if (!holdPhaseActive[i] && !coolingPhaseActive[i]) {
-            holdPhaseActive[i] = true;
-            phaseStartMillis[i] = currentMillis; // Start the hold timer
-            Serial.println("Sensor " + String(i) + ": Hold phase started.");
-        }
+constexpr int SHIFT_REGISTER_COUNT = highestOutputBit() / 8 + 1;
+constexpr int MCP23017_COUNT = highestOutputBit() / 16 + 1;
+
+/**
+ * @brief Heater output state, one bit per channel, reported by /status.
+ */
+struct OutputState {
+  uint32_t wanted;   // Set by outputSet() during the tick
+  uint32_t applied;  // State of the last successful commit
+  bool dirty;        // Commit even if wanted == applied (after begin or a failed transfer)
+  uint32_t commits;
+  uint32_t errors;   // Failed I2C transfers
+};
+OutputState outputs = {0, 0, true, 0, 0};
+
+/** @brief Records the wanted state of a channel's heater; applied by outputCommit(). */
+inline void outputSet(int channel, bool on) {
+  if (on) outputs.wanted |= 1UL << channel;
+  else outputs.wanted &= ~(1UL << channel);
+}
+
+/** @brief Maps a channel mask to the output bits (GPIO or expander) of those channels. */
+uint64_t outputImage(uint32_t channels) {
+  uint64_t image = 0;
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    if (channels & (1UL << i)) image |= 1ULL << CHANNELS[i].outputPin;
+  }
+  return image;
+}
+
+/** @brief GPIO bits of the outputs of every channel from i on. */
+constexpr uint64_t gpioOutputMask(int i = 0) {
+  return i >= NUM_SENSORS ? 0 : (1ULL << CHANNELS[i].outputPin) | gpioOutputMask(i + 1);
+}
+
+constexpr int bitCount(uint64_t value) { return value == 0 ? 0 : (int)(value & 1) + bitCount(value >> 1); }
+
+#if OUTPUT_DRIVER == OUTPUT_DRIVER_GPIO
+constexpr uint64_t GPIO_OUTPUT_MASK = gpioOutputMask();
+static_assert(bitCount(GPIO_OUTPUT_MASK) == NUM_SENSORS && GPIO_OUTPUT_MASK >> (MAX_OUTPUT_PIN + 1) == 0,
+              "Every channel needs its own output bit in the GPIO registers");
+#endif
+
+/**
+ * @brief Drives the GPIOs in clear LOW and those in set HIGH, one register
+ * write each. Safe from an interrupt.
+ */
+void IRAM_ATTR gpioWrite(uint64_t set, uint64_t clear) {
+#if defined(HOST_BUILD)
+  for (int pin = 0; pin <= MAX_OUTPUT_PIN; pin++) {
+    if (clear >> pin & 1) digitalWrite(pin, LOW);
+    if (set >> pin & 1) digitalWrite(pin, HIGH);
+  }
+#elif defined(ESP32)
+  GPIO.out_w1tc = (uint32_t)clear;
+  GPIO.out_w1ts = (uint32_t)set;
+  #if SOC_GPIO_PIN_COUNT > 32
+  GPIO.out1_w1tc.val = (uint32_t)(clear >> 32); // GPIO 32 and up
+  GPIO.out1_w1ts.val = (uint32_t)(set >> 32);
+  #endif
+#else
+  GPOC = (uint32_t)clear & 0xFFFF;
+  GPOS = (uint32_t)set & 0xFFFF;
+  if (clear & (1UL << 16)) GP16O &= ~1; // GPIO 16 sits in the RTC block with its own register
+  if (set & (1UL << 16)) GP16O |= 1;
+#endif
+}
+
+#if OUTPUT_DRIVER == OUTPUT_DRIVER_MCP23017
+/** @brief Writes two consecutive registers (A and B) of one MCP23017. */
+bool mcp23017Write(int chip, uint8_t reg, uint16_t value) {
+  Wire.beginTransmission(MCP23017_ADDRESS + chip);
+  Wire.write(reg);
+  Wire.write((uint8_t)value);
+  Wire.write((uint8_t)(value >> 8)); // Sequential mode: the B register follows
+  return Wire.endTransmission() == 0;
+}
+#endif
+
+/**
+ * @brief Applies the wanted output state in one batch.
+ * @note Called from loop() at the end of the control tick.
+ */
+void outputCommit() {
+  if (outputs.wanted == outputs.applied && !outputs.dirty) return;
+  ProfileScope profile(PROFILE_OUTPUT_COMMIT);
+  uint32_t wanted = outputs.wanted;
+  bool ok = true;
+#if OUTPUT_DRIVER == OUTPUT_DRIVER_GPIO
+  uint64_t on = outputImage(wanted);
+  gpioWrite(on, GPIO_OUTPUT_MASK & ~on);
+#elif OUTPUT_DRIVER == OUTPUT_DRIVER_74HC595
+  uint32_t image = (uint32_t)outputImage(wanted);
+  SPI.beginTransaction(SPISettings(OUTPUT_SPI_HZ, MSBFIRST, SPI_MODE0));
+  for (int r = SHIFT_REGISTER_COUNT - 1; r >= 0; r--) SPI.transfer((uint8_t)(image >> (8 * r))); // Farthest first
+  SPI.endTransaction();
+  digitalWrite(OUTPUT_LATCH_PIN, HIGH); // All outputs change on this edge
+  digitalWrite(OUTPUT_LATCH_PIN, LOW);
+#else
+  uint32_t image = (uint32_t)outputImage(wanted);
+  for (int c = 0; c < MCP23017_COUNT; c++) {
+    if (!mcp23017Write(c, MCP23017_OLATA, (uint16_t)(image >> (16 * c)))) ok = false;
+  }
+#endif
+  outputs.commits++;
+  if (ok) {
+    outputs.applied = wanted;
+    outputs.dirty = false;
+  } else {
+    outputs.errors++; // Retried on the next tick
+  }
+}
+
+/** @brief Switches every heater off now. Called from loop() before a reboot. */
+void outputAllOff() {
+  outputs.wanted = 0;
+  outputs.dirty = true;
+  outputCommit();
+}
+
+/**
+ * @brief Sets up the output driver with every heater off. Called first in setup().
+ */
+void outputBegin() {
+#if OUTPUT_DRIVER == OUTPUT_DRIVER_GPIO
+  gpioWrite(0, GPIO_OUTPUT_MASK); // Ensure all outputs are off on boot, before they become outputs
+  for (int i = 0; i < NUM_SENSORS; i++) pinMode(CHANNELS[i].outputPin, OUTPUT);
+  outputAllOff();
+#elif OUTPUT_DRIVER == OUTPUT_DRIVER_74HC595
+  digitalWrite(OUTPUT_DISABLE_PIN, HIGH); // /OE: outputs stay disabled until the registers are cleared
+  pinMode(OUTPUT_DISABLE_PIN, OUTPUT);
+  pinMode(OUTPUT_LATCH_PIN, OUTPUT);
+  digitalWrite(OUTPUT_LATCH_PIN, LOW);
+  SPI.begin();
+  outputAllOff();
+  digitalWrite(OUTPUT_DISABLE_PIN, LOW);
+#else
+  pinMode(OUTPUT_DISABLE_PIN, OUTPUT);
+  digitalWrite(OUTPUT_DISABLE_PIN, LOW); // /RESET pulse: all pins become inputs (heaters off)
+  delayMicroseconds(10);
+  digitalWrite(OUTPUT_DISABLE_PIN, HIGH);
+  Wire.begin(OUTPUT_SDA_PIN, OUTPUT_SCL_PIN);
+  Wire.setClock(OUTPUT_I2C_HZ);
+  outputAllOff(); // Latches cleared before the pins become outputs
+  for (int c = 0; c < MCP23017_COUNT; c++) {
+    if (!mcp23017Write(c, MCP23017_IODIRA, 0x0000)) Serial.printf("MCP23017 at 0x%02X not responding\n", MCP23017_ADDRESS + c);
+  }
+#endif
+}
+
+/**
+ * @brief Switches every heater off without the bus. Safe from an interrupt.
+ * @details The expander drivers stay off until the next outputBegin(), i.e. the reboot.
+ */
+void IRAM_ATTR outputForceOff() {
+#if OUTPUT_DRIVER == OUTPUT_DRIVER_GPIO
+  gpioWrite(0, GPIO_OUTPUT_MASK);
+#elif OUTPUT_DRIVER == OUTPUT_DRIVER_74HC595
+  digitalWrite(OUTPUT_DISABLE_PIN, HIGH);
+#else
+  digitalWrite(OUTPUT_DISABLE_PIN, LOW);
+#endif
+}
+
+
+//==============================================================================
+// Power Management
+//==============================================================================
+// The control work happens every 500 ms and the sensors are read every
+// 2000 ms; in between, loop() would spin at full power and warm the
+// enclosure. In low-power mode (opt-in, see LOW_POWER_DEFAULT and /api/power)
+// loop() instead sleeps until its next deadline: the radio uses light sleep
+// (ESP8266) or modem sleep (ESP32) and wakes for the access point's DTIM
+// beacons, and the CPU idles. Web traffic is still handled while loop()
+// sleeps, and a web command ends the sleep at once so it is applied without
+// waiting for the next tick. The price is a longer HTTP response time while
+// the radio sleeps.
+//
+// How late loop() wakes compared to its deadline is profiled as
+// "wake_lateness". Current cannot be measured on the board, so /status
+// reports an estimate from the time spent asleep and the typical draw of the
+// chip in each state (POWER_ACTIVE_MA, POWER_SLEEP_MA).
+
+#ifndef LOW_POWER_DEFAULT
+  #define LOW_POWER_DEFAULT 0 // 1: start in low-power mode
+#endif
+
+const uint32_t POWER_MIN_NAP = 10;   // Shorter gaps are not worth entering sleep (ms)
+const uint32_t POWER_WAKE_MARGIN = 2; // Wake this much before the deadline (ms)
+#ifdef ESP32
+const float POWER_ACTIVE_MA = 50.0f; // Typical draw, CPU running, radio idle (mA)
+const float POWER_SLEEP_MA = 20.0f;  // Typical draw in modem sleep between beacons (mA)
+#else
+const float POWER_ACTIVE_MA = 70.0f;
+const float POWER_SLEEP_MA = 3.0f;   // Light sleep, associated (mA)
+#endif
+
+/**
+ * @brief Low-power mode state and statistics, reported by /status.
+ */
+struct PowerState {
+  bool enabled;
+  std::atomic<int8_t> request;      // Mode change from the web handler: -1 none, 0 off, 1 on
+  std::atomic<bool> wakeRequested;  // A web command is waiting for loop()
+  uint32_t nextDeadline;            // millis() of loop()'s next scheduled work
+  uint64_t sleptMicros;             // Time spent in powerSleep() since enabled
+  uint64_t awakeMicros;             // Time spent outside powerSleep() since enabled
+  uint32_t lastTransitionMicros;
+  uint32_t naps;
+  uint32_t earlyWakes;              // Naps ended by a web command
+};
+PowerState power = {false, {-1}, {false}, 0, 0, 0, 0, 0, 0};
+
+#ifdef ESP32
+TaskHandle_t loopTaskHandle = nullptr;
+#endif
+
+/**
+ * @brief Ends a sleep in progress so loop() handles new work at once.
+ * @note Called from the web callbacks after they queue work for loop().
+ */
+void powerWake() {
+  power.wakeRequested.store(true, std::memory_order_release);
+#ifdef ESP32
+  if (loopTaskHandle != nullptr) xTaskNotifyGive(loopTaskHandle);
+#elif !defined(HOST_BUILD)
+  esp_schedule();
+#endif
+}
+
+/** @brief Switches the radio's sleep mode. Called from loop(). */
+void powerApply(bool enabled) {
+  if (enabled == power.enabled) return;
+#ifdef ESP32
+  loopTaskHandle = xTaskGetCurrentTaskHandle();
+  WiFi.setSleep(enabled ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM); // MIN_MODEM is the SDK default
+#else
+  WiFi.setSleepMode(enabled ? WIFI_LIGHT_SLEEP : WIFI_MODEM_SLEEP); // MODEM_SLEEP is the SDK default
+#endif
+  power.enabled = enabled;
+  power.sleptMicros = 0;
+  power.awakeMicros = 0;
+  power.naps = 0;
+  power.earlyWakes = 0;
+  power.lastTransitionMicros = micros();
+}
+
+/**
+ * @brief Sleeps until shortly before power.nextDeadline, or until powerWake().
+ * @note Called at the top of loop(), outside its profile and heap guard.
+ */
+void powerSleep() {
+  int8_t request = power.request.exchange(-1);
+  if (request >= 0) powerApply(request == 1);
+  if (!power.enabled) return;
+
+  uint32_t start = micros();
+  power.awakeMicros += start - power.lastTransitionMicros;
+  power.lastTransitionMicros = start;
+  int32_t remaining = (int32_t)(power.nextDeadline - millis()) - (int32_t)POWER_WAKE_MARGIN;
+  if (remaining < (int32_t)POWER_MIN_NAP || power.wakeRequested.exchange(false)) return;
+
+#ifdef ESP32
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(remaining));
+#elif !defined(HOST_BUILD)
+  esp_delay(remaining, []() { return !power.wakeRequested.load(std::memory_order_acquire); });
+#endif
+
+  uint32_t end = micros();
+  power.sleptMicros += end - start;
+  power.lastTransitionMicros = end;
+  power.naps++;
+  if (power.wakeRequested.exchange(false)) {
+    power.earlyWakes++;
+  } else {
+    uint32_t target = start + (uint32_t)remaining * 1000;
+    profileRecord(PROFILE_WAKE_LATENESS, (int32_t)(end - target) > 0 ? end - target : 0);
+  }
+}
+
+/** @brief Estimated average supply current since low-power mode was enabled (mA). */
+float powerEstimatedCurrent() {
+  uint64_t total = power.sleptMicros + power.awakeMicros;
+  if (!power.enabled || total == 0) return POWER_ACTIVE_MA;
+  return (POWER_ACTIVE_MA * power.awakeMicros + POWER_SLEEP_MA * power.sleptMicros) / total;
+}
+
+
+//==============================================================================
+// Watchdog
+//==============================================================================
+// A hung sensor read, a runaway control tick or a stuck web handler would
+// leave every heater in the state it was last switched to. A hardware timer
+// interrupt checks every WATCHDOG_TICK that each watched section finishes
+// within its budget and that the periodic ones keep running. On an overrun it
+// drives every output LOW from interrupt context, so this works while loop()
+// is stuck, and keeps them LOW until the reset. Which section overran and by
+// how much is written to RTC memory, which survives the reset. Once loop()
+// runs again it saves the run state like a firmware update does and reboots.
+// If loop() never returns the chip's own watchdog resets it (ESP8266); on the
+// ESP32 the outputs stay LOW until the board is reset by hand.
+//
+// /status reports the longest pass of every section and the last trip.
+
+const uint32_t WATCHDOG_TICK = 50;             // Interrupt period (ms)
+const uint32_t WATCHDOG_MAGIC = 0x44574547;    // "GEWD"
+
+/**
+ * @brief Watched sections: identifier, name, budget for one pass (ms) and the
+ * longest allowed gap between passes (ms, 0 for sections that only run on demand).
+ */
+#define WATCHDOG_SECTIONS(X) \
+  X(WATCHDOG_ACQUISITION, "acquisition", 1500, 6000) \
+  X(WATCHDOG_CONTROL,     "control",      250, 2000) \
+  X(WATCHDOG_WEB,         "web",          500,    0)
+
+#define WATCHDOG_SECTION_ENUM(id, name, budget, period) id,
+#define WATCHDOG_SECTION_NAME(id, name, budget, period) name,
+#define WATCHDOG_SECTION_SLOT(id, name, budget, period) {budget, period, 0, 0, 0},
+
+enum WatchdogSection : uint8_t { WATCHDOG_SECTIONS(WATCHDOG_SECTION_ENUM) WATCHDOG_SECTION_COUNT };
+const char *const WATCHDOG_SECTION_NAMES[WATCHDOG_SECTION_COUNT] = { WATCHDOG_SECTIONS(WATCHDOG_SECTION_NAME) };
+
+/**
+ * @brief Deadlines and statistics of one watched section.
+ * @note Kept in RAM, not flash, because the interrupt reads it while a flash
+ * write may have the cache disabled.
+ */
+struct WatchdogSlot {
+  uint32_t budget;            // ms
+  uint32_t period;            // ms, 0 if not periodic
+  volatile uint32_t entered;  // millis() | 1 while inside the section, else 0
+  volatile uint32_t lastPass; // millis() when the section last finished
+  uint32_t longest;           // Longest pass so far (ms)
+};
+WatchdogSlot watchdogSlots[WATCHDOG_SECTION_COUNT] = { WATCHDOG_SECTIONS(WATCHDOG_SECTION_SLOT) };
+
+/**
+ * @brief The last trip, kept in RTC memory across the reset.
+ * @note 32-bit fields only: the ESP8266 RTC memory is word-addressed.
+ */
+struct WatchdogRecord {
+  uint32_t magic;
+  uint32_t section;   // WatchdogSection that overran
+  uint32_t overrun;   // Time past its budget or deadline, until the reset (ms)
+  uint32_t uptime;    // millis() at the trip
+  uint32_t trips;     // Trips since power-on
+  uint32_t pending;   // 1 until the next boot has reported the trip
+  uint32_t check;     // ~(magic ^ section ^ overrun ^ uptime ^ trips ^ pending)
+};
+
+#if defined(HOST_BUILD)
+WatchdogRecord watchdogRtc;
+volatile WatchdogRecord *const watchdogRecord = &watchdogRtc;
+#elif defined(ESP32)
+RTC_NOINIT_ATTR WatchdogRecord watchdogRtc; // Not cleared by software or watchdog resets
+volatile WatchdogRecord *const watchdogRecord = &watchdogRtc;
+#else
+// RTC user memory block 0 (ESP.rtcUserMemoryRead() offset 0). Accessed
+// directly because the SDK call is not safe from an interrupt; the OTA
+// bootloader's command lives at block 64.
+volatile WatchdogRecord *const watchdogRecord = (volatile WatchdogRecord *)0x60001100;
+#endif
+
+/**
+ * @brief Trip state, and the record found at boot.
+ */
+struct WatchdogState {
+  volatile bool tripped;   // Outputs forced LOW; loop() must reboot
+  WatchdogRecord boot;     // Copy of the RTC record at boot
+  bool resetByWatchdog;    // This boot followed a trip
+};
+WatchdogState watchdog;
+
+uint32_t IRAM_ATTR watchdogCheckValue(volatile const WatchdogRecord &record) {
+  return ~(record.magic ^ record.section ^ record.overrun ^ record.uptime ^ record.trips ^ record.pending);
+}
+
+/**
+ * @brief Marks the enclosing block as a pass of a watched section.
+ */
+class WatchdogScope {
+ public:
+  explicit WatchdogScope(WatchdogSection section) : slot(watchdogSlots[section]), start(millis()) {
+    slot.entered = start | 1;
+  }
+  ~WatchdogScope() {
+    uint32_t now = millis();
+    if (now - start > slot.longest) slot.longest = now - start;
+    slot.lastPass = now; // Before leaving, so the interrupt never sees a stale gap
+    slot.entered = 0;
+  }
+
+ private:
+  WatchdogSlot &slot;
+  uint32_t start;
+};
+
+/**
+ * @brief Timer interrupt: forces the outputs LOW on an overrun and records it.
+ */
+void IRAM_ATTR watchdogCheck() {
+  uint32_t now = millis();
+  volatile WatchdogRecord &record = *watchdogRecord;
+  for (uint8_t s = 0; s < WATCHDOG_SECTION_COUNT; s++) {
+    const WatchdogSlot &slot = watchdogSlots[s];
+    uint32_t entered = slot.entered;
+    uint32_t overrun = 0;
+    if (entered != 0) {
+      if (now - entered > slot.budget) overrun = now - entered - slot.budget;
+    } else if (slot.period != 0 && now - slot.lastPass > slot.period) {
+      overrun = now - slot.lastPass - slot.period;
+    }
+    if (overrun == 0) continue;
+    if (!watchdog.tripped) {
+      watchdog.tripped = true;
+      record.section = s;
+      record.uptime = now;
+      record.trips = record.trips + 1;
+      record.pending = 1;
+    } else if (record.section != s || overrun <= record.overrun) {
+      continue;
+    }
+    record.overrun = overrun; // Grows while the section stays stuck
+    record.check = watchdogCheckValue(record);
+  }
+  if (watchdog.tripped) outputForceOff();
+}
+
+#ifdef ESP32
+hw_timer_t *watchdogTimer = nullptr;
+#endif
+
+/**
+ * @brief Reports the last trip and starts the timer interrupt.
+ * @note Called at the end of setup(), once the outputs are configured.
+ */
+void watchdogBegin() {
+  volatile WatchdogRecord &record = *watchdogRecord;
+  if (record.magic != WATCHDOG_MAGIC || record.check != watchdogCheckValue(record)) {
+    // Power-on: RTC memory holds garbage.
+    record.magic = WATCHDOG_MAGIC;
+    record.section = 0;
+    record.overrun = 0;
+    record.uptime = 0;
+    record.trips = 0;
+    record.pending = 0;
+  }
+  watchdog.boot.section = record.section;
+  watchdog.boot.overrun = record.overrun;
+  watchdog.boot.uptime = record.uptime;
+  watchdog.boot.trips = record.trips;
+  watchdog.resetByWatchdog = record.pending != 0 && record.section < WATCHDOG_SECTION_COUNT;
+  record.pending = 0;
+  record.check = watchdogCheckValue(record);
+  if (watchdog.resetByWatchdog) {
+    Serial.printf("Watchdog: reset after %s overran by %u ms at %u ms uptime\n",
+                  WATCHDOG_SECTION_NAMES[watchdog.boot.section], (unsigned)watchdog.boot.overrun,
+                  (unsigned)watchdog.boot.uptime);
+  }
+
+  uint32_t now = millis();
+  for (int s = 0; s < WATCHDOG_SECTION_COUNT; s++) watchdogSlots[s].lastPass = now;
+#if defined(ESP32)
+  watchdogTimer = timerBegin(1, 80, true); // 1 MHz
+  timerAttachInterrupt(watchdogTimer, watchdogCheck, true);
+  timerAlarmWrite(watchdogTimer, WATCHDOG_TICK * 1000, true);
+  timerAlarmEnable(watchdogTimer);
+#elif !defined(HOST_BUILD)
+  timer1_attachInterrupt(watchdogCheck);
+  timer1_enable(TIM_DIV256, TIM_EDGE, TIM_LOOP); // 80 MHz / 256 = 312.5 kHz
+  timer1_write(WATCHDOG_TICK * 312500 / 1000);
+#endif
+}
+
+
+//==============================================================================
+// Response Rendering
+//==============================================================================
+/**
+ * @brief Copies one window of a rendered document into a response buffer.
+ * @details Chunked responses are pulled by AsyncWebServer through a filler
+ * callback that asks for at most maxLen bytes starting at a byte offset.
+ * Renderers always walk the whole document; WindowWriter keeps only the bytes
+ * that fall inside the requested window and copies them directly into the TCP
+ * buffer, so no intermediate String and no per-request state is needed.
+ */
+class WindowWriter {
+ public:
+  WindowWriter(uint8_t *buffer, size_t maxLen, size_t offset)
+    : buffer(buffer), maxLen(maxLen), offset(offset), cursor(0), produced(0) {}
+
+  /** @brief Appends len bytes from RAM. */
+  void write(const char *data, size_t len) { copy(data, len, false); }
+
+  /** @brief Appends len bytes stored in PROGMEM. */
+  void write_P(PGM_P data, size_t len) { copy(data, len, true); }
+
+  /** @brief Appends a NUL-terminated string from RAM. */
+  void print(const char *text) { copy(text, strlen(text), false); }
+
+  /** @brief Appends formatted text. A single call is limited to 95 characters. */
+  void printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+  /**
+   * @brief Skips ahead to a document offset whose preceding content is known.
+   * @details Lets a renderer resume from a checkpoint recorded by an earlier
+   * chunk of the same (unchanged) document. Only valid before any output.
+   */
+  void skipTo(size_t documentOffset) { cursor = documentOffset; }
+
+  /** @brief Document offset of the next byte to be rendered. */
+  size_t position() const { return cursor; }
+
+  /** @brief Document offset of the first byte of the window. */
+  size_t windowStart() const { return offset; }
+
+  /** @brief Number of bytes copied into the buffer so far. */
+  size_t length() const { return produced; }
+
+  /** @brief True once the window is full; the rest of the document is discarded. */
+  bool full() const { return produced == maxLen; }
+
+ private:
+  void copy(const char *data, size_t len, bool progmem);
+
+  uint8_t *buffer;
+  size_t maxLen;
+  size_t offset;   // Document offset of the first byte in the window
+  size_t cursor;   // Document offset of the next byte to be rendered
+  size_t produced;
+};
+
+void WindowWriter::copy(const char *data, size_t len, bool progmem) {
+  size_t start = cursor;
+  cursor += len;
+  if (cursor <= offset || full()) return;
+
+  size_t skip = offset > start ? offset - start : 0;
+  size_t count = len - skip;
+  if (count > maxLen - produced) count = maxLen - produced;
+  if (progmem) {
+    memcpy_P(buffer + produced, data + skip, count);
+  } else {
+    memcpy(buffer + produced, data + skip, count);
+  }
+  produced += count;
+}
+
+void WindowWriter::printf(const char *format, ...) {
+  if (full()) return;
+  char text[96];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  if (len <= 0) return;
+  copy(text, (size_t)len < sizeof(text) ? (size_t)len : sizeof(text) - 1, false);
+}
+
+/** @brief A function that renders a complete document into a WindowWriter. */
+typedef void (*Renderer)(WindowWriter &out);
+
+/**
+ * @brief Sends a rendered document as a chunked response.
+ * @details The renderer runs once per TCP chunk, under a HeapGuardScope.
+ * @param section Profiled section receiving the render time of each chunk.
+ */
+void sendRendered(AsyncWebServerRequest *request, const char *contentType, Renderer render,
+                  ProfileSection section = PROFILE_NONE) {
+  AsyncWebServerResponse *response = request->beginChunkedResponse(contentType,
+    [render, section](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      ProfileScope profile(section);
+      WatchdogScope watched(WATCHDOG_WEB);
+      HeapGuardScope guard;
+      WindowWriter out(buffer, maxLen, index);
+      render(out);
+      return out.length();
+    });
+  request->send(response);
+}
+
+/**
+ * @brief A renderer that also takes a value captured when the request arrived.
+ * @details Every chunk of a response is rendered separately; capturing e.g. a
+ * ring position up front keeps all chunks rendering the same document.
+ */
+typedef void (*SnapshotRenderer)(WindowWriter &out, uint32_t snapshot);
+
+/**
+ * @brief Sends a snapshot-rendered document as a chunked response.
+ */
+void sendRendered(AsyncWebServerRequest *request, const char *contentType,
+                  SnapshotRenderer render, uint32_t snapshot, ProfileSection section = PROFILE_NONE) {
+  AsyncWebServerResponse *response = request->beginChunkedResponse(contentType,
+    [render, snapshot, section](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      ProfileScope profile(section);
+      WatchdogScope watched(WATCHDOG_WEB);
+      HeapGuardScope guard;
+      WindowWriter out(buffer, maxLen, index);
+      render(out, snapshot);
+      return out.length();
+    });
+  request->send(response);
+}
+
+
+//==============================================================================
+// Event Log
+//==============================================================================
+// State changes and sensor errors are recorded as compact binary records in a
+// lock-free ring instead of being printed on the spot. Producers (loop() and
+// the web callbacks) only reserve a slot and copy a few words; loop() later
+// formats the records and hands them to Serial only as fast as its TX buffer
+// accepts them, so logging never blocks control. The same ring is served as
+// text by /log.
+
+/**
+ * @brief Log events: identifier, level and message format.
+ * @details The format receives the record's value as its only argument.
+ */
+#define LOG_EVENTS(X) \
+  X(LOG_OUTPUT_ON,        LOG_LEVEL_DEBUG, "Temp %.2f below setpoint. Output ON.") \
+  X(LOG_OUTPUT_OFF,       LOG_LEVEL_DEBUG, "Temp %.2f above setpoint+hysteresis. Output OFF.") \
+  X(LOG_HOLD_STARTED,     LOG_LEVEL_INFO,  "Hold phase started at %.2f.") \
+  X(LOG_COOLING_STARTED,  LOG_LEVEL_INFO,  "Hold phase finished. Cooling phase started at %.2f.") \
+  X(LOG_COOLING_FINISHED, LOG_LEVEL_INFO,  "Cooling finished. Reached lower limit %.2f. Resetting to IDLE.") \
+  X(LOG_SENSOR_ERROR,     LOG_LEVEL_ERROR, "Error reading sensor (raw %.2f).") \
+  X(LOG_SETTINGS_UPDATED, LOG_LEVEL_INFO,  "Settings updated, cycle reset to Idle (threshold %.2f).") \
+  X(LOG_SETTINGS_REJECTED, LOG_LEVEL_WARN,  "Queued settings dropped: lower limit above threshold %.2f.") \
+  X(LOG_WIFI_CONNECTED,   LOG_LEVEL_INFO,  "WiFi connected after %.0f ms.") \
+  X(LOG_WIFI_LOST,        LOG_LEVEL_WARN,  "WiFi connection lost after %.0f s.") \
+  X(LOG_WIFI_FAILED,      LOG_LEVEL_WARN,  "WiFi connection failed. Retrying in %.0f s.") \
+  X(LOG_WIFI_AP_STARTED,  LOG_LEVEL_WARN,  "No WiFi for %.0f s. Fallback access point opened.") \
+  X(LOG_WIFI_AP_STOPPED,  LOG_LEVEL_INFO,  "Fallback access point closed.") \
+  X(LOG_CHANNELS_CHANGED, LOG_LEVEL_INFO,  "Enabled channels changed, %.0f active.")
+
+#define LOG_EVENT_ENUM(id, level, format) id,
+#define LOG_EVENT_LEVEL(id, level, format) level,
+#define LOG_EVENT_FORMAT(id, level, format) static const char id##_FORMAT[] PROGMEM = format;
+#define LOG_EVENT_FORMAT_PTR(id, level, format) id##_FORMAT,
+
+enum LogEvent : uint8_t { LOG_EVENTS(LOG_EVENT_ENUM) LOG_EVENT_COUNT };
+constexpr uint8_t LOG_EVENT_LEVELS[LOG_EVENT_COUNT] = { LOG_EVENTS(LOG_EVENT_LEVEL) };
+LOG_EVENTS(LOG_EVENT_FORMAT)
+static const char *const LOG_EVENT_FORMATS[LOG_EVENT_COUNT] PROGMEM = { LOG_EVENTS(LOG_EVENT_FORMAT_PTR) };
+
+/** @brief Level of an event, usable in constant expressions. */
+constexpr uint8_t logEventLevel(LogEvent event) { return LOG_EVENT_LEVELS[event]; }
+
+/**
+ * @brief Records an event. Events above LOG_LEVEL compile to nothing.
+ */
+#define LOG_EVENT(event, channel, value) \
+  do { if (logEventLevel(event) <= LOG_LEVEL) logPush(event, channel, value); } while (0)
+
+const uint8_t LOG_NO_CHANNEL = 0xFF; // Channel value for system-wide events
+const uint32_t LOG_CAPACITY = 64;    // Records kept in the ring (power of two)
+
+/**
+ * @brief One slot of the log ring.
+ * @note sequence is the slot's ticket + 1 once the record is complete, and 0
+ * while a producer is writing it.
+ */
+struct LogRecord {
+  std::atomic<uint32_t> sequence;
+  uint32_t timestamp; // millis() when the event was recorded
+  float value;
+  uint8_t event;
+  uint8_t channel;
+};
+
+/** @brief A consistent copy of a log record, taken by the readers. */
+struct LogEntry {
+  uint32_t timestamp;
+  float value;
+  uint8_t event;
+  uint8_t channel;
+};
+
+LogRecord logRing[LOG_CAPACITY];
+std::atomic<uint32_t> logHead(0); // Ticket of the next record to be written
+uint32_t logTail = 0;             // Ticket of the next record to print on Serial
+uint32_t logDropped = 0;          // Records overwritten before reaching Serial
+
+/**
+ * @brief Appends a record to the ring. Safe from loop() and web callbacks.
+ */
+void logPush(LogEvent event, uint8_t channel, float value) {
+  uint32_t ticket = logHead.fetch_add(1, std::memory_order_relaxed);
+  LogRecord &record = logRing[ticket % LOG_CAPACITY];
+  record.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  record.timestamp = millis();
+  record.value = value;
+  record.event = event;
+  record.channel = channel;
+  record.sequence.store(ticket + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Copies the record with the given ticket out of the ring.
+ * @return false if the record is still being written or was already overwritten.
+ */
+bool logRead(uint32_t ticket, LogEntry &entry) {
+  const LogRecord &record = logRing[ticket % LOG_CAPACITY];
+  if (record.sequence.load(std::memory_order_acquire) != ticket + 1) return false;
+  entry.timestamp = record.timestamp;
+  entry.value = record.value;
+  entry.event = record.event;
+  entry.channel = record.channel;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return record.sequence.load(std::memory_order_relaxed) == ticket + 1;
+}
+
+/**
+ * @brief Formats a log entry as one text line terminated by CRLF.
+ * @return Length of the line (always less than size).
+ */
+size_t formatLogEntry(const LogEntry &entry, char *line, size_t size) {
+  size_t len = 0;
+  int n = snprintf(line, size, "[%lu] ", (unsigned long)entry.timestamp);
+  if (n > 0) len += n;
+  if (entry.channel != LOG_NO_CHANNEL && len < size) {
+    n = snprintf(line + len, size - len, "Sensor %u: ", entry.channel);
+    if (n > 0) len += n;
+  }
+  if (len < size) {
+    PGM_P format = (PGM_P)pgm_read_ptr(&LOG_EVENT_FORMATS[entry.event]);
+    n = snprintf_P(line + len, size - len, format, entry.value);
+    if (n > 0) len += n;
+  }
+  if (len > size - 3) len = size - 3;
+  line[len++] = '\r';
+  line[len++] = '\n';
+  line[len] = '\0';
+  return len;
+}
+
+/**
+ * @brief Prints pending log records without blocking.
+ * @details Stops as soon as the next line does not fit into the Serial TX
+ * buffer; the remaining records are printed on a later loop() iteration.
+ */
+void drainLog() {
+  for (;;) {
+    uint32_t head = logHead.load(std::memory_order_acquire);
+    if (head - logTail > LOG_CAPACITY) {
+      logDropped += head - logTail - LOG_CAPACITY;
+      logTail = head - LOG_CAPACITY;
+    }
+    if (logTail == head) return;
+
+    LogEntry entry;
+    if (!logRead(logTail, entry)) {
+      // Overwritten while we read it: skip it. Otherwise it is still being written.
+      if (logHead.load(std::memory_order_acquire) - logTail > LOG_CAPACITY) continue;
+      return;
+    }
+
+    char line[112];
+    size_t len = formatLogEntry(entry, line, sizeof(line));
+    if (Serial.availableForWrite() < (int)len) return;
+    Serial.write((const uint8_t *)line, len);
+    logTail++;
+  }
+}
+
+/**
+ * @brief Renders the records still held in the ring, oldest first.
+ * @param end Ticket one past the newest record, fixed when the request arrived.
+ */
+void renderLog(WindowWriter &out, uint32_t end) {
+  uint32_t begin = end > LOG_CAPACITY ? end - LOG_CAPACITY : 0;
+  for (uint32_t ticket = begin; ticket != end && !out.full(); ticket++) {
+    LogEntry entry;
+    if (!logRead(ticket, entry)) continue;
+    char line[112];
+    size_t len = formatLogEntry(entry, line, sizeof(line));
+    out.write(line, len);
+  }
+}
+
+
+//==============================================================================
+// Event Trace
+//==============================================================================
+// A flight recorder for reconstructing what happened during a run: heater
+// toggles, phase transitions, temperature samples, sensor errors and web
+// commands are stored as 8-byte records with microsecond timestamps in a ring
+// that simply overwrites its oldest entries. Recording an event is one atomic
+// increment and two stores. /trace downloads the ring as a binary dump that
+// tools/trace2perfetto.cpp converts into Chrome/Perfetto trace JSON.
+
+/** @brief Trace event types. The numeric values are part of the dump format. */
+enum TraceEvent : uint8_t {
+  TRACE_HEATER_ON = 1,    // arg: temperature (0.01 °C)
+  TRACE_HEATER_OFF = 2,   // arg: temperature (0.01 °C)
+  TRACE_PHASE = 3,        // arg: new TracePhase
+  TRACE_TEMPERATURE = 4,  // arg: temperature (0.01 °C)
+  TRACE_SENSOR_ERROR = 5, // arg: raw reading (0.01 °C)
+  TRACE_WEB_COMMAND = 6   // arg: TraceCommand; channel is TRACE_NO_CHANNEL
+};
+
+/** @brief Phase values carried by TRACE_PHASE. */
+enum TracePhase : int16_t { TRACE_PHASE_IDLE = 0, TRACE_PHASE_HOLD = 1, TRACE_PHASE_COOLING = 2 };
+
+/** @brief Web commands carried by TRACE_WEB_COMMAND. */
+enum TraceCommand : int16_t {
+  TRACE_CMD_UPDATE = 1,
+  TRACE_CMD_CONFIG = 2,
+  TRACE_CMD_PRESET_APPLY = 3,
+  TRACE_CMD_PRESET_SAVE = 4,
+  TRACE_CMD_PRESET_DELETE = 5,
+  TRACE_CMD_WIFI = 6,
+  TRACE_CMD_POWER = 7,
+  TRACE_CMD_OTA = 8,
+  TRACE_CMD_CHANNELS = 9
+};
+
+/** @brief One trace record, stored and dumped as-is (little-endian). */
+struct TraceRecord {
+  uint32_t timestamp; // micros()
+  uint8_t event;      // TraceEvent
+  uint8_t channel;    // Channel index or TRACE_NO_CHANNEL
+  int16_t arg;        // Event-specific argument
+};
+static_assert(sizeof(TraceRecord) == 8, "TraceRecord is part of the dump format");
+
+/** @brief Header preceding the records in a /trace dump. */
+struct TraceHeader {
+  uint32_t magic;      // TRACE_MAGIC
+  uint16_t version;    // TRACE_VERSION
+  uint16_t recordSize; // sizeof(TraceRecord)
+  uint32_t count;      // Number of records following the header
+  uint32_t timestamp;  // micros() when the dump was taken
+};
+static_assert(sizeof(TraceHeader) == 16, "TraceHeader is part of the dump format");
+
+const uint8_t TRACE_NO_CHANNEL = 0xFF;
+const uint32_t TRACE_CAPACITY = 512;     // Records kept (4 KB of RAM)
+const uint32_t TRACE_UNSENT = 64;        // Oldest slots left out of a dump; they may be overwritten while it is sent
+const uint32_t TRACE_MAGIC = 0x52545447; // "GTTR"
+const uint16_t TRACE_VERSION = 1;
+
+TraceRecord traceRing[TRACE_CAPACITY];
+std::atomic<uint32_t> traceHead(0); // Total number of records ever written
+
+/**
+ * @brief Records a trace event. Safe from loop() and web callbacks.
+ */
+inline void trace(TraceEvent event, uint8_t channel, int16_t arg) {
+  uint32_t ticket = traceHead.fetch_add(1, std::memory_order_relaxed);
+  TraceRecord &record = traceRing[ticket % TRACE_CAPACITY];
+  record.timestamp = micros();
+  record.event = event;
+  record.channel = channel;
+  record.arg = arg;
+}
+
+/**
+ * @brief Converts a temperature to the 0.01 °C units used by trace arguments.
+ */
+inline int16_t traceCentiDegrees(float celsius) {
+  return (int16_t)lroundf(celsius * 100.0f);
+}
+
+/**
+ * @brief Renders the binary trace dump: a TraceHeader and the records, oldest first.
+ * @details Every chunk is rendered from the live ring. The TRACE_UNSENT
+ * oldest records are left out, so events traced while the dump is sent
+ * overwrite slots that are not part of it.
+ * @param end Total record count when the request arrived.
+ */
+void renderTrace(WindowWriter &out, uint32_t end) {
+  const uint32_t kept = TRACE_CAPACITY - TRACE_UNSENT;
+  uint32_t begin = end > kept ? end - kept : 0;
+  TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, sizeof(TraceRecord), end - begin, (uint32_t)micros()};
+  out.write((const char *)&header, sizeof(header));
+  for (uint32_t ticket = begin; ticket != end && !out.full(); ticket++) {
+    out.write((const char *)&traceRing[ticket % TRACE_CAPACITY], sizeof(TraceRecord));
+  }
+}
+
+
+//==============================================================================
+// Run Recording
+//==============================================================================
+// Everything the control logic consumes is recorded so that a misbehaving run
+// can be reproduced on a PC: the sensor readings, the times of the control
+// ticks, and the settings and channel changes that reach loop(). The heater
+// and phase changes they produced are recorded next to them. Every 60 s a
+// keyframe holds the complete channel state, so a replay can start from any
+// keyframe in the ring. /recording downloads the ring; tools/replay.cpp feeds
+// it back into loop() under a virtual clock and compares the heater and phase
+// timeline it gets with the recorded one.
+//
+// All records of one loop() pass carry the same time, the millis() value the
+// pass schedules its tasks with. Records are written from loop() only.
+
+/** @brief Record types. The numeric values are part of the dump format. */
+enum RecordType : uint8_t {
+  RECORD_KEYFRAME = 1,        // arg: number of RECORD_KEY_* records that follow
+  RECORD_KEY_SCHEDULE = 2,    // value: last run of task `channel` (0 sensors, 1 control), millis(); arg: controlStarted
+  RECORD_KEY_ENABLED = 3,     // value: channel enable mask
+  RECORD_KEY_SETTING = 4,     // arg: SettingField; value: float bits, minutes for the hold duration
+  RECORD_KEY_PHASE = 5,       // arg: TracePhase | output << 8; value: phaseStartMillis
+  RECORD_KEY_SETPOINT = 6,    // value: float bits of liveSetpoints
+  RECORD_KEY_TEMPERATURE = 7, // value: float bits of lastTemperatures
+  RECORD_READING = 8,         // arg: sensor reading (1/128 °C, exact for the DS18B20)
+  RECORD_TICK = 9,            // A control tick ran
+  RECORD_CHANNEL = 10,        // arg: 1 if the channel was enabled, 0 if disabled
+  RECORD_OUTPUT = 11,         // arg: 1 heater on, 0 heater off
+  RECORD_PHASE = 12,          // arg: new TracePhase
+  RECORD_SETTING = 16         // + SettingField; arg: new fixed-point value (see SETTING_FIELDS)
+};
+
+/**
+ * @brief One recorded event, stored and dumped as-is (little-endian).
+ * @note RECORD_KEY_* records belong to the keyframe before them and carry a
+ * 32-bit value in place of the time.
+ */
+struct RunRecord {
+  uint32_t time;   // millis() of the loop() pass, or the value of a RECORD_KEY_* record
+  uint8_t type;    // RecordType
+  uint8_t channel; // Channel index or RECORD_NO_CHANNEL
+  int16_t arg;     // Type-specific argument
+};
+static_assert(sizeof(RunRecord) == 8, "RunRecord is part of the dump format");
+
+/** @brief Header preceding the records in a /recording dump. */
+struct RecordingHeader {
+  uint32_t magic;      // RECORDING_MAGIC
+  uint16_t version;    // RECORDING_VERSION
+  uint16_t recordSize; // sizeof(RunRecord)
+  uint32_t first;      // Sequence number of the first record (records written since boot before it)
+  uint32_t count;      // Number of records following the header
+};
+static_assert(sizeof(RecordingHeader) == 16, "RecordingHeader is part of the dump format");
+
+const uint8_t RECORD_NO_CHANNEL = 0xFF;
+#ifdef ESP32
+const uint32_t RECORDING_CAPACITY = 2048;      // Records kept (16 KB of RAM, about 5 minutes)
+#else
+const uint32_t RECORDING_CAPACITY = 512;       // Records kept (4 KB of RAM, about 80 seconds)
+#endif
+const uint32_t RECORDING_UNSENT = 64;          // Oldest slots left out of a dump; they may be overwritten while it is sent
+const uint32_t RECORDING_KEYFRAME_TICKS = 120; // Control ticks between keyframes (60 s)
+const uint32_t RECORDING_MAGIC = 0x43455247;   // "GREC"
+const uint16_t RECORDING_VERSION = 1;
+
+/** @brief When loop() last ran its two periodic tasks. */
+struct TaskSchedule {
+  unsigned long lastSensorRead;
+  unsigned long lastLogicUpdate;
+  bool controlStarted; // The first control tick after boot has run
+};
+TaskSchedule tasks;
+
+/** @brief Recorder state, owned by loop(). */
+struct Recording {
+  uint32_t now;             // Time of the current loop() pass
+  uint32_t ticksToKeyframe; // Control ticks until the next keyframe; 0: write one now
+};
+Recording recording;
+
+RunRecord recordingRing[RECORDING_CAPACITY];
+std::atomic<uint32_t> recordingHead(0); // Total number of records ever written
+
+/** @brief Appends a record with an explicit time field. */
+inline void recordAt(uint32_t time, RecordType type, uint8_t channel, int16_t arg) {
+  uint32_t ticket = recordingHead.load(std::memory_order_relaxed);
+  RunRecord &record = recordingRing[ticket % RECORDING_CAPACITY];
+  record.time = time;
+  record.type = type;
+  record.channel = channel;
+  record.arg = arg;
+  recordingHead.store(ticket + 1, std::memory_order_release);
+}
+
+/** @brief Appends a record stamped with the current loop() pass. */
+inline void record(RecordType type, uint8_t channel, int16_t arg) {
+  recordAt(recording.now, type, channel, arg);
+}
+
+/** @brief Bit pattern of a float, for the value of RECORD_KEY_* records. */
+inline uint32_t recordFloat(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+/** @brief A sensor reading in the 1/128 °C steps of RECORD_READING. */
+inline int16_t recordReading(float celsius) {
+  return (int16_t)lroundf(celsius * 128.0f);
+}
+
+/** @brief The phase a channel is in, as a TracePhase. */
+inline int16_t channelPhase(int channel) {
+  return controller.holdPhaseActive[channel] ? TRACE_PHASE_HOLD
+       : controller.coolingPhaseActive[channel] ? TRACE_PHASE_COOLING : TRACE_PHASE_IDLE;
+}
+
+/**
+ * @brief Records the complete state the control logic depends on.
+ * @details Written before the tasks of a loop() pass; a replay restores this
+ * state and continues with the records after the keyframe.
+ */
+void recordKeyframe() {
+  const int16_t count = 3 + NUM_SENSORS * 7;
+  record(RECORD_KEYFRAME, RECORD_NO_CHANNEL, count);
+  recordAt(tasks.lastSensorRead, RECORD_KEY_SCHEDULE, 0, 0);
+  recordAt(tasks.lastLogicUpdate, RECORD_KEY_SCHEDULE, 1, tasks.controlStarted);
+  recordAt(controller.enabled, RECORD_KEY_ENABLED, RECORD_NO_CHANNEL, 0);
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    recordAt(recordFloat(controller.setting_HoldTemps[i]), RECORD_KEY_SETTING, i, 0);
+    recordAt(recordFloat(controller.setting_CoolingSpeeds[i]), RECORD_KEY_SETTING, i, 1);
+    recordAt(recordFloat(controller.setting_LowerLimits[i]), RECORD_KEY_SETTING, i, 2);
+    recordAt(controller.setting_HoldDurations[i], RECORD_KEY_SETTING, i, 3);
+    recordAt(controller.phaseStartMillis[i], RECORD_KEY_PHASE, i, channelPhase(i) | controller.outputState[i] << 8);
+    recordAt(recordFloat(controller.liveSetpoints[i]), RECORD_KEY_SETPOINT, i, 0);
+    recordAt(recordFloat(controller.lastTemperatures[i]), RECORD_KEY_TEMPERATURE, i, 0);
+  }
+  recording.ticksToKeyframe = RECORDING_KEYFRAME_TICKS;
+}
+
+/**
+ * @brief Renders the binary recording: a RecordingHeader and the records, oldest first.
+ * @param end Total record count when the request arrived.
+ */
+void renderRecording(WindowWriter &out, uint32_t end) {
+  const uint32_t kept = RECORDING_CAPACITY - RECORDING_UNSENT;
+  uint32_t begin = end > kept ? end - kept : 0;
+  RecordingHeader header = {RECORDING_MAGIC, RECORDING_VERSION, sizeof(RunRecord), begin, end - begin};
+  out.write((const char *)&header, sizeof(header));
+  for (uint32_t ticket = begin; ticket != end && !out.full(); ticket++) {
+    out.write((const char *)&recordingRing[ticket % RECORDING_CAPACITY], sizeof(RunRecord));
+  }
+}
+
+
+//==============================================================================
+// Admission Control
+//==============================================================================
+// AsyncWebServer serves as many requests at once as lwIP has connections
+// for, and every request holds heap until its response is sent. A few open
+// dashboards plus a scraper can exhaust the heap in the middle of a large
+// response and take heater control down with the crash. Every handler is
+// therefore admitted first: requests beyond the global or per-endpoint
+// in-flight limits, or arriving while free heap is below the reserve, are
+// answered at once with 503 and a Retry-After header.
+
+/**
+ * @brief Endpoints subject to admission control: identifier, name, concurrency limit.
+ */
+#define HTTP_ENDPOINTS(X) \
+  X(ENDPOINT_INDEX,   "index",   1) \
+  X(ENDPOINT_DATA,    "data",    3) \
+  X(ENDPOINT_UPDATE,  "update",  1) \
+  X(ENDPOINT_STATUS,  "status",  1) \
+  X(ENDPOINT_LOG,     "log",     1) \
+  X(ENDPOINT_TRACE,   "trace",   1) \
+  X(ENDPOINT_RECORDING, "recording", 1) \
+  X(ENDPOINT_PROFILE, "profile", 1) \
+  X(ENDPOINT_METRICS, "metrics", METRICS_SLOTS) \
+  X(ENDPOINT_CONFIG_GET,  "config_get",  1) \
+  X(ENDPOINT_CONFIG_POST, "config_post", 1) \
+  X(ENDPOINT_PRESETS,     "presets",     1) \
+  X(ENDPOINT_WIFI,        "wifi",        1) \
+  X(ENDPOINT_POWER,       "power",       1) \
+  X(ENDPOINT_OTA,         "ota",         1) \
+  X(ENDPOINT_CHANNELS,    "channels",    1) \
+  X(ENDPOINT_OTHER,   "other",   2)
+
+#define HTTP_ENDPOINT_ENUM(id, name, limit) id,
+#define HTTP_ENDPOINT_NAME(id, name, limit) name,
+#define HTTP_ENDPOINT_LIMIT(id, name, limit) limit,
+
+const int METRICS_SLOTS = 2; // Concurrent /metrics scrapes (see Metrics)
+
+enum HttpEndpoint : uint8_t { HTTP_ENDPOINTS(HTTP_ENDPOINT_ENUM) HTTP_ENDPOINT_COUNT };
+const char *const HTTP_ENDPOINT_NAMES[HTTP_ENDPOINT_COUNT] = { HTTP_ENDPOINTS(HTTP_ENDPOINT_NAME) };
+const uint8_t HTTP_ENDPOINT_LIMITS[HTTP_ENDPOINT_COUNT] = { HTTP_ENDPOINTS(HTTP_ENDPOINT_LIMIT) };
+
+/** @brief Why a request was turned away. */
+enum RejectReason : uint8_t { REJECT_HEAP, REJECT_GLOBAL, REJECT_ENDPOINT, REJECT_REASON_COUNT };
+const char *const REJECT_REASON_NAMES[REJECT_REASON_COUNT] = {"heap", "global", "endpoint"};
+
+const int HTTP_MAX_IN_FLIGHT = 6;           // Requests served at once, all endpoints together
+const uint32_t HTTP_HEAP_RESERVE = 12000;   // Free heap (bytes) required to admit a request
+const char *const HTTP_RETRY_AFTER_BUSY = "1"; // Retry-After (s) when a concurrency limit is hit
+const char *const HTTP_RETRY_AFTER_HEAP = "5"; // Retry-After (s) when the heap is low
+
+/**
+ * @brief Admission counters, reported by /status and /metrics.
+ */
+struct AdmissionStats {
+  std::atomic<uint8_t> inFlight;
+  std::atomic<uint8_t> endpointInFlight[HTTP_ENDPOINT_COUNT];
+  uint8_t peakInFlight;
+  uint32_t accepted[HTTP_ENDPOINT_COUNT];
+  uint32_t rejected[HTTP_ENDPOINT_COUNT][REJECT_REASON_COUNT];
+};
+AdmissionStats admission;
+
+/**
+ * @brief Answers a request with 503 and counts the rejection.
+ */
+void rejectRequest(AsyncWebServerRequest *request, HttpEndpoint endpoint, RejectReason reason) {
+  admission.rejected[endpoint][reason]++;
+  AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Busy");
+  response->addHeader("Retry-After", reason == REJECT_HEAP ? HTTP_RETRY_AFTER_HEAP : HTTP_RETRY_AFTER_BUSY);
+  request->send(response);
+}
+
+/**
+ * @brief Releases the in-flight slots taken by reserveRequest().
+ * @note Called from the request's disconnect handler, after the response is sent.
+ */
+void releaseRequest(HttpEndpoint endpoint) {
+  admission.endpointInFlight[endpoint].fetch_sub(1);
+  admission.inFlight.fetch_sub(1);
+}
+
+/** @brief Frees a per-request resource (such as a snapshot slot) when its request ends. */
+typedef void (*RequestCleanup)(int handle);
+
+/**
+ * @brief Takes the in-flight slots for a request to endpoint if there is room.
+ * @details Sends nothing. Body callbacks use it to decide on the first chunk,
+ * before they accept a body, and answer from the request handler later.
+ * @return REJECT_REASON_COUNT if the slots were taken, otherwise the reason
+ * to pass to rejectRequest().
+ */
+RejectReason takeRequestSlots(HttpEndpoint endpoint) {
+  if (ESP.getFreeHeap() < HTTP_HEAP_RESERVE) return REJECT_HEAP;
+  uint8_t inFlight = admission.inFlight.fetch_add(1) + 1;
+  if (inFlight > HTTP_MAX_IN_FLIGHT) {
+    admission.inFlight.fetch_sub(1);
+    return REJECT_GLOBAL;
+  }
+  if (admission.endpointInFlight[endpoint].fetch_add(1) >= HTTP_ENDPOINT_LIMITS[endpoint]) {
+    admission.endpointInFlight[endpoint].fetch_sub(1);
+    admission.inFlight.fetch_sub(1);
+    return REJECT_ENDPOINT;
+  }
+  if (inFlight > admission.peakInFlight) admission.peakInFlight = inFlight;
+  admission.accepted[endpoint]++;
+  return REJECT_REASON_COUNT;
+}
+
+/**
+ * @brief Takes the in-flight slots for a request without arranging their release.
+ * @details On failure the 503 has already been sent. Only admitRequest() and
+ * handlers that pair it with releaseOnDisconnect() call this.
+ * @return true if the handler should go on serving the request.
+ */
+bool reserveRequest(AsyncWebServerRequest *request, HttpEndpoint endpoint) {
+  RejectReason reason = takeRequestSlots(endpoint);
+  if (reason == REJECT_REASON_COUNT) return true;
+  rejectRequest(request, endpoint, reason);
+  return false;
+}
+
+/**
+ * @brief Releases a reserved request's slots, and its cleanup handle if any, when it ends.
+ * @note The request's one disconnect handler: the library keeps only the last
+ * one registered, so nothing else may call onDisconnect() on an admitted request.
+ */
+void releaseOnDisconnect(AsyncWebServerRequest *request, HttpEndpoint endpoint, RequestCleanup cleanup = nullptr,
+                         int handle = 0) {
+  request->onDisconnect([endpoint, cleanup, handle]() {
+    if (cleanup != nullptr) cleanup(handle);
+    releaseRequest(endpoint);
+  });
+}
+
+/**
+ * @brief Decides whether a request may be served now.
+ * @details On success the request holds one global and one endpoint slot
+ * until it disconnects. On failure the 503 has already been sent.
+ * @return true if the handler should go on serving the request.
+ */
+bool admitRequest(AsyncWebServerRequest *request, HttpEndpoint endpoint) {
+  if (!reserveRequest(request, endpoint)) return false;
+  releaseOnDisconnect(request, endpoint);
+  return true;
+}
+
+/** @brief Total rejections for one reason, across endpoints. */
+uint32_t rejectedTotal(RejectReason reason) {
+  uint32_t total = 0;
+  for (int e = 0; e < HTTP_ENDPOINT_COUNT; e++) total += admission.rejected[e][reason];
+  return total;
+}
+
+
+//==============================================================================
+// Settings Commands
+//==============================================================================
+// Every change to the process parameters arrives as a SettingsCommand: a
+// per-channel set of fixed-point field values that has been fully validated
+// before anything is applied. Web handlers only parse and submit commands;
+// loop() applies them between control ticks, so a command never takes effect
+// halfway through a tick and either applies completely or not at all.
+
+/** @brief The user-configurable fields of a channel. */
+enum SettingField : uint8_t {
+  FIELD_HOLD_TEMP,     // setting_HoldTemps, 0.01 °C
+  FIELD_COOLING_SPEED, // setting_CoolingSpeeds, 0.01 °C/min
+  FIELD_LOWER_LIMIT,   // setting_LowerLimits, 0.01 °C
+  FIELD_HOLD_DURATION, // setting_HoldDurations, minutes
+  SETTING_FIELD_COUNT
+};
+
+/**
+ * @brief How a field is named in the form and which fixed-point values it accepts.
+ */
+struct SettingFieldSpec {
+  const char *formName; // Form field prefix; the channel index follows it
+  uint8_t decimals;     // Fixed-point decimals of the stored value
+  int32_t min;          // Smallest accepted value (fixed-point)
+  int32_t max;          // Largest accepted value (fixed-point)
+};
+
+const SettingFieldSpec SETTING_FIELDS[SETTING_FIELD_COUNT] = {
+  {"threshold", 2, 0,     12500}, // 0.00 .. 125.00 °C (DS18B20 range)
+  {"cooling",   2, 1,     6000},  // 0.01 .. 60.00 °C/min
+  {"lower",     2, -5500, 12500}, // -55.00 .. 125.00 °C
+  {"hold",      0, 0,     10080}, // 0 .. 10080 min (one week)
+};
+
+/**
+ * @brief A validated change to any subset of channels and fields.
+ */
+struct SettingsCommand {
+  uint8_t fieldMask[NUM_SENSORS];                    // Bit f set: values[i][f] is present
+  int32_t values[NUM_SENSORS][SETTING_FIELD_COUNT];  // Fixed-point, see SETTING_FIELDS
+};
+
+/** @brief Why a command was refused. */
+enum CommandError : uint8_t {
+  COMMAND_OK,
+  COMMAND_UNKNOWN_FIELD,
+  COMMAND_BAD_CHANNEL,
+  COMMAND_BAD_NUMBER,
+  COMMAND_OUT_OF_RANGE,
+  COMMAND_LIMIT_ABOVE_THRESHOLD,
+  COMMAND_QUEUE_FULL,
+  COMMAND_BAD_JSON,
+  COMMAND_TOO_LARGE,
+  COMMAND_EMPTY
+};
+const char *const COMMAND_ERROR_TEXT[] = {
+  "OK", "Unknown field", "Invalid channel", "Not a number", "Out of range",
+  "Lower limit above threshold", "Busy", "Invalid JSON document", "Document too large", "Empty request"
+};
+
+/** @brief Empties a command. */
+void clearCommand(SettingsCommand &command) {
+  memset(command.fieldMask, 0, sizeof(command.fieldMask));
+}
+
+/** @brief Sets one field of one channel in a command. */
+void setCommandField(SettingsCommand &command, int channel, SettingField field, int32_t value) {
+  command.fieldMask[channel] |= 1 << field;
+  command.values[channel][field] = value;
+}
+
+/**
+ * @brief Parses a decimal number into a fixed-point integer.
+ * @details Accepts an optional sign, digits and an optional fraction. Digits
+ * beyond the requested precision are rounded half away from zero.
+ * @return false if the text is not a plain decimal number or does not fit
+ * in an int32_t once scaled to the requested decimals.
+ */
+bool parseFixedPoint(const char *text, uint8_t decimals, int32_t &value) {
+  bool negative = *text == '-';
+  if (*text == '-' || *text == '+') text++;
+
+  int64_t result = 0;
+  int digits = 0;
+  for (; *text >= '0' && *text <= '9'; text++, digits++) {
+    result = result * 10 + (*text - '0');
+    if (result > 100000000) return false;
+  }
+  int fraction = 0;
+  if (*text == '.') {
+    for (text++; *text >= '0' && *text <= '9'; text++, digits++) {
+      if (fraction < decimals) {
+        result = result * 10 + (*text - '0');
+      } else if (fraction == decimals && *text >= '5') {
+        result++;
+      }
+      fraction++;
+    }
+  }
+  if (digits == 0 || *text != '\0') return false;
+  for (; fraction < decimals; fraction++) result *= 10;
+  if (result > INT32_MAX) return false;
+
+  value = (int32_t)(negative ? -result : result);
+  return true;
+}
+
+/**
+ * @brief Decodes one form field ("<name><channel>" = "<number>") into a command.
+ */
+CommandError addFormField(SettingsCommand &command, const char *name, const char *value) {
+  for (int f = 0; f < SETTING_FIELD_COUNT; f++) {
+    const SettingFieldSpec &spec = SETTING_FIELDS[f];
+    size_t prefixLen = strlen(spec.formName);
+    if (strncmp(name, spec.formName, prefixLen) != 0) continue;
+
+    // The channel index: decimal digits without leading zeros
+    const char *digits = name + prefixLen;
+    if (*digits < '0' || *digits > '9' || (digits[0] == '0' && digits[1] != '\0')) return COMMAND_BAD_CHANNEL;
+    int channel = 0;
+    for (; *digits >= '0' && *digits <= '9' && channel < NUM_SENSORS; digits++) channel = channel * 10 + (*digits - '0');
+    if (*digits != '\0' || channel >= NUM_SENSORS) return COMMAND_BAD_CHANNEL;
+
+    int32_t fixed;
+    if (!parseFixedPoint(value, spec.decimals, fixed)) return COMMAND_BAD_NUMBER;
+    if (fixed < spec.min || fixed > spec.max) return COMMAND_OUT_OF_RANGE;
+    setCommandField(command, channel, (SettingField)f, fixed);
+    return COMMAND_OK;
+  }
+  return COMMAND_UNKNOWN_FIELD;
+}
+
+/** @brief Converts a fixed-point field value to the unit of its setting. */
+float fieldToFloat(SettingField field, int32_t value) {
+  return SETTING_FIELDS[field].decimals == 2 ? value / 100.0f : (float)value;
+}
+
+/** @brief Converts a setting to its fixed-point field value. */
+int32_t fieldFromFloat(SettingField field, float value) {
+  return SETTING_FIELDS[field].decimals == 2 ? (int32_t)lroundf(value * 100.0f) : (int32_t)lroundf(value);
+}
+
+/** @brief Current setting of one channel field, in fixed point. */
+int32_t currentField(int channel, SettingField field) {
+  switch (field) {
+    case FIELD_HOLD_TEMP:     return fieldFromFloat(field, controller.setting_HoldTemps[channel]);
+    case FIELD_COOLING_SPEED: return fieldFromFloat(field, controller.setting_CoolingSpeeds[channel]);
+    case FIELD_LOWER_LIMIT:   return fieldFromFloat(field, controller.setting_LowerLimits[channel]);
+    default:                  return (int32_t)controller.setting_HoldDurations[channel];
+  }
+}
+
+/** @brief Sets one channel field from its fixed-point value. */
+void writeField(int channel, SettingField field, int32_t value) {
+  switch (field) {
+    case FIELD_HOLD_TEMP:     controller.setting_HoldTemps[channel] = fieldToFloat(field, value); break;
+    case FIELD_COOLING_SPEED: controller.setting_CoolingSpeeds[channel] = fieldToFloat(field, value); break;
+    case FIELD_LOWER_LIMIT:   controller.setting_LowerLimits[channel] = fieldToFloat(field, value); break;
+    default:                  controller.setting_HoldDurations[channel] = value; break;
+  }
+}
+
+// Commands travel from the web callbacks to loop() through a small
+// single-producer/single-consumer queue. All AsyncWebServer callbacks run in
+// one context, so the handlers together form the single producer.
+const uint8_t COMMAND_QUEUE_SIZE = 4;
+SettingsCommand commandQueue[COMMAND_QUEUE_SIZE];
+std::atomic<uint8_t> commandQueueHead(0); // Next slot to fill (web callbacks)
+std::atomic<uint8_t> commandQueueTail(0); // Next slot to apply (loop)
+
+/**
+ * @brief Setting of one channel field once every queued command has been applied.
+ * @note Producer side (web callbacks). A command loop() applies meanwhile is
+ * still read from its slot, which only the producer overwrites.
+ */
+int32_t queuedField(int channel, SettingField field) {
+  int32_t value = currentField(channel, field);
+  uint8_t head = commandQueueHead.load(std::memory_order_relaxed);
+  for (uint8_t i = commandQueueTail.load(std::memory_order_acquire); i != head; i++) {
+    const SettingsCommand &queued = commandQueue[i % COMMAND_QUEUE_SIZE];
+    if (queued.fieldMask[channel] & (1 << field)) value = queued.values[channel][field];
+  }
+  return value;
+}
+
+/**
+ * @brief Checks rules that span fields, against the settings the command leaves behind.
+ * @param channel Receives the offending channel on failure.
+ * @param baseline The settings the command is applied on: currentField, or
+ * queuedField when other commands are still waiting in the queue.
+ */
+CommandError validateCommand(const SettingsCommand &command, int &channel,
+                             int32_t (*baseline)(int, SettingField) = currentField) {
+  for (channel = 0; channel < NUM_SENSORS; channel++) {
+    uint8_t mask = command.fieldMask[channel];
+    if (mask == 0) continue;
+    int32_t threshold = mask & (1 << FIELD_HOLD_TEMP) ? command.values[channel][FIELD_HOLD_TEMP]
+                                                      : baseline(channel, FIELD_HOLD_TEMP);
+    int32_t lower = mask & (1 << FIELD_LOWER_LIMIT) ? command.values[channel][FIELD_LOWER_LIMIT]
+                                                    : baseline(channel, FIELD_LOWER_LIMIT);
+    if (lower > threshold) return COMMAND_LIMIT_ABOVE_THRESHOLD;
+  }
+  return COMMAND_OK;
+}
+
+/**
+ * @brief Applies a validated command and resets the channels it touches to Idle.
+ * @note Called from loop() only.
+ */
+void applyCommand(const SettingsCommand &command) {
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    uint8_t mask = command.fieldMask[i];
+    if (mask == 0) continue;
+    for (int f = 0; f < SETTING_FIELD_COUNT; f++) {
+      if (!(mask & (1 << f))) continue;
+      writeField(i, (SettingField)f, command.values[i][f]);
+      record((RecordType)(RECORD_SETTING + f), i, (int16_t)command.values[i][f]);
+    }
+
+    // Restart the channel's cycle with the new parameters.
+    if (controller.holdPhaseActive[i] || controller.coolingPhaseActive[i]) {
+      trace(TRACE_PHASE, i, TRACE_PHASE_IDLE);
+      record(RECORD_PHASE, i, TRACE_PHASE_IDLE);
+    }
+    controller.holdPhaseActive[i] = false;
+    controller.coolingPhaseActive[i] = false;
+    controller.liveSetpoints[i] = controller.setting_HoldTemps[i]; // Reset live setpoint to new setting
+    LOG_EVENT(LOG_SETTINGS_UPDATED, i, controller.setting_HoldTemps[i]);
+  }
+}
+
+/**
+ * @brief Validates a command and queues it for loop().
+ * @return COMMAND_OK, a validation error, or COMMAND_QUEUE_FULL.
+ */
+CommandError submitCommand(const SettingsCommand &command) {
+  int channel;
+  CommandError error = validateCommand(command, channel, queuedField);
+  if (error != COMMAND_OK) return error;
+
+  uint8_t head = commandQueueHead.load(std::memory_order_relaxed);
+  if ((uint8_t)(head - commandQueueTail.load(std::memory_order_acquire)) >= COMMAND_QUEUE_SIZE) return COMMAND_QUEUE_FULL;
+  commandQueue[head % COMMAND_QUEUE_SIZE] = command;
+  commandQueueHead.store(head + 1, std::memory_order_release);
+  powerWake();
+  return COMMAND_OK;
+}
+
+/**
+ * @brief Applies all queued commands, oldest first. Called from loop().
+ * @details Each command is checked again against the settings it lands on,
+ * and dropped if it no longer fits, so an invalid combination never reaches
+ * the controller or flash.
+ * @return True if any command was applied.
+ */
+bool applyQueuedCommands() {
+  uint8_t tail = commandQueueTail.load(std::memory_order_relaxed);
+  bool applied = false;
+  while (tail != commandQueueHead.load(std::memory_order_acquire)) {
+    const SettingsCommand &command = commandQueue[tail % COMMAND_QUEUE_SIZE];
+    int channel;
+    if (validateCommand(command, channel) == COMMAND_OK) {
+      applyCommand(command);
+      applied = true;
+    } else {
+      LOG_EVENT(LOG_SETTINGS_REJECTED, channel, controller.setting_HoldTemps[channel]);
+    }
+    commandQueueTail.store(++tail, std::memory_order_release);
+  }
+  return applied;
+}
+
+/**
+ * @brief Sends the response for a refused command: 503 when busy, otherwise 400.
+ * @param field The offending form field, if any.
+ */
+void sendCommandError(AsyncWebServerRequest *request, CommandError error, const char *field,
+                      HttpEndpoint endpoint = ENDPOINT_UPDATE) {
+  if (error == COMMAND_QUEUE_FULL) {
+    rejectRequest(request, endpoint, REJECT_ENDPOINT);
+    return;
+  }
+  char message[64];
+  snprintf(message, sizeof(message), field ? "%s: %s" : "%s", COMMAND_ERROR_TEXT[error], field);
+  request->send(400, "text/plain", message);
+}
+
+
+//==============================================================================
+// Flash Store
+//==============================================================================
+// Data that must survive reboots (settings, presets) is kept as fixed binary
+// records: a StoreHeader (magic, layout version, element count and a write
+// sequence number), the payload, and a trailing CRC-32. Loading a record at
+// boot is a read and a checksum, with no parsing. On the ESP32 each record is
+// a single NVS blob (NVS wear-levels and replaces it atomically); on the
+// ESP8266 it alternates between two LittleFS files so a power cut during a
+// write still leaves the previous copy, and the newest valid copy wins at boot.
+
+/**
+ * @brief Leading part of every stored record.
+ */
+struct StoreHeader {
+  uint32_t magic;    // Identifies the record type
+  uint16_t version;  // Layout version; bump when the record changes
+  uint16_t count;    // Number of elements (channels, preset slots)
+  uint32_t sequence; // Incremented on every write; the newest valid copy wins
+};
+
+/** @brief Full validity check of a record read from flash (header, CRC, contents). */
+typedef bool (*RecordValidator)(const void *record);
+
+/** @brief Standard CRC-32 (IEEE 802.3), bitwise; the records are small. */
+uint32_t crc32(const uint8_t *data, size_t length) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+/**
+ * @brief CRC of a record, excluding its trailing 32-bit CRC field.
+ */
+uint32_t recordCrc(const void *record, size_t size) {
+  return crc32((const uint8_t *)record, size - sizeof(uint32_t));
+}
+
+/** @brief Checks the header and CRC of a record. */
+bool recordHeaderValid(const void *record, size_t size, uint32_t magic, uint16_t version, uint16_t count) {
+  const StoreHeader *header = (const StoreHeader *)record;
+  uint32_t crc;
+  memcpy(&crc, (const uint8_t *)record + size - sizeof(crc), sizeof(crc));
+  return header->magic == magic && header->version == version && header->count == count &&
+         crc == recordCrc(record, size);
+}
+
+#ifdef ESP32
+Preferences storePrefs;
+
+bool storeBegin() { return true; }
+
+bool storeRead(const char *key, void *record, size_t size, RecordValidator valid) {
+  if (!storePrefs.begin("gellan", true)) return false;
+  size_t length = storePrefs.getBytes(key, record, size);
+  storePrefs.end();
+  return length == size && valid(record);
+}
+
+bool storeWrite(const char *key, const void *record, size_t size) {
+  if (!storePrefs.begin("gellan", false)) return false;
+  size_t length = storePrefs.putBytes(key, record, size);
+  storePrefs.end();
+  return length == size;
+}
+
+void storeErase(const char *key) {
+  if (!storePrefs.begin("gellan", false)) return;
+  storePrefs.remove(key);
+  storePrefs.end();
+}
+#else
+bool storeBegin() { return LittleFS.begin(); }
+
+/** @brief Path of one of the two copies of a record: "/<key>.<copy>". */
+void storePath(char *path, size_t size, const char *key, int copy) {
+  snprintf(path, size, "/%s.%d", key, copy);
+}
+
+bool storeReadCopy(const char *key, int copy, void *record, size_t size, RecordValidator valid) {
+  char path[32];
+  storePath(path, sizeof(path), key, copy);
+  File file = LittleFS.open(path, "r");
+  if (!file) return false;
+  size_t length = file.read((uint8_t *)record, size);
+  file.close();
+  return length == size && valid(record);
+}
+
+/** @brief Reads the newest valid copy. Runs at boot only, so it simply reads the winner twice. */
+bool storeRead(const char *key, void *record, size_t size, RecordValidator valid) {
+  bool found[2];
+  uint32_t sequence[2] = {0, 0};
+  for (int copy = 0; copy < 2; copy++) {
+    found[copy] = storeReadCopy(key, copy, record, size, valid);
+    if (found[copy]) sequence[copy] = ((const StoreHeader *)record)->sequence;
+  }
+  if (!found[0] && !found[1]) return false;
+  int newest = !found[0] || (found[1] && (int32_t)(sequence[1] - sequence[0]) > 0) ? 1 : 0;
+  return newest == 1 || storeReadCopy(key, newest, record, size, valid);
+}
+
+/** @brief Writes the copy the previous record is not in. */
+bool storeWrite(const char *key, const void *record, size_t size) {
+  char path[32];
+  storePath(path, sizeof(path), key, ((const StoreHeader *)record)->sequence & 1);
+  File file = LittleFS.open(path, "w");
+  if (!file) return false;
+  size_t length = file.write((const uint8_t *)record, size);
+  file.close();
+  return length == size;
+}
+
+void storeErase(const char *key) {
+  char path[32];
+  for (int copy = 0; copy < 2; copy++) {
+    storePath(path, sizeof(path), key, copy);
+    LittleFS.remove(path);
+  }
+}
+#endif
+
+
+//==============================================================================
+// Settings Store
+//==============================================================================
+// The channel settings are stored as the fixed-point values of a
+// SettingsCommand. Edits only mark the store dirty; loop() writes once things
+// have been quiet for SETTINGS_SAVE_DELAY, or at the latest
+// SETTINGS_SAVE_MAX_DELAY after the first unsaved change, and skips the write
+// when the values did not actually change.
+
+const uint32_t SETTINGS_MAGIC = 0x53544547;        // "GETS"
+const uint16_t SETTINGS_VERSION = 1;               // Bump when SettingsRecord changes
+const unsigned long SETTINGS_SAVE_DELAY = 5000;     // Quiet time before a write (ms)
+const unsigned long SETTINGS_SAVE_MAX_DELAY = 30000; // Longest a change stays unsaved (ms)
+
+/**
+ * @brief The persisted settings. Written and read as raw bytes.
+ */
+struct SettingsRecord {
+  StoreHeader header; // count = NUM_SENSORS of the firmware that wrote it
+  int32_t values[NUM_SENSORS][SETTING_FIELD_COUNT]; // Fixed point, as in SettingsCommand
+  uint32_t crc;       // CRC-32 of everything above
+};
+
+/**
+ * @brief State of the settings store, reported by /status.
+ */
+struct SettingsStore {
+  bool loaded;                    // Settings at boot came from flash, not compiled defaults
+  bool dirty;                     // RAM differs from flash, or may
+  unsigned long firstChange;      // millis() of the first unsaved change
+  unsigned long lastChange;       // millis() of the latest unsaved change
+  uint32_t writes;                // Records written since boot
+  uint32_t writeErrors;           // Failed writes since boot
+  SettingsRecord saved;           // Copy of the record in flash
+};
+SettingsStore settingsStore;
+
+/** @brief Returns true if the fixed-point values of one channel form valid settings. */
+bool channelValuesValid(const int32_t *values) {
+  for (int f = 0; f < SETTING_FIELD_COUNT; f++) {
+    if (values[f] < SETTING_FIELDS[f].min || values[f] > SETTING_FIELDS[f].max) return false;
+  }
+  return values[FIELD_LOWER_LIMIT] <= values[FIELD_HOLD_TEMP];
+}
+
+/**
+ * @brief Checks a settings record read from flash before any of it is used.
+ * @details Besides the header and CRC, every value must pass the same range
+ * and cross-field checks as a web update.
+ */
+bool settingsRecordValid(const void *data) {
+  const SettingsRecord &record = *(const SettingsRecord *)data;
+  if (!recordHeaderValid(&record, sizeof(record), SETTINGS_MAGIC, SETTINGS_VERSION, NUM_SENSORS)) return false;
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    if (!channelValuesValid(record.values[i])) return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Loads the stored settings into the setting arrays. Called from setup().
+ * @details Keeps the compiled defaults when there is no valid record.
+ */
+void loadSettings() {
+  SettingsRecord &record = settingsStore.saved;
+  if (!storeRead("settings", &record, sizeof(record), settingsRecordValid)) {
+    memset(&record, 0, sizeof(record));
+    Serial.println("Settings: no stored settings, using defaults");
+    return;
+  }
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    for (int f = 0; f < SETTING_FIELD_COUNT; f++) writeField(i, (SettingField)f, record.values[i][f]);
+  }
+  settingsStore.loaded = true;
+  Serial.printf("Settings: loaded record #%u\n", (unsigned)record.header.sequence);
+}
+
+/**
+ * @brief Notes a settings change; the write happens later from saveSettingsIfDue().
+ */
+void markSettingsDirty() {
+  unsigned long now = millis();
+  if (!settingsStore.dirty) settingsStore.firstChange = now;
+  settingsStore.lastChange = now;
+  settingsStore.dirty = true;
+}
+
+/**
+ * @brief Writes the settings once changes have settled. Called from loop().
+ * @param immediately Write pending changes now (before a reboot).
+ * @note The flash libraries allocate briefly, so this runs outside the heap guard.
+ */
+void saveSettingsIfDue(bool immediately = false) {
+  if (!settingsStore.dirty) return;
+  unsigned long now = millis();
+  if (!immediately && now - settingsStore.lastChange < SETTINGS_SAVE_DELAY &&
+      now - settingsStore.firstChange < SETTINGS_SAVE_MAX_DELAY) {
+    return;
+  }
+  settingsStore.dirty = false;
+
+  SettingsRecord record;
+  memset(&record, 0, sizeof(record));
+  record.header.magic = SETTINGS_MAGIC;
+  record.header.version = SETTINGS_VERSION;
+  record.header.count = NUM_SENSORS;
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    for (int f = 0; f < SETTING_FIELD_COUNT; f++) record.values[i][f] = currentField(i, (SettingField)f);
+  }
+  if (memcmp(record.values, settingsStore.saved.values, sizeof(record.values)) == 0 &&
+      settingsStore.saved.header.magic == SETTINGS_MAGIC) {
+    return; // Edited back to what is already stored
+  }
+  record.header.sequence = settingsStore.saved.header.sequence + 1;
+  record.crc = recordCrc(&record, sizeof(record));
+
+  ProfileScope profile(PROFILE_FLASH_WRITE);
+  if (storeWrite("settings", &record, sizeof(record))) {
+    settingsStore.saved = record;
+    settingsStore.writes++;
+  } else {
+    settingsStore.writeErrors++;
+    markSettingsDirty(); // Retry after another delay
+    Serial.println("Settings: write failed");
+  }
+}
+
+
+//==============================================================================
+// Presets
+//==============================================================================
+// A preset is a named set of the four channel settings. Built-in presets live
+// in PROGMEM; PRESET_SLOTS user presets are kept in one flash record. Applying
+// a preset to any set of channels is a single SettingsCommand built from the
+// preset and a channel bit mask, so it goes through the same validation and
+// queue as a form post. Saving and deleting user presets is handed to loop()
+// through a one-entry mailbox, which also writes the record to flash.
+
+const uint8_t PRESET_NAME_MAX = 16;   // Including the terminating NUL
+const uint8_t PRESET_SLOTS = 8;       // User presets
+const uint32_t PRESETS_MAGIC = 0x53525047; // "GPRS"
+const uint16_t PRESETS_VERSION = 1;
+
+/**
+ * @brief A named parameter set (32 bytes). An empty name marks a free slot.
+ */
+struct Preset {
+  char name[PRESET_NAME_MAX];
+  int32_t values[SETTING_FIELD_COUNT]; // Fixed point, as in SettingsCommand
+};
+
+/** @brief A compiled-in setting as a fixed-point preset value (decimals as in SETTING_FIELDS). */
+constexpr int32_t presetValue(float value, int32_t scale) {
+  return (int32_t)(value * scale + (value < 0 ? -0.5f : 0.5f));
+}
+
+const Preset BUILTIN_PRESETS[] PROGMEM = {
+  // The compiled-in defaults of the first channel
+  {"default", {presetValue(CHANNELS[0].holdTemp, 100), presetValue(CHANNELS[0].coolingSpeed, 100),
+               presetValue(CHANNELS[0].lowerLimit, 100), (int32_t)CHANNELS[0].holdDuration}},
+};
+const uint8_t BUILTIN_PRESET_COUNT = sizeof(BUILTIN_PRESETS) / sizeof(BUILTIN_PRESETS[0]);
+
+/**
+ * @brief The persisted user presets.
+ */
+struct PresetRecord {
+  StoreHeader header; // count = PRESET_SLOTS
+  Preset slots[PRESET_SLOTS];
+  uint32_t crc;
+};
+PresetRecord presetRecord; // The header and CRC are those of the record in flash
+
+/**
+ * @brief Flash state of the user presets, reported by /status.
+ */
+struct PresetStore {
+  bool dirty;                // presetRecord.slots differ from flash
+  bool retrying;             // The last write failed; retried after SETTINGS_SAVE_DELAY
+  unsigned long failedAt;    // millis() of the failed write
+  uint32_t writes;           // Records written since boot
+  uint32_t writeErrors;      // Failed writes since boot
+};
+PresetStore presetStore;
+
+enum PresetOp : uint8_t { PRESET_OP_NONE, PRESET_OP_SAVE, PRESET_OP_DELETE };
+
+/**
+ * @brief A user-preset change waiting for loop().
+ */
+struct PresetEdit {
+  PresetOp op;
+  Preset preset; // For PRESET_OP_DELETE only the name is used
+};
+PresetEdit presetMailbox;
+std::atomic<bool> presetMailboxFull(false);
+
+bool presetRecordValid(const void *data) {
+  const PresetRecord &record = *(const PresetRecord *)data;
+  if (!recordHeaderValid(&record, sizeof(record), PRESETS_MAGIC, PRESETS_VERSION, PRESET_SLOTS)) return false;
+  for (int s = 0; s < PRESET_SLOTS; s++) {
+    const Preset &preset = record.slots[s];
+    if (preset.name[0] == '\0') continue;
+    if (memchr(preset.name, '\0', PRESET_NAME_MAX) == nullptr || !channelValuesValid(preset.values)) return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Loads the user presets. Called from setup().
+ */
+void loadPresets() {
+  if (!storeRead("presets", &presetRecord, sizeof(presetRecord), presetRecordValid)) {
+    memset(&presetRecord, 0, sizeof(presetRecord));
+  }
+}
+
+/**
+ * @brief Finds a preset by name.
+ * @param preset Receives the preset.
+ * @param slot Receives the user slot, or -1 for a built-in preset.
+ */
+bool findPreset(const char *name, Preset &preset, int &slot) {
+  for (int b = 0; b < BUILTIN_PRESET_COUNT; b++) {
+    memcpy_P(&preset, &BUILTIN_PRESETS[b], sizeof(preset));
+    if (strcmp(preset.name, name) == 0) {
+      slot = -1;
+      return true;
+    }
+  }
+  for (slot = 0; slot < PRESET_SLOTS; slot++) {
+    if (presetRecord.slots[slot].name[0] != '\0' && strcmp(presetRecord.slots[slot].name, name) == 0) {
+      preset = presetRecord.slots[slot];
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Preset names are 1-15 letters, digits, spaces, '.', '-' or '_'.
+ */
+bool presetNameValid(const char *name) {
+  if (name == nullptr || name[0] == '\0' || strlen(name) >= PRESET_NAME_MAX) return false;
+  for (const char *c = name; *c != '\0'; c++) {
+    if (!isalnum((unsigned char)*c) && strchr(" .-_", *c) == nullptr) return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Builds the command that applies a preset to every channel in channelMask.
+ */
+void presetCommand(const Preset &preset, uint32_t channelMask, SettingsCommand &command) {
+  clearCommand(command);
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    if (!(channelMask & (1UL << i))) continue;
+    for (int f = 0; f < SETTING_FIELD_COUNT; f++) setCommandField(command, i, (SettingField)f, preset.values[f]);
+  }
+}
+
+/**
+ * @brief Queues a user-preset change for loop().
+ * @return False if the previous change has not been handled yet.
+ */
+bool submitPresetEdit(PresetOp op, const Preset &preset) {
+  if (presetMailboxFull.load(std::memory_order_acquire)) return false;
+  presetMailbox.op = op;
+  presetMailbox.preset = preset;
+  presetMailboxFull.store(true, std::memory_order_release);
+  powerWake();
+  return true;
+}
+
+/**
+ * @brief Applies a pending user-preset change; savePresetsIfDue() writes it.
+ * @note Called from loop().
+ */
+void applyPresetEdit() {
+  if (!presetMailboxFull.load(std::memory_order_acquire)) return;
+  PresetEdit edit = presetMailbox;
+  presetMailboxFull.store(false, std::memory_order_release);
+
+  int target = -1;
+  for (int s = 0; s < PRESET_SLOTS; s++) {
+    if (presetRecord.slots[s].name[0] != '\0' && strcmp(presetRecord.slots[s].name, edit.preset.name) == 0) target = s;
+  }
+  if (edit.op == PRESET_OP_DELETE) {
+    if (target < 0) return;
+    memset(&presetRecord.slots[target], 0, sizeof(Preset));
+  } else {
+    for (int s = 0; s < PRESET_SLOTS && target < 0; s++) {
+      if (presetRecord.slots[s].name[0] == '\0') target = s;
+    }
+    if (target < 0) return; // Checked by the handler; only a race with another save gets here
+    presetRecord.slots[target] = edit.preset;
+  }
+  presetStore.dirty = true;
+}
+
+/**
+ * @brief Writes changed user presets to flash. Called from loop().
+ * @details Edits are written at once. A failed write leaves the store dirty
+ * and is retried SETTINGS_SAVE_DELAY later, with any edits made meanwhile;
+ * the sequence number only advances once a record is in flash.
+ * @param immediately Retry a failed write now (before a reboot).
+ * @note The flash libraries allocate briefly, so this runs outside the heap guard.
+ */
+void savePresetsIfDue(bool immediately = false) {
+  if (!presetStore.dirty) return;
+  if (!immediately && presetStore.retrying && millis() - presetStore.failedAt < SETTINGS_SAVE_DELAY) return;
+
+  PresetRecord record = presetRecord;
+  record.header.magic = PRESETS_MAGIC;
+  record.header.version = PRESETS_VERSION;
+  record.header.count = PRESET_SLOTS;
+  record.header.sequence = presetRecord.header.sequence + 1;
+  record.crc = recordCrc(&record, sizeof(record));
+
+  ProfileScope profile(PROFILE_FLASH_WRITE);
+  if (storeWrite("presets", &record, sizeof(record))) {
+    presetRecord.header = record.header;
+    presetRecord.crc = record.crc;
+    presetStore.dirty = false;
+    presetStore.retrying = false;
+    presetStore.writes++;
+  } else {
+    presetStore.retrying = true;
+    presetStore.failedAt = millis();
+    presetStore.writeErrors++;
+    Serial.println("Presets: write failed");
+  }
+}
+
+/** @brief Number of free user-preset slots. */
+int freePresetSlots() {
+  int free = 0;
+  for (int s = 0; s < PRESET_SLOTS; s++) {
+    if (presetRecord.slots[s].name[0] == '\0') free++;
+  }
+  return free;
+}
+
+/**
+ * @brief Returns the value of a POST parameter, or nullptr.
+ * @note Walks the parameters by index; looking them up by name would build a String.
+ */
+const char *findPostParam(AsyncWebServerRequest *request, const char *name) {
+  for (size_t p = 0; p < request->params(); p++) {
+    const AsyncWebParameter *param = request->getParam(p);
+    if (param->isPost() && strcmp(param->name().c_str(), name) == 0) return param->value().c_str();
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Parses a channel list: "all", or channel numbers separated by commas.
+ * @return The channel bit mask, or 0 if the list is invalid.
+ */
+uint32_t parseChannelList(const char *text) {
+  if (text == nullptr || strcmp(text, "all") == 0) return ALL_CHANNELS;
+  uint32_t mask = 0;
+  while (*text != '\0') {
+    char *end;
+    long channel = strtol(text, &end, 10);
+    if (end == text || channel < 0 || channel >= NUM_SENSORS) return 0;
+    mask |= 1UL << channel;
+    text = end;
+    if (*text == ',') text++;
+    else if (*text != '\0') return 0;
+  }
+  return mask;
+}
+
+/** @brief Renders one preset as a JSON object. */
+void renderPreset(WindowWriter &out, const Preset &preset, bool builtin, bool first) {
+  out.printf("%s{\"name\":\"%s\",\"builtin\":%s", first ? "" : ",", preset.name, builtin ? "true" : "false");
+  for (int f = 0; f < SETTING_FIELD_COUNT; f++) {
+    if (SETTING_FIELDS[f].decimals == 2) {
+      out.printf(",\"%s\":%.2f", SETTING_FIELDS[f].formName, preset.values[f] / 100.0);
+    } else {
+      out.printf(",\"%s\":%ld", SETTING_FIELDS[f].formName, (long)preset.values[f]);
+    }
+  }
+  out.print("}");
+}
+
+/**
+ * @brief Renders all presets: {"free_slots":N,"presets":[{"name":...,"builtin":...,<fields>},...]}.
+ */
+void renderPresets(WindowWriter &out) {
+  out.printf("{\"free_slots\":%d,\"presets\":[", freePresetSlots());
+  bool first = true;
+  Preset preset;
+  for (int b = 0; b < BUILTIN_PRESET_COUNT; b++) {
+    memcpy_P(&preset, &BUILTIN_PRESETS[b], sizeof(preset));
+    renderPreset(out, preset, true, first);
+    first = false;
+  }
+  for (int s = 0; s < PRESET_SLOTS; s++) {
+    if (presetRecord.slots[s].name[0] == '\0') continue;
+    renderPreset(out, presetRecord.slots[s], false, first);
+    first = false;
+  }
+  out.print("]}");
+}
+
+
+//==============================================================================
+// Channel Selection
+//==============================================================================
+// CHANNELS sets how many channels the firmware can handle; which of them are
+// populated is chosen at runtime with POST /api/channels and kept in flash.
+// Disabled channels are skipped by the sensor reads, the control step, /data,
+// /metrics and the main page, so bus time and response size follow the
+// populated channels. A channel that is disabled mid-run has its heater
+// switched off and returns to Idle. The web handler hands the new mask to
+// loop() through channelsRequest, and loop() writes it to flash.
+
+const uint32_t CHANNELS_MAGIC = 0x4E484347; // "GCHN"
+const uint16_t CHANNELS_VERSION = 1;
+
+/**
+ * @brief The persisted enable mask.
+ */
+struct ChannelsRecord {
+  StoreHeader header; // count = NUM_SENSORS
+  uint32_t enabled;   // Bit i: channel i is populated
+  uint32_t crc;
+};
+ChannelsRecord channelsRecord;
+
+std::atomic<uint32_t> channelsRequest(0); // New enable mask from the web handler, 0 if none
+
+bool channelsRecordValid(const void *data) {
+  const ChannelsRecord &record = *(const ChannelsRecord *)data;
+  return recordHeaderValid(&record, sizeof(record), CHANNELS_MAGIC, CHANNELS_VERSION, NUM_SENSORS) &&
+         record.enabled != 0 && (record.enabled & ~ALL_CHANNELS) == 0;
+}
+
+/**
+ * @brief Switches to a new enable mask.
+ * @details Newly disabled channels are stopped; newly enabled ones start
+ * without a temperature until their sensor is read.
+ */
+void setEnabledChannels(uint32_t enabled) {
+  uint32_t changed = controller.enabled ^ enabled;
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    if (!(changed & (1UL << i))) continue;
+    controller.lastTemperatures[i] = CHANNEL_NO_READING;
+    record(RECORD_CHANNEL, i, enabled >> i & 1);
+    if (enabled & (1UL << i)) continue;
+    if (controller.outputState[i]) {
+      trace(TRACE_HEATER_OFF, i, 0);
+      record(RECORD_OUTPUT, i, 0);
+    }
+    if (controller.holdPhaseActive[i] || controller.coolingPhaseActive[i]) {
+      trace(TRACE_PHASE, i, TRACE_PHASE_IDLE);
+      record(RECORD_PHASE, i, TRACE_PHASE_IDLE);
+    }
+    controller.outputState[i] = false;
+    controller.holdPhaseActive[i] = false;
+    controller.coolingPhaseActive[i] = false;
+    controller.liveSetpoints[i] = controller.setting_HoldTemps[i];
+    outputSet(i, false);
+  }
+  controller.setEnabled(enabled);
+  outputCommit();
+}
+
+/** @brief Loads the stored enable mask. Called from setup(); keeps every channel enabled without one. */
+void loadChannels() {
+  if (!storeRead("channels", &channelsRecord, sizeof(channelsRecord), channelsRecordValid)) {
+    memset(&channelsRecord, 0, sizeof(channelsRecord));
+    return;
+  }
+  controller.setEnabled(channelsRecord.enabled);
+  Serial.printf("Channels: %d of %d enabled\n", controller.activeChannels(), NUM_SENSORS);
+}
+
+/**
+ * @brief Applies and stores an enable mask sent by POST /api/channels.
+ * @note Called from loop(), outside the heap guard (the flash write may allocate).
+ */
+void applyChannelsRequest() {
+  uint32_t enabled = channelsRequest.exchange(0);
+  if (enabled == 0 || enabled == controller.enabled) return;
+  setEnabledChannels(enabled);
+  LOG_EVENT(LOG_CHANNELS_CHANGED, LOG_NO_CHANNEL, (float)controller.activeChannels());
+
+  ChannelsRecord record;
+  memset(&record, 0, sizeof(record));
+  record.header.magic = CHANNELS_MAGIC;
+  record.header.version = CHANNELS_VERSION;
+  record.header.count = NUM_SENSORS;
+  record.header.sequence = channelsRecord.header.sequence + 1;
+  record.enabled = enabled;
+  record.crc = recordCrc(&record, sizeof(record));
+  ProfileScope profile(PROFILE_FLASH_WRITE);
+  if (storeWrite("channels", &record, sizeof(record))) {
+    channelsRecord = record;
+  } else {
+    Serial.println("Channels: write failed");
+  }
+}
+
+/**
+ * @brief Renders every channel with its enable flag, for GET /api/channels.
+ */
+void renderChannels(WindowWriter &out) {
+  out.printf("{\"capacity\":%d,\"active\":%d,\"channels\":[", NUM_SENSORS, controller.activeChannels());
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    out.printf("%s{\"channel\":%d,\"name\":\"%s\",\"enabled\":%s}", i == 0 ? "" : ",", i, CHANNELS[i].name,
+               controller.channelEnabled(i) ? "true" : "false");
+  }
+  out.print("]}");
+}
+
+
+//==============================================================================
+// WiFi
+//==============================================================================
+// The controller never waits for the network: setup() configures the outputs
+// and sensors first and loop() starts controlling at once, while wifiService()
+// brings the link up in the background. The BSSID and radio channel of the
+// last good connection are kept in the flash store so the next boot can join
+// without scanning; if that fast attempt fails, a normal scan-and-join
+// follows. A lost link is first left to the SDK's auto-reconnect, then retried
+// with an increasing delay. The web server starts on the first connection.
+//
+// When no network has been reachable for WIFI_AP_FALLBACK, the controller
+// also opens its own access point ("GellanTurbo-XXXXXX", password
+// ap_password) with a captive-portal DNS server, so the same web interface is
+// reachable at 192.168.4.1 and new credentials can be entered there. They are
+// stored in flash and take precedence over ssid/password. The station keeps
+// retrying (paused while a client is connected to the access point, since a
+// scan moves the radio off the AP channel); once it connects the access point
+// closes after WIFI_AP_LINGER, giving the client time to note the new address.
+// All of this runs from loop() in short non-blocking steps between control
+// ticks.
+
+const unsigned long WIFI_FAST_TIMEOUT = 4000;     // Join using the stored BSSID/channel (ms)
+const unsigned long WIFI_CONNECT_TIMEOUT = 15000; // Scan and join (ms)
+const unsigned long WIFI_RETRY_MIN = 2000;        // First delay between failed attempts (ms)
+const unsigned long WIFI_RETRY_MAX = 60000;       // Longest delay between failed attempts (ms)
+const unsigned long WIFI_AP_FALLBACK = 30000;     // Offline time before the access point opens (ms)
+const unsigned long WIFI_AP_LINGER = 120000;      // Access point lifetime after the station connects (ms)
+const uint32_t WIFI_MAGIC = 0x49574547;           // "GEWI"
+const uint16_t WIFI_VERSION = 1;
+const uint32_t CREDENTIALS_MAGIC = 0x52434547;    // "GECR"
+const uint16_t CREDENTIALS_VERSION = 1;
+
+/**
+ * @brief Network credentials entered at runtime.
+ */
+struct CredentialsRecord {
+  StoreHeader header; // count = 1
+  char ssid[33];      // NUL-terminated
+  char password[65];  // NUL-terminated; empty for an open network
+  uint8_t reserved[2];
+  uint32_t crc;
+};
+
+/**
+ * @brief The access point of the last good connection.
+ */
+struct WifiRecord {
+  StoreHeader header; // count = 1
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t reserved;
+  uint32_t crc;
+};
+
+enum WifiState : uint8_t { WIFI_CONNECTING, WIFI_CONNECTED, WIFI_WAITING };
+
+DNSServer dnsServer;
+
+/**
+ * @brief Connection state, reported by /status.
+ */
+struct WifiLink {
+  WifiState state;
+  bool fastAttempt;            // Current attempt uses the stored BSSID/channel
+  bool serverStarted;
+  unsigned long attemptStarted; // millis()
+  unsigned long connectedSince; // millis()
+  unsigned long retryDelay;     // Delay before the next attempt after a failure (ms)
+  unsigned long offlineSince;   // millis() when the station was last known to be disconnected
+  bool apActive;                // Fallback access point is open
+  char apSsid[24];
+  uint32_t connects;
+  uint32_t disconnects;
+  WifiRecord saved;             // Valid if saved.header.magic == WIFI_MAGIC
+  CredentialsRecord credentials; // Stored credentials, valid if credentials.header.magic == CREDENTIALS_MAGIC
+};
+WifiLink wifiLink;
+
+/**
+ * @brief Milestones since boot, reported by /status. 0 means not reached yet.
+ */
+struct BootTiming {
+  uint32_t firstControlTickMicros; // First run of the control logic
+  uint32_t wifiConnectedMillis;    // First WiFi connection
+  uint32_t httpReadyMillis;        // Web server listening
+};
+BootTiming bootTiming;
+
+// New credentials travel from the web handler to loop() through a one-entry mailbox.
+CredentialsRecord credentialsMailbox;
+std::atomic<bool> credentialsMailboxFull(false);
+
+bool wifiRecordValid(const void *record) {
+  return recordHeaderValid(record, sizeof(WifiRecord), WIFI_MAGIC, WIFI_VERSION, 1);
+}
+
+bool credentialsRecordValid(const void *data) {
+  const CredentialsRecord &record = *(const CredentialsRecord *)data;
+  return recordHeaderValid(&record, sizeof(record), CREDENTIALS_MAGIC, CREDENTIALS_VERSION, 1) &&
+         memchr(record.ssid, '\0', sizeof(record.ssid)) != nullptr && record.ssid[0] != '\0' &&
+         memchr(record.password, '\0', sizeof(record.password)) != nullptr;
+}
+
+/** @brief Network name in use: the stored one, else the compiled-in one. */
+const char *wifiSsid() {
+  return wifiLink.credentials.header.magic == CREDENTIALS_MAGIC ? wifiLink.credentials.ssid : ssid;
+}
+
+const char *wifiPassword() {
+  return wifiLink.credentials.header.magic == CREDENTIALS_MAGIC ? wifiLink.credentials.password : password;
+}
+
+/**
+ * @brief Starts a connection attempt, without waiting for it.
+ * @param fast Join the stored BSSID on the stored channel instead of scanning.
+ */
+void wifiAttempt(bool fast) {
+  wifiLink.fastAttempt = fast;
+  wifiLink.attemptStarted = millis();
+  wifiLink.state = WIFI_CONNECTING;
+  if (fast) {
+    WiFi.begin(wifiSsid(), wifiPassword(), wifiLink.saved.channel, wifiLink.saved.bssid);
+  } else {
+    WiFi.begin(wifiSsid(), wifiPassword());
+  }
+}
+
+/**
+ * @brief Starts WiFi in the background. Called at the end of setup().
+ */
+void wifiBegin() {
+  WiFi.persistent(false); // The SDK would otherwise rewrite its flash config on every begin()
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);
+  if (!storeRead("wifi", &wifiLink.saved, sizeof(wifiLink.saved), wifiRecordValid)) {
+    memset(&wifiLink.saved, 0, sizeof(wifiLink.saved));
+  }
+  if (!storeRead("credentials", &wifiLink.credentials, sizeof(wifiLink.credentials), credentialsRecordValid)) {
+    memset(&wifiLink.credentials, 0, sizeof(wifiLink.credentials));
+  }
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  snprintf(wifiLink.apSsid, sizeof(wifiLink.apSsid), "GellanTurbo-%02X%02X%02X", mac[3], mac[4], mac[5]);
+  wifiLink.offlineSince = millis();
+  wifiLink.retryDelay = WIFI_RETRY_MIN;
+  wifiAttempt(wifiLink.saved.header.magic == WIFI_MAGIC);
+}
+
+/** @brief Starts the web server the first time the controller becomes reachable. */
+void startServerOnce() {
+  if (wifiLink.serverStarted) return;
+  server.begin();
+  wifiLink.serverStarted = true;
+  bootTiming.httpReadyMillis = millis();
+}
+
+/**
+ * @brief Opens the fallback access point and the captive-portal DNS server.
+ */
+void startAccessPoint() {
+  WiFi.mode(WIFI_AP_STA);
+  WiFi.softAP(wifiLink.apSsid, ap_password);
+  dnsServer.start(53, "*", WiFi.softAPIP()); // Every name resolves to the controller
+  wifiLink.apActive = true;
+  LOG_EVENT(LOG_WIFI_AP_STARTED, LOG_NO_CHANNEL, (millis() - wifiLink.offlineSince) / 1000.0f);
+  Serial.printf("Access point \"%s\" open, web interface at http://", wifiLink.apSsid);
+  Serial.println(WiFi.softAPIP());
+  startServerOnce();
+}
+
+void stopAccessPoint() {
+  dnsServer.stop();
+  WiFi.softAPdisconnect(true);
+  WiFi.mode(WIFI_STA);
+  wifiLink.apActive = false;
+  LOG_EVENT(LOG_WIFI_AP_STOPPED, LOG_NO_CHANNEL, 0);
+}
+
+/**
+ * @brief Stores new credentials and reconnects with them.
+ */
+void applyCredentials(CredentialsRecord &record) {
+  record.header.magic = CREDENTIALS_MAGIC;
+  record.header.version = CREDENTIALS_VERSION;
+  record.header.count = 1;
+  record.header.sequence = wifiLink.credentials.header.sequence + 1;
+  record.crc = recordCrc(&record, sizeof(record));
+  {
+    ProfileScope profile(PROFILE_FLASH_WRITE);
+    if (!storeWrite("credentials", &record, sizeof(record))) Serial.println("WiFi: storing credentials failed");
+  }
+  wifiLink.credentials = record;
+  memset(&wifiLink.saved, 0, sizeof(wifiLink.saved)); // The stored BSSID belongs to the old network
+  if (wifiLink.state == WIFI_CONNECTED) wifiLink.offlineSince = millis();
+  WiFi.disconnect();
+  wifiLink.retryDelay = WIFI_RETRY_MIN;
+  wifiAttempt(false);
+}
+
+/**
+ * @brief Handles a new connection: starts the web server and remembers the access point.
+ */
+void wifiConnected(unsigned long now) {
+  wifiLink.state = WIFI_CONNECTED;
+  wifiLink.connectedSince = now;
+  wifiLink.retryDelay = WIFI_RETRY_MIN;
+  wifiLink.connects++;
+  LOG_EVENT(LOG_WIFI_CONNECTED, LOG_NO_CHANNEL, (float)(now - wifiLink.attemptStarted));
+  Serial.print("ESP IP Address: http://");
+  Serial.println(WiFi.localIP());
+
+  if (bootTiming.wifiConnectedMillis == 0) bootTiming.wifiConnectedMillis = now;
+  startServerOnce();
+
+  const uint8_t *bssid = WiFi.BSSID();
+  uint8_t channel = (uint8_t)WiFi.channel();
+  if (bssid == nullptr) return;
+  if (wifiLink.saved.header.magic == WIFI_MAGIC && wifiLink.saved.channel == channel &&
+      memcmp(wifiLink.saved.bssid, bssid, sizeof(wifiLink.saved.bssid)) == 0) {
+    return;
+  }
+  WifiRecord record;
+  memset(&record, 0, sizeof(record));
+  record.header.magic = WIFI_MAGIC;
+  record.header.version = WIFI_VERSION;
+  record.header.count = 1;
+  record.header.sequence = wifiLink.saved.header.sequence + 1;
+  memcpy(record.bssid, bssid, sizeof(record.bssid));
+  record.channel = channel;
+  record.crc = recordCrc(&record, sizeof(record));
+  ProfileScope profile(PROFILE_FLASH_WRITE);
+  if (storeWrite("wifi", &record, sizeof(record))) wifiLink.saved = record;
+}
+
+/**
+ * @brief Advances the connection state machine. Called from loop().
+ * @note Runs outside the heap guard: the WiFi stack and the flash store allocate.
+ */
+void wifiService() {
+  unsigned long now = millis();
+  bool up = WiFi.status() == WL_CONNECTED;
+
+  if (credentialsMailboxFull.load(std::memory_order_acquire)) {
+    CredentialsRecord record = credentialsMailbox;
+    credentialsMailboxFull.store(false, std::memory_order_release);
+    applyCredentials(record);
+    return;
+  }
+  if (wifiLink.apActive) {
+    dnsServer.processNextRequest();
+    if (up && now - wifiLink.connectedSince >= WIFI_AP_LINGER && WiFi.softAPgetStationNum() == 0) stopAccessPoint();
+  } else if (!up && now - wifiLink.offlineSince >= WIFI_AP_FALLBACK) {
+    startAccessPoint();
+  }
+
+  switch (wifiLink.state) {
+    case WIFI_CONNECTING:
+      if (up) {
+        wifiConnected(now);
+      } else if (now - wifiLink.attemptStarted >= (wifiLink.fastAttempt ? WIFI_FAST_TIMEOUT : WIFI_CONNECT_TIMEOUT)) {
+        if (wifiLink.fastAttempt) {
+          wifiAttempt(false); // The access point may have moved; scan for it
+        } else {
+          LOG_EVENT(LOG_WIFI_FAILED, LOG_NO_CHANNEL, wifiLink.retryDelay / 1000.0f);
+          WiFi.disconnect();
+          wifiLink.state = WIFI_WAITING;
+          wifiLink.attemptStarted = now;
+        }
+      }
+      break;
+
+    case WIFI_CONNECTED:
+      if (!up) {
+        // Give the SDK's auto-reconnect a full attempt before starting over.
+        wifiLink.disconnects++;
+        wifiLink.offlineSince = now;
+        LOG_EVENT(LOG_WIFI_LOST, LOG_NO_CHANNEL, (now - wifiLink.connectedSince) / 1000.0f);
+        wifiLink.state = WIFI_CONNECTING;
+        wifiLink.fastAttempt = false;
+        wifiLink.attemptStarted = now;
+      }
+      break;
+
+    case WIFI_WAITING:
+      if (wifiLink.apActive && WiFi.softAPgetStationNum() > 0) {
+        wifiLink.attemptStarted = now; // Don't scan away from a client that is configuring us
+      } else if (now - wifiLink.attemptStarted >= wifiLink.retryDelay) {
+        wifiLink.retryDelay = wifiLink.retryDelay * 2 > WIFI_RETRY_MAX ? WIFI_RETRY_MAX : wifiLink.retryDelay * 2;
+        wifiAttempt(wifiLink.saved.header.magic == WIFI_MAGIC);
+      }
+      break;
+  }
+}
+
+/**
+ * @brief Queues new credentials for loop().
+ * @return False if the previous change has not been handled yet.
+ */
+bool submitCredentials(const char *newSsid, const char *newPassword) {
+  if (credentialsMailboxFull.load(std::memory_order_acquire)) return false;
+  memset(&credentialsMailbox, 0, sizeof(credentialsMailbox));
+  strcpy(credentialsMailbox.ssid, newSsid);
+  strcpy(credentialsMailbox.password, newPassword);
+  credentialsMailboxFull.store(true, std::memory_order_release);
+  powerWake();
+  return true;
+}
+
+/**
+ * @brief Writes text as a quoted JSON string. Network names may contain anything.
+ */
+void writeJsonString(WindowWriter &out, const char *text) {
+  out.print("\"");
+  for (const char *c = text; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      out.printf("\\%c", *c);
+    } else if ((unsigned char)*c < 0x20) {
+      out.printf("\\u%04x", (unsigned char)*c);
+    } else {
+      out.write(c, 1);
+    }
+  }
+  out.print("\"");
+}
+
+/**
+ * @brief Renders the WiFi state: {"connected":..,"ssid":..,"stored_credentials":..,"ap_active":..,"ap_ssid":..}.
+ */
+void renderWifi(WindowWriter &out) {
+  out.printf("{\"connected\":%s,\"ssid\":", wifiLink.state == WIFI_CONNECTED ? "true" : "false");
+  writeJsonString(out, wifiSsid());
+  out.printf(",\"stored_credentials\":%s,\"ap_active\":%s,\"ap_ssid\":\"%s\"}",
+             wifiLink.credentials.header.magic == CREDENTIALS_MAGIC ? "true" : "false",
+             wifiLink.apActive ? "true" : "false", wifiLink.apSsid);
+}
+
+
+//==============================================================================
+// Configuration API
+//==============================================================================
+// POST /api/config changes any subset of channels and fields in one request:
+//
+//   {"channels":[{"channel":2,"threshold":62.5,"hold":90},{"channel":5,"lower":40}]}
+//
+// Field names are the settings-form names (SETTING_FIELDS). "name" is
+// accepted and ignored, so a GET /api/config export can be posted to another
+// controller unchanged. The body is parsed straight out of the request buffer
+// when it arrives in one TCP segment (and out of a fixed assembly buffer
+// otherwise) by ArduinoJson into a fixed arena, so a request never uses more
+// than CONFIG_BODY_MAX + CONFIG_ARENA_SIZE bytes. The result is a single
+// SettingsCommand: it is applied completely or not at all.
+
+const size_t CONFIG_BODY_MAX = 1536;             // Largest accepted body (bytes)
+const size_t CONFIG_ARENA_SIZE = 4096;           // ArduinoJson memory per parse (bytes)
+const unsigned long CONFIG_UPLOAD_TIMEOUT = 5000; // An abandoned upload frees the buffer after this (ms)
+
+/**
+ * @brief ArduinoJson allocator handing out memory from a fixed arena.
+ * @details Allocation is a pointer bump; everything is released at once by
+ * reset() before the next parse. A full arena makes the parse fail with
+ * NoMemory instead of touching the heap.
+ */
+class ArenaAllocator : public ArduinoJson::Allocator {
+ public:
+  void reset() { used = 0; }
+
+  void *allocate(size_t size) override {
+    size_t need = HEADER + ((size + 7) & ~(size_t)7);
+    if (need > sizeof(arena) - used) return nullptr;
+    uint8_t *block = arena + used + HEADER;
+    *(size_t *)(block - HEADER) = size;
+    used += need;
+    return block;
+  }
+
+  void deallocate(void *) override {}
+
+  void *reallocate(void *ptr, size_t newSize) override {
+    if (ptr == nullptr) return allocate(newSize);
+    uint8_t *block = (uint8_t *)ptr;
+    size_t oldSize = *(size_t *)(block - HEADER);
+    size_t blockEnd = block - arena + ((oldSize + 7) & ~(size_t)7);
+    if (blockEnd == used) {
+      // The newest block can grow or shrink in place.
+      size_t start = block - arena;
+      size_t newEnd = start + ((newSize + 7) & ~(size_t)7);
+      if (newEnd > sizeof(arena)) return nullptr;
+      *(size_t *)(block - HEADER) = newSize;
+      used = newEnd;
+      return block;
+    }
+    void *moved = allocate(newSize);
+    if (moved != nullptr) memcpy(moved, ptr, oldSize < newSize ? oldSize : newSize);
+    return moved;
+  }
+
+ private:
+  static const size_t HEADER = 8; // Block size, keeping blocks 8-byte aligned
+  alignas(8) uint8_t arena[CONFIG_ARENA_SIZE];
+  size_t used = 0;
+};
+
+ArenaAllocator configArena;
+
+/**
+ * @brief The one /api/config upload being received.
+ * @details Only one upload is buffered at a time; a second one arriving
+ * meanwhile is refused with 503 by its handler.
+ */
+struct ConfigUpload {
+  AsyncWebServerRequest *owner; // Request whose body is being received, or nullptr
+  unsigned long started;        // millis() of the first body chunk
+  bool complete;                // Body received and parsed, or refused by admission control
+  RejectReason rejected;        // Why admission refused the request; REJECT_REASON_COUNT if admitted
+  CommandError error;           // Parse result
+  int channel;                  // Channel of the offending entry, or -1
+  char field[16];               // Offending field, or empty
+  SettingsCommand command;      // Parsed command (when error == COMMAND_OK)
+  char body[CONFIG_BODY_MAX];   // Assembly buffer for bodies split across segments
+};
+ConfigUpload configUpload;
+
+/** @brief Returns the field whose form name is exactly name, or -1. */
+int findSettingField(const char *name) {
+  for (int f = 0; f < SETTING_FIELD_COUNT; f++) {
+    if (strcmp(name, SETTING_FIELDS[f].formName) == 0) return f;
+  }
+  return -1;
+}
+
+/**
+ * @brief Parses a configuration document into a command.
+ * @details On failure configUpload.channel/field point at the offending entry.
+ */
+CommandError parseConfig(const char *json, size_t length, SettingsCommand &command) {
+  configArena.reset();
+  JsonDocument doc(&configArena);
+  if (deserializeJson(doc, json, length, DeserializationOption::NestingLimit(4))) return COMMAND_BAD_JSON;
+
+  JsonArrayConst channels = doc.as<JsonObjectConst>()["channels"].as<JsonArrayConst>();
+  if (channels.isNull()) return COMMAND_BAD_JSON;
+
+  clearCommand(command);
+  for (JsonVariantConst item : channels) {
+    JsonObjectConst entry = item.as<JsonObjectConst>();
+    JsonVariantConst index = entry["channel"];
+    configUpload.channel = -1;
+    if (entry.isNull() || !index.is<int>()) return COMMAND_BAD_CHANNEL;
+    int channel = index.as<int>();
+    if (channel < 0 || channel >= NUM_SENSORS) return COMMAND_BAD_CHANNEL;
+    configUpload.channel = channel;
+
+    for (JsonPairConst member : entry) {
+      const char *key = member.key().c_str();
+      if (strcmp(key, "channel") == 0 || strcmp(key, "name") == 0) continue;
+      strncpy(configUpload.field, key, sizeof(configUpload.field) - 1);
+      configUpload.field[sizeof(configUpload.field) - 1] = '\0';
+
+      int f = findSettingField(key);
+      if (f < 0) return COMMAND_UNKNOWN_FIELD;
+      if (!member.value().is<float>()) return COMMAND_BAD_NUMBER;
+      const SettingFieldSpec &spec = SETTING_FIELDS[f];
+      double value = member.value().as<double>() * (spec.decimals == 2 ? 100.0 : 1.0);
+      if (!(value >= spec.min - 0.5 && value <= spec.max + 0.5)) return COMMAND_OUT_OF_RANGE;
+      setCommandField(command, channel, (SettingField)f, (int32_t)lround(value));
+    }
+  }
+  configUpload.channel = -1;
+  configUpload.field[0] = '\0';
+  return COMMAND_OK;
+}
+
+/**
+ * @brief Body callback of POST /api/config: collects and parses the document.
+ * @details Admission control decides on the first chunk, so a refused request
+ * is neither buffered nor parsed.
+ */
+void receiveConfigBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+  if (index == 0) {
+    if (configUpload.owner != nullptr && millis() - configUpload.started < CONFIG_UPLOAD_TIMEOUT) return;
+    configUpload.owner = request;
+    configUpload.started = millis();
+    configUpload.complete = false;
+    configUpload.error = COMMAND_OK;
+    configUpload.channel = -1;
+    configUpload.field[0] = '\0';
+    configUpload.rejected = takeRequestSlots(ENDPOINT_CONFIG_POST);
+    if (configUpload.rejected != REJECT_REASON_COUNT) {
+      configUpload.complete = true;
+      return;
+    }
+    releaseOnDisconnect(request, ENDPOINT_CONFIG_POST);
+  }
+  if (configUpload.owner != request || configUpload.complete) return;
+
+  HeapGuardScope guard;
+  if (total > CONFIG_BODY_MAX) {
+    configUpload.error = COMMAND_TOO_LARGE;
+    configUpload.complete = true;
+    return;
+  }
+  const char *json = (const char *)data;
+  if (index != 0 || len != total) {
+    // Split across segments: assemble first.
+    if (index + len > total) return;
+    memcpy(configUpload.body + index, data, len);
+    if (index + len < total) return;
+    json = configUpload.body;
+  }
+  configUpload.error = parseConfig(json, total, configUpload.command);
+  configUpload.complete = true;
+}
+
+/**
+ * @brief Sends the JSON result of a configuration request.
+ */
+void sendConfigResult(AsyncWebServerRequest *request, CommandError error) {
+  char body[128];
+  if (error == COMMAND_OK) {
+    request->send(200, "application/json", "{\"ok\":true}");
+  } else if (error == COMMAND_QUEUE_FULL) {
+    rejectRequest(request, ENDPOINT_CONFIG_POST, REJECT_ENDPOINT);
+  } else {
+    snprintf(body, sizeof(body), "{\"ok\":false,\"error\":\"%s\",\"channel\":%d,\"field\":\"%s\"}",
+             COMMAND_ERROR_TEXT[error], configUpload.channel, configUpload.field);
+    request->send(error == COMMAND_TOO_LARGE ? 413 : 400, "application/json", body);
+  }
+}
+
+/**
+ * @brief Renders the settings of every channel in the /api/config schema.
+ */
+void renderConfig(WindowWriter &out) {
+  out.print("{\"channels\":[");
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    out.printf("%s{\"channel\":%d,\"name\":\"%s\"", i == 0 ? "" : ",", i, CHANNELS[i].name);
+    for (int f = 0; f < SETTING_FIELD_COUNT; f++) {
+      int32_t value = currentField(i, (SettingField)f);
+      if (SETTING_FIELDS[f].decimals == 2) {
+        out.printf(",\"%s\":%.2f", SETTING_FIELDS[f].formName, value / 100.0);
+      } else {
+        out.printf(",\"%s\":%ld", SETTING_FIELDS[f].formName, (long)value);
+      }
+    }
+    out.print("}");
+  }
+  out.print("]}");
+}
+
+
+//==============================================================================
+// Firmware Update
+//==============================================================================
+// POST /ota streams a firmware image (the raw .bin as the request body) into
+// the spare flash partition as it arrives, one TCP segment at a time, so the
+// upload needs no more RAM than the Update library's one-sector buffer. The
+// image's MD5 must be sent in the X-MD5 header and is checked before the new
+// image is marked bootable. Uploads need HTTP basic authentication as user
+// "admin" with ota_password; while ota_password is empty, /ota and
+// /ota/reboot are refused with 403. Admission control decides on the first
+// body chunk, so a refused upload never opens the updater.
+//
+// A reboot would interrupt running processes, so it is deferred while any
+// channel is in Hold or Cooling unless the upload (or POST /ota/reboot) has
+// ?force=1. Either way, the phase, live setpoint and phase time of every
+// channel are saved to flash just before the reboot and restored by the new
+// firmware, so a forced update continues the runs where they stopped. The
+// heaters are off during the few seconds of the reboot.
+
+const unsigned long OTA_UPLOAD_TIMEOUT = 10000; // An abandoned upload frees the updater after this (ms)
+const unsigned long OTA_REBOOT_DELAY = 1000;    // Time for the response to reach the client (ms)
+const uint32_t CHECKPOINT_MAGIC = 0x50434547;   // "GECP"
+const uint16_t CHECKPOINT_VERSION = 1;
+
+enum OtaError : uint8_t {
+  OTA_OK,
+  OTA_BUSY,
+  OTA_DISABLED,
+  OTA_UNAUTHORIZED,
+  OTA_NO_MD5,
+  OTA_TOO_LARGE,
+  OTA_WRITE_FAILED,
+  OTA_VERIFY_FAILED,
+  OTA_INCOMPLETE
+};
+const char *const OTA_ERROR_TEXT[] = {
+  "OK", "Busy", "Firmware updates are disabled (ota_password is not set)", "Unauthorized", "X-MD5 header with the image MD5 required", "Image does not fit",
+  "Flash write failed", "Image verification failed", "Upload incomplete"
+};
+
+/**
+ * @brief The one firmware upload in progress, and the pending reboot.
+ */
+struct OtaState {
+  AsyncWebServerRequest *owner; // Request whose body is being written, or nullptr
+  unsigned long lastActivity;   // millis() of the last body chunk
+  OtaError error;
+  RejectReason rejected;        // Why admission refused the upload (OTA_BUSY)
+  uint32_t written;             // Bytes written to flash so far
+  bool complete;                // Image written and verified
+  bool rebootPending;           // A verified image is waiting for the reboot
+  bool rebootForced;            // Reboot even with processes running
+  unsigned long rebootAfter;    // millis() before which the reboot must not happen
+};
+OtaState ota;
+
+/**
+ * @brief Run state of one channel, saved across a firmware update.
+ */
+struct ChannelCheckpoint {
+  uint8_t phase;          // TRACE_PHASE_IDLE, TRACE_PHASE_HOLD or TRACE_PHASE_COOLING
+  uint8_t reserved[3];
+  int32_t liveSetpoint;   // Hundredths of a degree
+  uint32_t phaseElapsed;  // Time spent in the phase (ms)
+};
+
+struct CheckpointRecord {
+  StoreHeader header; // count = NUM_SENSORS
+  ChannelCheckpoint channels[NUM_SENSORS];
+  uint32_t crc;
+};
+
+bool checkpointRecordValid(const void *data) {
+  const CheckpointRecord &record = *(const CheckpointRecord *)data;
+  if (!recordHeaderValid(&record, sizeof(record), CHECKPOINT_MAGIC, CHECKPOINT_VERSION, NUM_SENSORS)) return false;
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    if (record.channels[i].phase > TRACE_PHASE_COOLING) return false;
+  }
+  return true;
+}
+
+/** @brief Returns true if any channel is in Hold or Cooling. */
+bool processRunning() {
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    if (controller.holdPhaseActive[i] || controller.coolingPhaseActive[i]) return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Saves the run state of every channel. Called right before a reboot.
+ */
+void saveCheckpoint() {
+  CheckpointRecord record;
+  memset(&record, 0, sizeof(record));
+  record.header.magic = CHECKPOINT_MAGIC;
+  record.header.version = CHECKPOINT_VERSION;
+  record.header.count = NUM_SENSORS;
+  unsigned long now = millis();
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    ChannelCheckpoint &channel = record.channels[i];
+    channel.phase = controller.holdPhaseActive[i] ? TRACE_PHASE_HOLD : controller.coolingPhaseActive[i] ? TRACE_PHASE_COOLING : TRACE_PHASE_IDLE;
+    channel.liveSetpoint = (int32_t)lroundf(controller.liveSetpoints[i] * 100.0f);
+    channel.phaseElapsed = now - controller.phaseStartMillis[i];
+  }
+  record.crc = recordCrc(&record, sizeof(record));
+  if (!storeWrite("checkpoint", &record, sizeof(record))) Serial.println("OTA: saving run state failed");
+}
+
+/**
+ * @brief Resumes the runs saved by saveCheckpoint() and discards the checkpoint.
+ * @details Called from setup() after the settings are loaded. The time spent
+ * rebooting does not count towards the hold duration.
+ */
+void restoreCheckpoint() {
+  CheckpointRecord record;
+  if (!storeRead("checkpoint", &record, sizeof(record), checkpointRecordValid)) return;
+  storeErase("checkpoint"); // A later power cycle must not resume stale runs
+  unsigned long now = millis();
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    const ChannelCheckpoint &channel = record.channels[i];
+    if (channel.phase == TRACE_PHASE_IDLE) continue;
+    controller.holdPhaseActive[i] = channel.phase == TRACE_PHASE_HOLD;
+    controller.coolingPhaseActive[i] = channel.phase == TRACE_PHASE_COOLING;
+    controller.liveSetpoints[i] = channel.liveSetpoint / 100.0f;
+    controller.phaseStartMillis[i] = now - channel.phaseElapsed;
+    trace(TRACE_PHASE, i, channel.phase);
+  }
+  Serial.println("Resumed run state from before the reboot");
+}
+
+void otaAbort() {
+#ifdef ESP32
+  Update.abort();
+#else
+  Update.end(); // Ends with an error when the image is incomplete, discarding it
+#endif
+}
+
+/**
+ * @brief Body callback of POST /ota: writes the image to flash as it arrives.
+ */
+void receiveFirmware(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+  if (index == 0) {
+    if (ota.owner != nullptr && millis() - ota.lastActivity < OTA_UPLOAD_TIMEOUT) return;
+    if (Update.isRunning()) otaAbort();
+    ota.owner = request;
+    ota.error = OTA_OK;
+    ota.written = 0;
+    ota.complete = false;
+    if (ota_password[0] == '\0') {
+      ota.error = OTA_DISABLED;
+      return;
+    }
+    ota.rejected = takeRequestSlots(ENDPOINT_OTA);
+    if (ota.rejected != REJECT_REASON_COUNT) {
+      ota.error = OTA_BUSY;
+      return;
+    }
+    releaseOnDisconnect(request, ENDPOINT_OTA);
+    if (!request->authenticate("admin", ota_password)) {
+      ota.error = OTA_UNAUTHORIZED;
+      return;
+    }
+    const AsyncWebHeader *md5 = request->getHeader("X-MD5");
+    if (md5 == nullptr || md5->value().length() != 32) {
+      ota.error = OTA_NO_MD5;
+      return;
+    }
+#ifndef ESP32
+    Update.runAsync(true); // Called from the network context; must not yield
+#endif
+    if (!Update.begin(total)) {
+      ota.error = OTA_TOO_LARGE;
+      return;
+    }
+    Update.setMD5(md5->value().c_str());
+  }
+  if (ota.owner != request || ota.error != OTA_OK) return;
+  ota.lastActivity = millis();
+
+  if (Update.write(data, len) != len) {
+    ota.error = OTA_WRITE_FAILED;
+    otaAbort();
+    return;
+  }
+  ota.written += len;
+  if (index + len == total) {
+    if (Update.end()) {
+      ota.complete = true;
+    } else {
+      ota.error = OTA_VERIFY_FAILED;
+    }
+  }
+}
+
+/**
+ * @brief Arms the reboot into the new image; loop() performs it (see otaService).
+ */
+void scheduleReboot(bool force) {
+  ota.rebootPending = true;
+  ota.rebootForced = ota.rebootForced || force;
+  ota.rebootAfter = millis() + OTA_REBOOT_DELAY;
+}
+
+/**
+ * @brief Reboots into a new image once allowed. Called from loop(), outside the heap guard.
+ */
+void otaService() {
+  if (ota.owner != nullptr && millis() - ota.lastActivity >= OTA_UPLOAD_TIMEOUT && !ota.complete) {
+    // The client went away mid-upload.
+    if (Update.isRunning()) otaAbort();
+    ota.owner = nullptr;
+  }
+  if (!ota.rebootPending || (int32_t)(millis() - ota.rebootAfter) < 0) return;
+  if (processRunning() && !ota.rebootForced) return;
+
+  outputAllOff();
+  saveSettingsIfDue(true);
+  savePresetsIfDue(true);
+  saveCheckpoint();
+  Serial.println("OTA: rebooting into the new firmware");
+  Serial.flush();
+  ESP.restart();
+}
+
+/**
+ * @brief Reboots after a watchdog trip (see "Watchdog"), resuming the runs
+ * afterwards like a firmware update does. Called from loop(), outside the heap guard.
+ */
+void watchdogService() {
+  if (!watchdog.tripped) return;
+  for (int i = 0; i < NUM_SENSORS; i++) controller.outputState[i] = false;
+  outputAllOff();
+  saveSettingsIfDue(true);
+  savePresetsIfDue(true);
+  saveCheckpoint();
+  Serial.printf("Watchdog: %s overran, rebooting\n", WATCHDOG_SECTION_NAMES[watchdogRecord->section]);
+  Serial.flush();
+  ESP.restart();
+}
+
+
+//==============================================================================
+// Function: generateTableRows
+//==============================================================================
+/**
+ * @brief  Renders the HTML table rows for the web interface.
+ * @param  out Writer receiving the rows.
+ */
+void generateTableRows(WindowWriter &out) {
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    if (!controller.channelEnabled(i)) continue;
+    out.printf("<tr data-ch='%d'>", i);
+    out.printf("<td>%s</td>", CHANNELS[i].name);
+    out.printf("<td id='temp%d'>-</td>", i); // Placeholder for live temperature
+    // Populate inputs with *user settings*, not live values
+    out.printf("<td><input type='number' step='0.1' name='threshold%d' value='%.2f'></td>", i, controller.setting_HoldTemps[i]);
+    out.printf("<td><input type='number' step='0.1' name='cooling%d' value='%.2f'></td>", i, controller.setting_CoolingSpeeds[i]);
+    out.printf("<td><input type='number' step='0.1' name='lower%d' value='%.2f'></td>", i, controller.setting_LowerLimits[i]);
+    out.printf("<td><input type='number' step='1' name='hold%d' value='%lu'></td>", i, (unsigned long)controller.setting_HoldDurations[i]);
+    out.printf("<td id='time%d'>-</td>", i);   // Placeholder for remaining time
+    out.printf("<td id='status%d'>-</td>", i); // Placeholder for current status
+    out.print("</tr>");
+  }
+}
+
+/**
+ * @brief Renders the main page: the PROGMEM template with the table rows injected.
+ */
+void renderIndexPage(WindowWriter &out) {
+  out.write_P(HTML_HEAD, sizeof(HTML_HEAD) - 1);
+  generateTableRows(out);
+  out.write_P(HTML_TAIL, sizeof(HTML_TAIL) - 1);
+}
+
+/**
+ * @brief Renders the live sensor state as a JSON array (one object per channel).
+ */
+void renderSensorData(WindowWriter &out) {
+  unsigned long now = millis();
+  bool first = true;
+  out.print("[");
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    if (!controller.channelEnabled(i)) continue;
+    char remainingStr[24] = "-";
+    const char *statusStr = "Idle";
+
+    if (controller.holdPhaseActive[i]) {
+      unsigned long holdDurationSecs = controller.setting_HoldDurations[i] * 60;
+      unsigned long elapsedSecs = (now - controller.phaseStartMillis[i]) / 1000;
+
+      if (elapsedSecs < holdDurationSecs) {
+        unsigned long remainingSecs = holdDurationSecs - elapsedSecs;
+        // Format time as M:SS for better readability
+        snprintf(remainingStr, sizeof(remainingStr), "%lu:%02lu", remainingSecs / 60, remainingSecs % 60);
+      }
+      statusStr = "Holding";
+
+    } else if (controller.coolingPhaseActive[i]) {
+      statusStr = "Cooling";
+    }
+
+    out.printf("%s{\"ch\":%d,\"temp\":%.2f,\"time_rem\":\"%s\",\"status\":\"%s\"}",
+               first ? "" : ",", i, controller.lastTemperatures[i], remainingStr, statusStr);
+    first = false;
+  }
+  out.print("]");
+}
+
+/**
+ * @brief Renders the "power" member shared by /status and /api/power.
+ */
+void renderPowerStatus(WindowWriter &out) {
+  uint64_t total = power.sleptMicros + power.awakeMicros;
+  out.printf("\"power\":{\"low_power\":%s,\"sleep_ratio\":%.3f,", power.enabled ? "true" : "false",
+             total ? (double)power.sleptMicros / total : 0.0);
+  out.printf("\"naps\":%u,\"early_wakes\":%u,", (unsigned)power.naps, (unsigned)power.earlyWakes);
+  out.printf("\"wake_lateness_p99_us\":%u,\"estimated_current_ma\":%.1f}",
+             (unsigned)profileHistograms[PROFILE_WAKE_LATENESS].percentile(990), powerEstimatedCurrent());
+}
+
+void renderPower(WindowWriter &out) {
+  out.print("{");
+  renderPowerStatus(out);
+  out.print("}");
+}
+
+/**
+ * @brief Renders the "watchdog" member of /status: the longest pass of every
+ * watched section and the trip that caused the last reset, if any.
+ */
+void renderWatchdogStatus(WindowWriter &out) {
+  out.print("\"watchdog\":{\"sections\":{");
+  for (int s = 0; s < WATCHDOG_SECTION_COUNT; s++) {
+    out.printf("%s\"%s\":{\"budget_ms\":%u,\"longest_ms\":%u}", s == 0 ? "" : ",",
+               WATCHDOG_SECTION_NAMES[s], (unsigned)watchdogSlots[s].budget, (unsigned)watchdogSlots[s].longest);
+  }
+  out.printf("},\"trips\":%u,\"last_reset\":", (unsigned)watchdog.boot.trips);
+  if (watchdog.resetByWatchdog) {
+    out.printf("{\"section\":\"%s\",\"overrun_ms\":%u,", WATCHDOG_SECTION_NAMES[watchdog.boot.section],
+               (unsigned)watchdog.boot.overrun);
+    out.printf("\"uptime_ms\":%u}}", (unsigned)watchdog.boot.uptime);
+  } else {
+    out.print("null}");
+  }
+}
+
+/**
+ * @brief Renders system diagnostics (uptime and heap) as a JSON object.
+ */
+void renderStatus(WindowWriter &out) {
+  out.printf("{\"uptime_ms\":%lu,", millis());
+  out.printf("\"free_heap\":%u,\"max_block\":%u,\"min_free_heap\":%u,",
+             (unsigned)heapStats.freeHeap, (unsigned)heapStats.maxBlock, (unsigned)heapStats.minFreeHeap);
+  out.printf("\"log_dropped\":%u,", (unsigned)logDropped);
+  out.printf("\"ota\":{\"uploading\":%s,\"written\":%u,\"reboot_pending\":%s},", ota.owner ? "true" : "false",
+             (unsigned)ota.written, ota.rebootPending ? "true" : "false");
+  out.printf("\"boot\":{\"first_control_tick_ms\":%.1f,", bootTiming.firstControlTickMicros / 1000.0);
+  out.printf("\"wifi_connected_ms\":%lu,\"http_ready_ms\":%lu},",
+             (unsigned long)bootTiming.wifiConnectedMillis, (unsigned long)bootTiming.httpReadyMillis);
+  out.printf("\"wifi\":{\"connected\":%s,\"rssi\":%d,\"channel\":%d,",
+             wifiLink.state == WIFI_CONNECTED ? "true" : "false", (int)WiFi.RSSI(), (int)WiFi.channel());
+  out.printf("\"connects\":%u,\"disconnects\":%u,\"fast_connect\":%s,",
+             (unsigned)wifiLink.connects, (unsigned)wifiLink.disconnects,
+             wifiLink.saved.header.magic == WIFI_MAGIC ? "true" : "false");
+  out.printf("\"ap_active\":%s},", wifiLink.apActive ? "true" : "false");
+  renderPowerStatus(out);
+  out.print(",");
+  renderWatchdogStatus(out);
+  out.print(",");
+  out.printf("\"channels\":{\"capacity\":%d,\"active\":%d},", NUM_SENSORS, controller.activeChannels());
+  out.printf("\"outputs\":{\"driver\":\"%s\",\"state\":%u,\"commits\":%u,\"errors\":%u},", OUTPUT_DRIVER_NAME,
+             (unsigned)outputs.applied, (unsigned)outputs.commits, (unsigned)outputs.errors);
+  out.printf("\"settings\":{\"loaded\":%s,\"pending\":%s,",
+             settingsStore.loaded ? "true" : "false", settingsStore.dirty ? "true" : "false");
+  out.printf("\"writes\":%u,\"write_errors\":%u,\"sequence\":%u},", (unsigned)settingsStore.writes,
+             (unsigned)settingsStore.writeErrors, (unsigned)settingsStore.saved.header.sequence);
+  out.printf("\"presets\":{\"pending\":%s,\"writes\":%u,\"write_errors\":%u,\"sequence\":%u},",
+             presetStore.dirty ? "true" : "false", (unsigned)presetStore.writes, (unsigned)presetStore.writeErrors,
+             (unsigned)presetRecord.header.sequence);
+  out.printf("\"http\":{\"in_flight\":%u,\"peak_in_flight\":%u,\"rejected\":{",
+             admission.inFlight.load(), admission.peakInFlight);
+  for (int r = 0; r < REJECT_REASON_COUNT; r++) {
+    out.printf("%s\"%s\":%u", r == 0 ? "" : ",", REJECT_REASON_NAMES[r], (unsigned)rejectedTotal((RejectReason)r));
+  }
+  out.print("},\"endpoints\":{");
+  for (int e = 0; e < HTTP_ENDPOINT_COUNT; e++) {
+    uint32_t rejected = 0;
+    for (int r = 0; r < REJECT_REASON_COUNT; r++) rejected += admission.rejected[e][r];
+    out.printf("%s\"%s\":{\"accepted\":%u,\"rejected\":%u}", e == 0 ? "" : ",",
+               HTTP_ENDPOINT_NAMES[e], (unsigned)admission.accepted[e], (unsigned)rejected);
+  }
+  out.print("}}}");
+}
+
+
+/**
+ * @brief Renders per-section latency statistics as a JSON object.
+ * @details Cycle-counted sections are converted to microseconds; percentiles
+ * are the upper bounds of their log2 buckets.
+ */
+void renderProfile(WindowWriter &out) {
+  float cyclesPerMicro = ESP.getCpuFreqMHz();
+  out.printf("{\"cpu_mhz\":%u,\"sections\":{", (unsigned)ESP.getCpuFreqMHz());
+  for (int s = 0; s < PROFILE_SECTION_COUNT; s++) {
+    const LatencyHistogram &h = profileHistograms[s];
+    float scale = PROFILE_SECTION_IN_CYCLES[s] ? 1.0f / cyclesPerMicro : 1.0f;
+    out.printf("%s\"%s\":{\"count\":%u,", s == 0 ? "" : ",", PROFILE_SECTION_NAMES[s], (unsigned)h.count);
+    out.printf("\"p50_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}",
+               h.percentile(500) * scale, h.percentile(990) * scale, h.max * scale);
+  }
+  out.print("}}");
+}
+
+
+//==============================================================================
+// Metrics
+//==============================================================================
+// /metrics exposes the controller in the Prometheus text format. A scrape
+// first copies everything it reports into one of a few snapshot slots and
+// then renders only from that copy, so every chunk of the response renders
+// the same document and the scrape never touches state the control loop is
+// writing for longer than the copy takes.
+
+const int METRICS_BUCKET_FIRST = 8;   // First histogram bucket exported (2^8)
+const int METRICS_BUCKET_STEP = 2;    // Exported buckets grow by 4x
+const int METRICS_BUCKETS = 12;       // Exported buckets per histogram (up to 2^30)
+const int METRICS_CHANNEL_FAMILIES = 5;
+// Rendered blocks: channel families, system metrics, HTTP admission, one histogram per section, section maxima
+const int METRICS_SECTIONS_FIRST_BLOCK = METRICS_CHANNEL_FAMILIES + 2;
+const int METRICS_BLOCKS = METRICS_SECTIONS_FIRST_BLOCK + PROFILE_SECTION_COUNT + 1;
+
+/**
+ * @brief Everything a single scrape reports, copied when the scrape starts.
+ */
+struct MetricsSnapshot {
+  std::atomic<bool> inUse;
+  uint32_t cpuMhz;
+  uint64_t uptimeMillis;
+  HeapStats heap;
+  uint32_t logDropped;
+  uint8_t httpInFlight;
+  uint32_t httpAccepted[HTTP_ENDPOINT_COUNT];
+  uint32_t httpRejected[HTTP_ENDPOINT_COUNT][REJECT_REASON_COUNT];
+  uint32_t channelsEnabled;
+  struct Channel {
+    float temperature;
+    float setpoint;
+    bool heaterOn;
+    uint8_t phase; // TracePhase
+    uint32_t sensorErrors;
+  } channels[NUM_SENSORS];
+  struct Section {
+    uint32_t cumulative[METRICS_BUCKETS]; // Samples at or below each exported bound
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;
+  } sections[PROFILE_SECTION_COUNT];
+  uint32_t blockOffsets[METRICS_BLOCKS]; // Document offset of each rendered block
+  uint8_t blocksKnown;                   // Entries of blockOffsets filled in so far
+};
+
+MetricsSnapshot metricsSnapshots[METRICS_SLOTS];
+
+/**
+ * @brief Returns milliseconds since boot without the 49-day millis() wrap.
+ * @note Must be called at least once per wrap period; loop() does.
+ */
+uint64_t uptimeMillis() {
+  static uint32_t last = 0;
+  static uint32_t wraps = 0;
+  uint32_t now = millis();
+  if (now < last) wraps++;
+  last = now;
+  return ((uint64_t)wraps << 32) | now;
+}
+
+/**
+ * @brief Claims a free snapshot slot.
+ * @return The slot index, or -1 if all slots are busy.
+ */
+int metricsAcquire() {
+  for (int slot = 0; slot < METRICS_SLOTS; slot++) {
+    bool expected = false;
+    if (metricsSnapshots[slot].inUse.compare_exchange_strong(expected, true)) return slot;
+  }
+  return -1;
+}
+
+/** @brief Returns a slot claimed with metricsAcquire(). */
+void metricsRelease(int slot) {
+  metricsSnapshots[slot].inUse.store(false);
+}
+
+/**
+ * @brief Copies the current controller state into a snapshot slot.
+ */
+void metricsCapture(MetricsSnapshot &snapshot) {
+  snapshot.blockOffsets[0] = 0;
+  snapshot.blocksKnown = 1;
+  snapshot.cpuMhz = ESP.getCpuFreqMHz();
+  snapshot.uptimeMillis = uptimeMillis();
+  sampleHeap(true);
+  snapshot.heap = heapStats;
+  snapshot.logDropped = logDropped;
+  snapshot.httpInFlight = admission.inFlight.load();
+  memcpy(snapshot.httpAccepted, admission.accepted, sizeof(snapshot.httpAccepted));
+  memcpy(snapshot.httpRejected, admission.rejected, sizeof(snapshot.httpRejected));
+
+  snapshot.channelsEnabled = controller.enabled;
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    MetricsSnapshot::Channel &channel = snapshot.channels[i];
+    channel.temperature = controller.lastTemperatures[i];
+    channel.setpoint = controller.liveSetpoints[i];
+    channel.heaterOn = controller.outputState[i];
+    channel.phase = controller.holdPhaseActive[i] ? TRACE_PHASE_HOLD : controller.coolingPhaseActive[i] ? TRACE_PHASE_COOLING : TRACE_PHASE_IDLE;
+    channel.sensorErrors = controller.sensorErrorCounts[i];
+  }
+
+  for (int s = 0; s < PROFILE_SECTION_COUNT; s++) {
+    const LatencyHistogram &h = profileHistograms[s];
+    MetricsSnapshot::Section &section = snapshot.sections[s];
+    uint32_t cumulative = 0;
+    int b = 0;
+    for (int k = 0; k < METRICS_BUCKETS; k++) {
+      // Exported bound k covers log2 buckets 0 .. METRICS_BUCKET_FIRST + k * METRICS_BUCKET_STEP.
+      for (; b <= METRICS_BUCKET_FIRST + k * METRICS_BUCKET_STEP; b++) cumulative += h.buckets[b];
+      section.cumulative[k] = cumulative;
+    }
+    section.count = h.count;
+    section.max = h.max;
+    section.sum = h.sum;
+  }
+}
+
+/** @brief Renders the HELP and TYPE lines of a metric family. */
+void renderMetricHeader(WindowWriter &out, const char *name, const char *type, const char *help) {
+  out.printf("# HELP %s %s\n", name, help);
+  out.printf("# TYPE %s %s\n", name, type);
+}
+
+/**
+ * @brief Renders one channel metric family.
+ * @param field 0 temperature, 1 setpoint, 2 heater, 3 phase, 4 sensor errors.
+ */
+void renderChannelFamily(WindowWriter &out, const MetricsSnapshot &m, int field) {
+  static const char *const names[] = {"gellan_temperature_celsius", "gellan_setpoint_celsius", "gellan_heater_on",
+                                      "gellan_phase", "gellan_sensor_errors_total"};
+  static const char *const types[] = {"gauge", "gauge", "gauge", "gauge", "counter"};
+  static const char *const helps[] = {"Last temperature read (-127 after a sensor error).",
+                                      "Live setpoint used by the control logic.",
+                                      "1 while the heater output is on.",
+                                      "Process phase: 0 Idle, 1 Holding, 2 Cooling.",
+                                      "Failed sensor reads."};
+  renderMetricHeader(out, names[field], types[field], helps[field]);
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    if (!(m.channelsEnabled & (1UL << i))) continue;
+    const MetricsSnapshot::Channel &c = m.channels[i];
+    out.printf("%s{channel=\"%d\",name=\"%s\"} ", names[field], i, CHANNELS[i].name);
+    switch (field) {
+      case 0: out.printf("%.2f\n", c.temperature); break;
+      case 1: out.printf("%.2f\n", c.setpoint); break;
+      case 2: out.printf("%d\n", c.heaterOn ? 1 : 0); break;
+      case 3: out.printf("%u\n", c.phase); break;
+      default: out.printf("%u\n", (unsigned)c.sensorErrors); break;
+    }
+  }
+}
+
+/** @brief Renders the system-wide gauges and counters. */
+void renderSystemMetrics(WindowWriter &out, const MetricsSnapshot &m) {
+  renderMetricHeader(out, "gellan_free_heap_bytes", "gauge", "Free heap.");
+  out.printf("gellan_free_heap_bytes %u\n", (unsigned)m.heap.freeHeap);
+  renderMetricHeader(out, "gellan_max_free_block_bytes", "gauge", "Largest contiguous free heap block.");
+  out.printf("gellan_max_free_block_bytes %u\n", (unsigned)m.heap.maxBlock);
+  renderMetricHeader(out, "gellan_min_free_heap_bytes", "gauge", "Lowest free heap since boot.");
+  out.printf("gellan_min_free_heap_bytes %u\n", (unsigned)m.heap.minFreeHeap);
+  renderMetricHeader(out, "gellan_log_dropped_total", "counter", "Log records overwritten before reaching Serial.");
+  out.printf("gellan_log_dropped_total %u\n", (unsigned)m.logDropped);
+  renderMetricHeader(out, "gellan_uptime_seconds", "counter", "Time since boot.");
+  out.printf("gellan_uptime_seconds %.3f\n", m.uptimeMillis / 1000.0);
+}
+
+/** @brief Renders the HTTP admission counters. */
+void renderHttpMetrics(WindowWriter &out, const MetricsSnapshot &m) {
+  renderMetricHeader(out, "gellan_http_in_flight", "gauge", "Requests being served.");
+  out.printf("gellan_http_in_flight %u\n", m.httpInFlight);
+  renderMetricHeader(out, "gellan_http_requests_total", "counter", "Requests admitted, by endpoint.");
+  for (int e = 0; e < HTTP_ENDPOINT_COUNT; e++) {
+    out.printf("gellan_http_requests_total{endpoint=\"%s\"} %u\n", HTTP_ENDPOINT_NAMES[e], (unsigned)m.httpAccepted[e]);
+  }
+  renderMetricHeader(out, "gellan_http_rejected_total", "counter", "Requests answered with 503, by endpoint and reason.");
+  for (int e = 0; e < HTTP_ENDPOINT_COUNT; e++) {
+    for (int r = 0; r < REJECT_REASON_COUNT; r++) {
+      out.printf("gellan_http_rejected_total{endpoint=\"%s\",reason=\"%s\"} %u\n",
+                 HTTP_ENDPOINT_NAMES[e], REJECT_REASON_NAMES[r], (unsigned)m.httpRejected[e][r]);
+    }
+  }
+}
+
+/** @brief Seconds per histogram unit of a profiled section. */
+double sectionSecondsPerUnit(const MetricsSnapshot &m, int s) {
+  return PROFILE_SECTION_IN_CYCLES[s] ? 1e-6 / m.cpuMhz : 1e-6;
+}
+
+/** @brief Renders the duration histogram of one profiled section. */
+void renderSectionHistogram(WindowWriter &out, const MetricsSnapshot &m, int s) {
+  if (s == 0) {
+    renderMetricHeader(out, "gellan_section_duration_seconds", "histogram",
+                       "Duration of loop sections and web handlers, and lateness of the periodic tasks.");
+  }
+  const MetricsSnapshot::Section &section = m.sections[s];
+  double secondsPerUnit = sectionSecondsPerUnit(m, s);
+  for (int k = 0; k < METRICS_BUCKETS; k++) {
+    double bound = (double)(1UL << (METRICS_BUCKET_FIRST + k * METRICS_BUCKET_STEP)) * secondsPerUnit;
+    out.printf("gellan_section_duration_seconds_bucket{section=\"%s\",le=\"%.6g\"} %u\n",
+               PROFILE_SECTION_NAMES[s], bound, (unsigned)section.cumulative[k]);
+  }
+  out.printf("gellan_section_duration_seconds_bucket{section=\"%s\",le=\"+Inf\"} %u\n",
+             PROFILE_SECTION_NAMES[s], (unsigned)section.count);
+  out.printf("gellan_section_duration_seconds_sum{section=\"%s\"} %.6f\n",
+             PROFILE_SECTION_NAMES[s], section.sum * secondsPerUnit);
+  out.printf("gellan_section_duration_seconds_count{section=\"%s\"} %u\n",
+             PROFILE_SECTION_NAMES[s], (unsigned)section.count);
+}
+
+/** @brief Renders the longest sample of every profiled section. */
+void renderSectionMax(WindowWriter &out, const MetricsSnapshot &m) {
+  renderMetricHeader(out, "gellan_section_duration_max_seconds", "gauge", "Longest sample of each section since boot.");
+  for (int s = 0; s < PROFILE_SECTION_COUNT; s++) {
+    out.printf("gellan_section_duration_max_seconds{section=\"%s\"} %.6f\n",
+               PROFILE_SECTION_NAMES[s], m.sections[s].max * sectionSecondsPerUnit(m, s));
+  }
+}
+
+/**
+ * @brief Renders a snapshot in the Prometheus text exposition format (0.0.4).
+ * @details The document is a fixed sequence of blocks. The first chunk
+ * records where each block starts, so later chunks resume from the last
+ * block before their window instead of re-rendering the whole scrape.
+ * @param slot Snapshot slot captured when the scrape arrived.
+ */
+void renderMetrics(WindowWriter &out, uint32_t slot) {
+  MetricsSnapshot &m = metricsSnapshots[slot];
+
+  int block = 0;
+  while (block + 1 < m.blocksKnown && m.blockOffsets[block + 1] <= out.windowStart()) block++;
+  out.skipTo(m.blockOffsets[block]);
+
+  for (; block < METRICS_BLOCKS && !out.full(); block++) {
+    if (block >= m.blocksKnown) {
+      m.blockOffsets[block] = out.position();
+      m.blocksKnown = block + 1;
+    }
+    if (block < METRICS_CHANNEL_FAMILIES) {
+      renderChannelFamily(out, m, block);
+    } else if (block == METRICS_CHANNEL_FAMILIES) {
+      renderSystemMetrics(out, m);
+    } else if (block == METRICS_CHANNEL_FAMILIES + 1) {
+      renderHttpMetrics(out, m);
+    } else if (block < METRICS_BLOCKS - 1) {
+      renderSectionHistogram(out, m, block - METRICS_SECTIONS_FIRST_BLOCK);
+    } else {
+      renderSectionMax(out, m);
+    }
+  }
+}
+
+
+//==============================================================================
+// Function: setup
+//==============================================================================
+/**
+ * @brief Main initialization function. Runs once on boot.
+ * @details Initializes Serial, Pins, Sensors, configures all web server
+ * endpoints and starts connecting to WiFi. Nothing here waits for the
+ * network, so control starts as soon as loop() runs.
+ */
+void setup() {
+  Serial.begin(115200);
+
+  // --- Hardware Initialization ---
+  outputBegin(); // All heaters off before anything else
+  if (!storeBegin()) Serial.println("Flash store unavailable, using defaults");
+  loadSettings();
+  loadPresets();
+  loadChannels();
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    controller.liveSetpoints[i] = controller.setting_HoldTemps[i]; // Initialize live setpoint from settings
+  }
+  restoreCheckpoint(); // Resume runs interrupted by a firmware update or watchdog reboot
+  sensors.begin(); // Initialize the DallasTemperature library
+  // Set to non-blocking mode
+  sensors.setWaitForConversion(false);
+  // Send the first temperature request
+  sensors.requestTemperatures();
+
+
+  //=======================================
+  // --- Web Server Endpoints ---
+  //=======================================
+
+  /**
+   * @brief Serves the main HTML page.
+   * The PROGMEM template is streamed in chunks with the dynamically
+   * generated table rows injected between its two halves.
+   */
+  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_INDEX)) return;
+    sendRendered(request, "text/html", renderIndexPage, PROFILE_HTTP_INDEX);
+  });
+
+  /**
+   * @brief Serves real-time sensor data as a JSON array.
+   * This endpoint is called by the JavaScript 'fetch' function every 2 seconds.
+   * It renders a JSON array where each object represents the current state of
+   * one enabled channel; "ch" is the channel number.
+   */
+  server.on("/data", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_DATA)) return;
+    sendRendered(request, "application/json", renderSensorData, PROFILE_HTTP_DATA);
+  });
+
+  /**
+   * @brief Serves system diagnostics (free heap, largest free block, uptime).
+   */
+  server.on("/status", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_STATUS)) return;
+    sampleHeap(true);
+    sendRendered(request, "application/json", renderStatus);
+  });
+
+  /**
+   * @brief Serves the event log held in RAM as plain text, oldest line first.
+   */
+  server.on("/log", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_LOG)) return;
+    sendRendered(request, "text/plain", renderLog, logHead.load(std::memory_order_acquire));
+  });
+
+  /**
+   * @brief Downloads the event trace as a binary dump.
+   * Convert it with tools/trace2perfetto.cpp for viewing in ui.perfetto.dev.
+   */
+  server.on("/trace", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_TRACE)) return;
+    sendRendered(request, "application/octet-stream", renderTrace, traceHead.load(std::memory_order_relaxed));
+  });
+
+  /**
+   * @brief Serves the run recording as a binary dump (see "Run Recording").
+   * Replay it on a PC with tools/replay.cpp.
+   */
+  server.on("/recording", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_RECORDING)) return;
+    sendRendered(request, "application/octet-stream", renderRecording, recordingHead.load(std::memory_order_acquire));
+  });
+
+  /**
+   * @brief Serves section timings and task lateness as JSON (see renderProfile).
+   */
+  server.on("/profile", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_PROFILE)) return;
+    sendRendered(request, "application/json", renderProfile);
+  });
+
+  /**
+   * @brief Serves Prometheus/OpenMetrics text (see renderMetrics).
+   * Each scrape renders from its own snapshot slot.
+   */
+  server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!reserveRequest(request, ENDPOINT_METRICS)) return;
+    int slot = metricsAcquire(); // Cannot fail: admission limits scrapes to METRICS_SLOTS
+    releaseOnDisconnect(request, ENDPOINT_METRICS, metricsRelease, slot);
+    metricsCapture(metricsSnapshots[slot]);
+    sendRendered(request, "text/plain; version=0.0.4", renderMetrics, slot, PROFILE_HTTP_METRICS);
+  });
+
+  /**
+   * @brief Handles POST requests from the form to update settings.
+   * The submitted fields are decoded in a single pass into a validated
+   * SettingsCommand; nothing changes unless every field is valid.
+   */
+  server.on("/update", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_UPDATE)) return;
+    ProfileScope profile(PROFILE_HTTP_UPDATE);
+    WatchdogScope watched(WATCHDOG_WEB);
+    trace(TRACE_WEB_COMMAND, TRACE_NO_CHANNEL, TRACE_CMD_UPDATE);
+
+    SettingsCommand command;
+    CommandError error = COMMAND_OK;
+    const char *field = nullptr;
+    {
+      HeapGuardScope guard;
+      clearCommand(command);
+      for (size_t p = 0; p < request->params() && error == COMMAND_OK; p++) {
+        const AsyncWebParameter *param = request->getParam(p);
+        if (!param->isPost()) continue;
+        field = param->name().c_str();
+        error = addFormField(command, field, param->value().c_str());
+      }
+      if (error == COMMAND_OK) {
+        field = nullptr;
+        error = submitCommand(command);
       }
+    }
 
-      // --- 2. HOLD PHASE LOGIC ---
-      // This logic checks if the hold timer has expired.
-      if (holdPhaseActive[i]) {
-        unsigned long holdDurationSecs = setting_HoldDurations[i] * 60;
-        unsigned long elapsedSecs = (currentMillis - phaseStartMillis[i]) / 1000;
-        
-        // Check if the elapsed time has exceeded the desired hold duration
-        if (elapsedSecs >= holdDurationSecs) {
-          
-          // --- State Transition: HOLD -> COOLING ---
-          holdPhaseActive[i] = false;
-          coolingPhaseActive[i] = true;
-          phaseStartMillis[i] = currentMillis; // Reset timer for cooling phase
-          Serial.println("Sensor " + String(i) + ": Hold phase finished. Cooling phase started.");
-        }
+    if (error != COMMAND_OK) {
+      sendCommandError(request, error, field);
+      return;
+    }
+    request->send(200, "text/plain", "OK"); // Send a simple 'OK' response
+  });
+
+  /**
+   * @brief Exports the settings of all channels as JSON (see renderConfig).
+   */
+  server.on("/api/config", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_CONFIG_GET)) return;
+    sendRendered(request, "application/json", renderConfig);
+  });
+
+  /**
+   * @brief Applies a JSON configuration document (see "Configuration API").
+   * The body has already been parsed by receiveConfigBody() when this runs,
+   * and the request admitted there.
+   */
+  server.on("/api/config", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (configUpload.owner != request) {
+      // No body at all, or another upload holds the buffer.
+      if (configUpload.owner == nullptr) {
+        sendConfigResult(request, COMMAND_EMPTY);
+      } else {
+        rejectRequest(request, ENDPOINT_CONFIG_POST, REJECT_ENDPOINT);
+      }
+      return;
+    }
+    configUpload.owner = nullptr;
+    if (configUpload.rejected != REJECT_REASON_COUNT) {
+      rejectRequest(request, ENDPOINT_CONFIG_POST, configUpload.rejected);
+      return;
+    }
+    trace(TRACE_WEB_COMMAND, TRACE_NO_CHANNEL, TRACE_CMD_CONFIG);
+
+    CommandError error = configUpload.complete ? configUpload.error : COMMAND_EMPTY;
+    if (error == COMMAND_OK) {
+      HeapGuardScope guard;
+      error = submitCommand(configUpload.command);
+    }
+    sendConfigResult(request, error);
+  }, nullptr, receiveConfigBody);
+
+  /**
+   * @brief Lists the built-in and user presets (see renderPresets).
+   */
+  server.on("/api/presets", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_PRESETS)) return;
+    sendRendered(request, "application/json", renderPresets);
+  });
+
+  /**
+   * @brief Applies a preset. Form fields: name, channels ("all" or e.g. "0,2,5"; default all).
+   */
+  server.on("/api/presets/apply", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_PRESETS)) return;
+    HeapGuardScope guard;
+    trace(TRACE_WEB_COMMAND, TRACE_NO_CHANNEL, TRACE_CMD_PRESET_APPLY);
+    const char *name = findPostParam(request, "name");
+    Preset preset;
+    int slot;
+    if (name == nullptr || !findPreset(name, preset, slot)) {
+      request->send(404, "text/plain", "Unknown preset");
+      return;
+    }
+    uint32_t channels = parseChannelList(findPostParam(request, "channels"));
+    if (channels == 0) {
+      sendCommandError(request, COMMAND_BAD_CHANNEL, "channels", ENDPOINT_PRESETS);
+      return;
+    }
+    SettingsCommand command;
+    presetCommand(preset, channels, command);
+    CommandError error = submitCommand(command);
+    if (error != COMMAND_OK) {
+      sendCommandError(request, error, nullptr, ENDPOINT_PRESETS);
+      return;
+    }
+    request->send(200, "text/plain", "OK");
+  });
+
+  /**
+   * @brief Saves the current settings of a channel as a user preset.
+   * Form fields: name (1-15 characters, replaces a user preset of the same name), channel.
+   */
+  server.on("/api/presets/save", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_PRESETS)) return;
+    HeapGuardScope guard;
+    trace(TRACE_WEB_COMMAND, TRACE_NO_CHANNEL, TRACE_CMD_PRESET_SAVE);
+    const char *name = findPostParam(request, "name");
+    const char *channelText = findPostParam(request, "channel");
+    Preset preset;
+    int slot;
+    if (!presetNameValid(name)) {
+      request->send(400, "text/plain", "Invalid preset name");
+      return;
+    }
+    uint32_t channels = channelText ? parseChannelList(channelText) : 0;
+    if (channels == 0 || (channels & (channels - 1)) != 0) {
+      sendCommandError(request, COMMAND_BAD_CHANNEL, "channel", ENDPOINT_PRESETS);
+      return;
+    }
+    bool exists = findPreset(name, preset, slot);
+    if (exists && slot < 0) {
+      request->send(409, "text/plain", "Built-in presets cannot be replaced");
+      return;
+    }
+    if (!exists && freePresetSlots() == 0) {
+      request->send(507, "text/plain", "No free preset slot");
+      return;
+    }
+    memset(&preset, 0, sizeof(preset));
+    strcpy(preset.name, name);
+    int channel = 0;
+    while (!(channels & (1UL << channel))) channel++;
+    for (int f = 0; f < SETTING_FIELD_COUNT; f++) preset.values[f] = currentField(channel, (SettingField)f);
+    if (!submitPresetEdit(PRESET_OP_SAVE, preset)) {
+      rejectRequest(request, ENDPOINT_PRESETS, REJECT_ENDPOINT);
+      return;
+    }
+    request->send(200, "text/plain", "OK");
+  });
+
+  /**
+   * @brief Deletes a user preset. Form field: name.
+   */
+  server.on("/api/presets/delete", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_PRESETS)) return;
+    HeapGuardScope guard;
+    trace(TRACE_WEB_COMMAND, TRACE_NO_CHANNEL, TRACE_CMD_PRESET_DELETE);
+    const char *name = findPostParam(request, "name");
+    Preset preset;
+    int slot;
+    if (name == nullptr || !findPreset(name, preset, slot)) {
+      request->send(404, "text/plain", "Unknown preset");
+      return;
+    }
+    if (slot < 0) {
+      request->send(409, "text/plain", "Built-in presets cannot be deleted");
+      return;
+    }
+    if (!submitPresetEdit(PRESET_OP_DELETE, preset)) {
+      rejectRequest(request, ENDPOINT_PRESETS, REJECT_ENDPOINT);
+      return;
+    }
+    request->send(200, "text/plain", "OK");
+  });
+
+  /**
+   * @brief Reports the WiFi state (see renderWifi).
+   */
+  server.on("/api/wifi", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_WIFI)) return;
+    sendRendered(request, "application/json", renderWifi);
+  });
+
+  /**
+   * @brief Stores new WiFi credentials and reconnects. Form fields: ssid, password.
+   */
+  server.on("/api/wifi", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_WIFI)) return;
+    HeapGuardScope guard;
+    trace(TRACE_WEB_COMMAND, TRACE_NO_CHANNEL, TRACE_CMD_WIFI);
+    const char *newSsid = findPostParam(request, "ssid");
+    const char *newPassword = findPostParam(request, "password");
+    if (newPassword == nullptr) newPassword = "";
+    size_t passwordLength = strlen(newPassword);
+    if (newSsid == nullptr || newSsid[0] == '\0' || strlen(newSsid) > 32) {
+      request->send(400, "text/plain", "SSID must be 1-32 characters");
+      return;
+    }
+    if (passwordLength > 63 || (passwordLength > 0 && passwordLength < 8)) {
+      request->send(400, "text/plain", "Password must be empty or 8-63 characters");
+      return;
+    }
+    if (!submitCredentials(newSsid, newPassword)) {
+      rejectRequest(request, ENDPOINT_WIFI, REJECT_ENDPOINT);
+      return;
+    }
+    request->send(200, "text/plain", "OK");
+  });
+
+  /**
+   * @brief Reports low-power mode (see renderPowerStatus).
+   */
+  server.on("/api/power", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_POWER)) return;
+    sendRendered(request, "application/json", renderPower);
+  });
+
+  /**
+   * @brief Switches low-power mode. Form field: enabled (0 or 1).
+   */
+  server.on("/api/power", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_POWER)) return;
+    HeapGuardScope guard;
+    trace(TRACE_WEB_COMMAND, TRACE_NO_CHANNEL, TRACE_CMD_POWER);
+    const char *enabled = findPostParam(request, "enabled");
+    if (enabled == nullptr || (strcmp(enabled, "0") != 0 && strcmp(enabled, "1") != 0)) {
+      request->send(400, "text/plain", "enabled must be 0 or 1");
+      return;
+    }
+    power.request.store(enabled[0] == '1' ? 1 : 0);
+    powerWake();
+    request->send(200, "text/plain", "OK");
+  });
+
+  /**
+   * @brief Lists every channel with its enable flag (see "Channel Selection").
+   */
+  server.on("/api/channels", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_CHANNELS)) return;
+    sendRendered(request, "application/json", renderChannels);
+  });
+
+  /**
+   * @brief Chooses the populated channels. Form field: enabled ("all" or channel numbers, e.g. "0,1,4").
+   */
+  server.on("/api/channels", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_CHANNELS)) return;
+    HeapGuardScope guard;
+    trace(TRACE_WEB_COMMAND, TRACE_NO_CHANNEL, TRACE_CMD_CHANNELS);
+    const char *list = findPostParam(request, "enabled");
+    uint32_t enabled = list != nullptr ? parseChannelList(list) : 0;
+    if (enabled == 0) {
+      request->send(400, "text/plain", "enabled must be all or a list of channel numbers");
+      return;
+    }
+    channelsRequest.store(enabled);
+    powerWake();
+    request->send(200, "text/plain", "OK");
+  });
+
+  /**
+   * @brief Installs a firmware image (see "Firmware Update").
+   * The body has already been written to flash by receiveFirmware() when this
+   * runs, and the request admitted there.
+   *   curl -H "X-MD5: $(md5sum fw.bin | cut -d' ' -f1)" --data-binary @fw.bin http://<ip>/ota
+   */
+  server.on("/ota", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (ota.owner != request) {
+      if (ota.owner == nullptr) {
+        request->send(400, "text/plain", "Empty request");
+      } else {
+        rejectRequest(request, ENDPOINT_OTA, REJECT_ENDPOINT);
       }
+      return;
+    }
+    ota.owner = nullptr;
+    if (ota.error == OTA_BUSY) {
+      rejectRequest(request, ENDPOINT_OTA, ota.rejected);
+      return;
+    }
+    trace(TRACE_WEB_COMMAND, TRACE_NO_CHANNEL, TRACE_CMD_OTA);
+    if (ota.error == OTA_DISABLED) {
+      request->send(403, "text/plain", OTA_ERROR_TEXT[OTA_DISABLED]);
+      return;
+    }
+    if (ota.error == OTA_UNAUTHORIZED) {
+      request->requestAuthentication();
+      return;
+    }
+    if (ota.error == OTA_OK && !ota.complete) ota.error = OTA_INCOMPLETE;
+    if (ota.error != OTA_OK) {
+      char message[80];
+      snprintf(message, sizeof(message), "%s (updater error %u)", OTA_ERROR_TEXT[ota.error], (unsigned)Update.getError());
+      request->send(ota.error == OTA_TOO_LARGE ? 413 : 400, "text/plain", message);
+      return;
+    }
+    bool force = request->hasParam("force") && request->getParam("force")->value() == "1";
+    scheduleReboot(force);
+    if (processRunning() && !force) {
+      request->send(202, "text/plain", "Update installed. Reboot deferred until all channels are idle (POST /ota/reboot?force=1 to reboot now).");
+    } else {
+      request->send(200, "text/plain", "Update installed. Rebooting.");
+    }
+  }, nullptr, receiveFirmware);
+
+  /**
+   * @brief Reboots into an installed update now. Query: force=1 to interrupt running processes.
+   */
+  server.on("/ota/reboot", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (!admitRequest(request, ENDPOINT_OTA)) return;
+    if (ota_password[0] == '\0') {
+      request->send(403, "text/plain", OTA_ERROR_TEXT[OTA_DISABLED]);
+      return;
+    }
+    if (!request->authenticate("admin", ota_password)) {
+      request->requestAuthentication();
+      return;
+    }
+    if (!ota.rebootPending) {
+      request->send(409, "text/plain", "No update installed");
+      return;
+    }
+    bool force = request->hasParam("force") && request->getParam("force")->value() == "1";
+    scheduleReboot(force);
+    request->send(200, "text/plain", processRunning() && !force ? "Reboot deferred until all channels are idle" : "Rebooting");
+  });
+
+  // Handle 404 Not Found errors. While the fallback access point is open,
+  // unknown URLs (such as the operating systems' captive-portal probes) are
+  // redirected to the web interface.
+  server.onNotFound([](AsyncWebServerRequest *request){
+    if (!admitRequest(request, ENDPOINT_OTHER)) return;
+    if (wifiLink.apActive) {
+      IPAddress ip = WiFi.softAPIP();
+      char url[32];
+      snprintf(url, sizeof(url), "http://%u.%u.%u.%u/", ip[0], ip[1], ip[2], ip[3]);
+      request->redirect(url);
+      return;
+    }
+    request->send(404, "text/plain", "Not found");
+  });
+
+  // --- WiFi Connection ---
+  // Connects in the background; wifiService() starts the web server once connected.
+  wifiBegin();
+  if (LOW_POWER_DEFAULT) power.request.store(1);
+  watchdogBegin();
+}
+
+
+//==============================================================================
+// Function: loop
+//==============================================================================
+/**
+ * @brief Main execution loop.
+ * @details This loop is non-blocking. It uses millis() to schedule two
+ * main tasks:
+ * 1. Reading sensor data (infrequent, every 2s).
+ * 2. Running the control logic state machine (frequent, every 500ms).
+ */
+void loop() {
+  powerSleep();
+  ProfileScope profile(PROFILE_LOOP);
+  unsigned long currentMillis = millis();
+  recording.now = currentMillis;
+  watchdogService();
+  wifiService();
+  otaService();
+  saveSettingsIfDue();
+  applyPresetEdit();
+  savePresetsIfDue();
+  applyChannelsRequest();
+  HeapGuardScope guard; // Nothing below may allocate once setup() has finished
+  static uint32_t lastSensorReadMicros = 0;
+  static uint32_t lastLogicUpdateMicros = 0;
+
+  sampleHeap(false);
+  uptimeMillis();
+  drainLog();
+  if (applyQueuedCommands()) markSettingsDirty();
+  if (recording.ticksToKeyframe == 0) recordKeyframe();
+
+  // --- Task 1: Read Sensors (Interval: 2000ms) ---
+  // This task reads the results from the *previous* request
+  // and issues a new non-blocking request for the *next* cycle.
+  if (currentMillis - tasks.lastSensorRead >= 2000) {
+    tasks.lastSensorRead = currentMillis;
+    profileLateness(PROFILE_SENSOR_LATENESS, lastSensorReadMicros, 2000000);
+    ProfileScope profile(PROFILE_ACQUISITION);
+    WatchdogScope watched(WATCHDOG_ACQUISITION);
+    
+    // Retrieve the temperature for each sensor by its address
+    for (int i = 0; i < NUM_SENSORS; i++) {
+      if (!controller.channelEnabled(i)) continue;
+      float temp = sensors.getTempC(CHANNELS[i].address);
+      record(RECORD_READING, i, recordReading(temp));
+      
+      // 85.0 is a power-on reset value, -127 is disconnected
+      if(temp != DEVICE_DISCONNECTED_C && temp != 85.0) {
+        controller.lastTemperatures[i] = temp;
+        trace(TRACE_TEMPERATURE, i, traceCentiDegrees(temp));
+      } else {
+        controller.lastTemperatures[i] = CHANNEL_NO_READING; // Use error value (-127)
+        controller.sensorErrorCounts[i]++;
+        LOG_EVENT(LOG_SENSOR_ERROR, i, temp);
+        trace(TRACE_SENSOR_ERROR, i, traceCentiDegrees(temp));
+      }
+    }
+
+    // Issue a non-blocking request for all sensors on the bus for the next read cycle
+    sensors.requestTemperatures(); 
+  }
+
+  // --- Task 2: Control Logic (Interval: 500ms) ---
+  // Run logic more frequently than sensor reads for better responsiveness.
+  if (currentMillis - tasks.lastLogicUpdate >= 500 || !tasks.controlStarted) {
+    unsigned long elapsedSinceUpdate = currentMillis - tasks.lastLogicUpdate;
+    tasks.lastLogicUpdate = currentMillis;
+    record(RECORD_TICK, RECORD_NO_CHANNEL, 0);
+    recording.ticksToKeyframe--;
+    profileLateness(PROFILE_LOGIC_LATENESS, lastLogicUpdateMicros, 500000);
+    ProfileScope profile(PROFILE_CONTROL);
+    WatchdogScope watched(WATCHDOG_CONTROL);
+    if (!tasks.controlStarted) bootTiming.firstControlTickMicros = micros() | 1;
+    tasks.controlStarted = true;
+    sampleHeap(true);
 
-      // --- 3. COOLING RAMP LOGIC ---
-      // This logic dynamically lowers the 'liveSetpoints' setpoint over time.
-      if (coolingPhaseActive[i]) {
-        
-        // Only ramp down if the current setpoint is still above the floor
-        if (liveSetpoints[i] > setting_LowerLimits[i]) {
-          
-          // Calculate how much the setpoint should decrease in this time slice
-          float degreesPerMilli = setting_CoolingSpeeds[i] / 60000.0;
-          float decreaseAmount = degreesPerMilli * elapsedSinceUpdate;
-          
-          // Apply the decrease to the "live" setpoint
-          liveSetpoints[i] -= decreaseAmount;
-
-          // Clamp the setpoint to the lower limit to prevent overshooting
-          if (liveSetpoints[i] < setting_LowerLimits[i]) {
-            liveSetpoints[i] = setting_LowerLimits[i];
+    // All channels advance in one batched step (see channel_engine.h). The
+    // heater writes, trace records and log lines for what changed follow in a
+    // second pass, expanded once per channel by forEachChannel().
+    if (controller.step(currentMillis, elapsedSinceUpdate, !watchdog.tripped, HYSTERESIS) != 0) {
+      struct EmitEvents {
+        inline __attribute__((always_inline)) void operator()(int i) const {
+          uint8_t events = controller.events[i];
+          if (events == 0) return;
+          float temp = controller.lastTemperatures[i];
+
+          // Heater ON: temp fell below the "live" setpoint.
+          if (events & CHANNEL_HEATER_ON) {
+            outputSet(i, true);
+            record(RECORD_OUTPUT, i, 1);
+            trace(TRACE_HEATER_ON, i, traceCentiDegrees(temp));
+            LOG_EVENT(LOG_OUTPUT_ON, i, temp);
+          }
+          // Heater OFF: temp rose above the setpoint + hysteresis.
+          if (events & CHANNEL_HEATER_OFF) {
+            outputSet(i, false);
+            record(RECORD_OUTPUT, i, 0);
+            trace(TRACE_HEATER_OFF, i, traceCentiDegrees(temp));
+            LOG_EVENT(LOG_OUTPUT_OFF, i, temp);
+          }
+          // IDLE -> HOLD: the temperature was reached for the first time.
+          if (events & CHANNEL_HOLD_STARTED) {
+            trace(TRACE_PHASE, i, TRACE_PHASE_HOLD);
+            record(RECORD_PHASE, i, TRACE_PHASE_HOLD);
+            LOG_EVENT(LOG_HOLD_STARTED, i, temp);
+          }
+          // HOLD -> COOLING: the hold timer expired.
+          if (events & CHANNEL_COOLING_STARTED) {
+            trace(TRACE_PHASE, i, TRACE_PHASE_COOLING);
+            record(RECORD_PHASE, i, TRACE_PHASE_COOLING);
+            LOG_EVENT(LOG_COOLING_STARTED, i, temp);
+          }
+          // COOLING -> IDLE: the ramp reached the lower limit; the live setpoint is back at the setting.
+          if (events & CHANNEL_COOLING_FINISHED) {
+            trace(TRACE_PHASE, i, TRACE_PHASE_IDLE);
+            record(RECORD_PHASE, i, TRACE_PHASE_IDLE);
+            LOG_EVENT(LOG_COOLING_FINISHED, i, controller.setting_LowerLimits[i]);
           }
-          
-        } else {
-          // --- State Transition: COOLING -> IDLE ---
-          // The cooling ramp is complete. Reset state.
-          coolingPhaseActive[i] = false;
-          liveSetpoints[i] = setting_HoldTemps[i]; // Reset live setpoint to user setting!
-          Serial.println("Sensor " + String(i) + ": Cooling finished. Reached lower limit. Resetting to IDLE.");
         }
-      }
+      } emit;
+      Controller<NUM_SENSORS>::forEachChannel(emit);
     }
+    outputCommit(); // All heater changes of this tick at once
   }
+
+  // --- Next deadline, for low-power mode ---
+  uint32_t nextSensorRead = tasks.lastSensorRead + 2000;
+  uint32_t nextLogicUpdate = tasks.lastLogicUpdate + 500;
+  power.nextDeadline = (int32_t)(nextSensorRead - nextLogicUpdate) < 0 ? nextSensorRead : nextLogicUpdate;
 }
@@ -0,0 +1,215 @@
+/**
+ * @brief Measures ChannelEngine::step() from 7 to 1,000,000 simulated channels.
+ *
+ * Build and run on the host:
+ *
+ *   g++ -std=c++11 -O3 -march=native -o channel_bench tools/channel_bench.cpp
+ *   ./channel_bench
+ *
+ * Every channel drives a simple heater model (the temperature rises while the
+ * heater is on and falls while it is off) through full Hold and Cooling
+ * cycles. For each channel count the program reports the time of one batched
+ * step() and of the equivalent per-channel state machine (the form the
+ * control loop had before the engine), per tick and per channel. The event
+ * pass that turns events[] into actions is timed separately.
+ *
+ * Before measuring, both forms run side by side for a few thousand ticks and
+ * must end in the same state; the program exits with 1 if they do not.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+
+#include "../channel_engine.h"
+
+//==============================================================================
+// Setup
+//==============================================================================
+const size_t MAX_CHANNELS = 1000000;
+const size_t CHANNEL_COUNTS[] = {7, 64, 1024, 16384, 262144, MAX_CHANNELS};
+const float HYSTERESIS = 0.5f;
+const uint32_t TICK_MS = 500;
+
+typedef ChannelEngine<MAX_CHANNELS> Engine;
+
+/** @brief Small deterministic generator, so every run simulates the same channels. */
+struct Random {
+  uint32_t state;
+  uint32_t next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+  float uniform(float low, float high) { return low + (high - low) * (next() >> 8) / 16777216.0f; }
+};
+
+/** @brief Gives every channel its own settings, staggered so the channels do not switch in step. */
+void seed(Engine &engine, size_t count) {
+  Random random = {12345};
+  for (size_t i = 0; i < count; i++) {
+    engine.setting_HoldTemps[i] = random.uniform(40, 80);
+    engine.setting_CoolingSpeeds[i] = random.uniform(0.5f, 30);
+    engine.setting_LowerLimits[i] = random.uniform(20, 37);
+    engine.setting_HoldDurations[i] = random.next() % 3;
+    engine.lastTemperatures[i] = random.uniform(15, 90);
+    engine.outputState[i] = false;
+    engine.holdPhaseActive[i] = false;
+    engine.coolingPhaseActive[i] = false;
+    engine.phaseStartMillis[i] = 0;
+    engine.liveSetpoints[i] = engine.setting_HoldTemps[i];
+    engine.laneEnabled[i] = (random.next() & 63) != 0; // About 1 in 64 channels is disabled
+    engine.events[i] = 0;
+  }
+}
+
+/** @brief Moves every temperature by one tick of the heater model. */
+void plant(Engine &engine, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    float t = engine.lastTemperatures[i];
+    engine.lastTemperatures[i] = t + (engine.outputState[i] ? 0.1f : -0.005f * (t - 15));
+  }
+}
+
+//==============================================================================
+// Reference: The Per-Channel State Machine
+//==============================================================================
+/** @brief One tick of one channel, written as the branching state machine. */
+void referenceStep(Engine &c, size_t i, uint32_t now, uint32_t elapsed) {
+  float temp = c.lastTemperatures[i];
+  if (!c.laneEnabled[i] || temp == CHANNEL_NO_READING) return;
+
+  if (temp < c.liveSetpoints[i] && !c.outputState[i]) {
+    c.outputState[i] = true;
+  } else if (temp > c.liveSetpoints[i] + HYSTERESIS && c.outputState[i]) {
+    c.outputState[i] = false;
+    if (!c.holdPhaseActive[i] && !c.coolingPhaseActive[i]) {
+      c.holdPhaseActive[i] = true;
+      c.phaseStartMillis[i] = now;
+    }
+  }
+
+  if (c.holdPhaseActive[i]) {
+    uint32_t holdDurationSecs = c.setting_HoldDurations[i] * 60;
+    uint32_t elapsedSecs = (now - c.phaseStartMillis[i]) / 1000;
+    if (elapsedSecs >= holdDurationSecs) {
+      c.holdPhaseActive[i] = false;
+      c.coolingPhaseActive[i] = true;
+      c.phaseStartMillis[i] = now;
+    }
+  }
+
+  if (c.coolingPhaseActive[i]) {
+    if (c.liveSetpoints[i] > c.setting_LowerLimits[i]) {
+      c.liveSetpoints[i] -= c.setting_CoolingSpeeds[i] * (elapsed / 60000.0f);
+      if (c.liveSetpoints[i] < c.setting_LowerLimits[i]) c.liveSetpoints[i] = c.setting_LowerLimits[i];
+    } else {
+      c.coolingPhaseActive[i] = false;
+      c.liveSetpoints[i] = c.setting_HoldTemps[i];
+    }
+  }
+}
+
+/** @brief Runs both forms for ticks ticks and compares their state. */
+bool selfCheck(size_t count, int ticks) {
+  std::unique_ptr<Engine> batched(new Engine());
+  std::unique_ptr<Engine> reference(new Engine());
+  seed(*batched, count);
+  seed(*reference, count);
+  for (int tick = 1; tick <= ticks; tick++) {
+    uint32_t now = tick * TICK_MS;
+    batched->step(now, TICK_MS, true, HYSTERESIS, count);
+    for (size_t i = 0; i < count; i++) referenceStep(*reference, i, now, TICK_MS);
+    plant(*batched, count);
+    plant(*reference, count);
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (batched->outputState[i] != reference->outputState[i] ||
+        batched->holdPhaseActive[i] != reference->holdPhaseActive[i] ||
+        batched->coolingPhaseActive[i] != reference->coolingPhaseActive[i] ||
+        batched->phaseStartMillis[i] != reference->phaseStartMillis[i] ||
+        batched->liveSetpoints[i] != reference->liveSetpoints[i]) {
+      fprintf(stderr, "self-check: channel %zu differs after %d ticks\n", i, ticks);
+      return false;
+    }
+  }
+  return true;
+}
+
+//==============================================================================
+// Measurement
+//==============================================================================
+typedef std::chrono::steady_clock Clock;
+
+double nanosSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+struct Result {
+  double batchedNs;   // Per tick
+  double referenceNs; // Per tick
+  double eventsNs;    // Per tick
+  double eventsPerTick;
+};
+
+/** @brief Times ticks ticks of count channels; the heater model runs between them, untimed. */
+Result measure(Engine &engine, size_t count, int ticks) {
+  Result result = {0, 0, 0, 0};
+  uint64_t events = 0;
+  uint32_t now = 0;
+
+  seed(engine, count);
+  for (int tick = 0; tick < ticks; tick++) {
+    now += TICK_MS;
+    Clock::time_point start = Clock::now();
+    uint8_t any = engine.step(now, TICK_MS, true, HYSTERESIS, count);
+    result.batchedNs += nanosSince(start);
+
+    // The event pass: count what the firmware would log and trace.
+    start = Clock::now();
+    if (any != 0) {
+      for (size_t i = 0; i < count; i++) {
+        uint8_t e = engine.events[i];
+        if (e == 0) continue;
+        events += __builtin_popcount(e);
+      }
+    }
+    result.eventsNs += nanosSince(start);
+    plant(engine, count);
+  }
+
+  seed(engine, count);
+  now = 0;
+  for (int tick = 0; tick < ticks; tick++) {
+    now += TICK_MS;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < count; i++) referenceStep(engine, i, now, TICK_MS);
+    result.referenceNs += nanosSince(start);
+    plant(engine, count);
+  }
+
+  result.batchedNs /= ticks;
+  result.referenceNs /= ticks;
+  result.eventsNs /= ticks;
+  result.eventsPerTick = (double)events / ticks;
+  return result;
+}
+
+int main() {
+  if (!selfCheck(10000, 4000)) return 1;
+
+  std::unique_ptr<Engine> engine(new Engine());
+  printf("%10s %14s %12s %10s %12s %9s %12s %14s\n", "channels", "step ns/tick", "step ns/ch", "Mch/s",
+         "ref ns/ch", "speedup", "events/tick", "event ns/tick");
+  for (size_t count : CHANNEL_COUNTS) {
+    // At least 200 ticks, and about 50 million channel steps per form.
+    int ticks = (int)(50000000 / count);
+    if (ticks < 200) ticks = 200;
+    Result r = measure(*engine, count, ticks);
+    printf("%10zu %14.1f %12.3f %10.1f %12.3f %8.1fx %12.1f %14.1f\n", count, r.batchedNs, r.batchedNs / count,
+           count / r.batchedNs * 1000.0, r.referenceNs / count, r.referenceNs / r.batchedNs, r.eventsPerTick, r.eventsNs);
+  }
+  return 0;
+}
@@ -0,0 +1,167 @@
+/**
+ * @brief Host stand-ins for the Arduino core, for running main.cpp on a PC.
+ *
+ * The headers in tools/host replace the ESP8266 core and the libraries
+ * main.cpp uses, so the firmware compiles for Linux unchanged:
+ *
+ *   g++ -std=gnu++11 -DHOST_BUILD -Itools/host <tool>.cpp tools/host/host.cpp
+ *
+ * where <tool>.cpp includes main.cpp and provides main(). Time is virtual:
+ * millis() and micros() return hostMicros, which only the tool (and delay())
+ * advances. Only what main.cpp uses is provided; network, flash updates and
+ * hardware timers do nothing. The "Host controls" below are the extra hooks a
+ * tool uses to drive the firmware.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <cmath>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+
+//==============================================================================
+// Host Controls
+//==============================================================================
+extern uint64_t hostMicros;  // Virtual clock read by millis() and micros()
+extern FILE *hostSerial;     // Where Serial output goes; nullptr discards it (default stdout)
+extern const char *hostFsRoot; // Directory holding the LittleFS files (default ".")
+extern uint8_t hostPinLevels[64]; // Last digitalWrite() level of every pin
+
+/** @brief Temperature getTempC() reports when no virtual sensors are on the bus (OneWire.h); 25 °C when unset. */
+extern float (*hostReadTemperature)(const uint8_t *address);
+
+//==============================================================================
+// Core API
+//==============================================================================
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x00
+#define OUTPUT 0x01
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define FPSTR(p) (p)
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_float(p) (*(const float *)(p))
+#define pgm_read_ptr(p) (*(void *const *)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+
+/** @brief std::string with the parts of the Arduino String interface main.cpp uses. */
+class String {
+ public:
+  String() {}
+  String(const char *text) : text(text != nullptr ? text : "") {}
+  String(const std::string &text) : text(text) {}
+  String(int value) : text(std::to_string(value)) {}
+  String(unsigned int value) : text(std::to_string(value)) {}
+  String(long value) : text(std::to_string(value)) {}
+  String(unsigned long value) : text(std::to_string(value)) {}
+
+  const char *c_str() const { return text.c_str(); }
+  size_t length() const { return text.size(); }
+  long toInt() const { return atol(text.c_str()); }
+  float toFloat() const { return (float)atof(text.c_str()); }
+  bool equals(const char *other) const { return text == other; }
+  bool operator==(const char *other) const { return text == other; }
+  bool operator==(const String &other) const { return text == other.text; }
+  char operator[](size_t i) const { return text[i]; }
+  String &operator+=(const String &other) { text += other.text; return *this; }
+  friend String operator+(const String &a, const String &b) { return String(a.text + b.text); }
+
+ private:
+  std::string text;
+};
+
+class IPAddress {
+ public:
+  IPAddress() : octets{0, 0, 0, 0} {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets{a, b, c, d} {}
+  uint8_t operator[](int i) const { return octets[i]; }
+  String toString() const {
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+    return String(text);
+  }
+
+ private:
+  uint8_t octets[4];
+};
+
+/** @brief Formatted output; the host version writes to a FILE. */
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(const uint8_t *data, size_t len) = 0;
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t print(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+  size_t print(const String &text) { return print(text.c_str()); }
+  size_t print(const __FlashStringHelper *text) { return print((const char *)text); }
+  size_t print(int value) { return printf("%d", value); }
+  size_t print(unsigned int value) { return printf("%u", value); }
+  size_t print(long value) { return printf("%ld", value); }
+  size_t print(unsigned long value) { return printf("%lu", value); }
+  size_t print(double value, int digits = 2) { return printf("%.*f", digits, value); }
+  size_t print(const IPAddress &ip) { return print(ip.toString()); }
+  size_t println() { return print("\r\n"); }
+  template <typename T> size_t println(const T &value) { return print(value) + println(); }
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class HardwareSerial : public Print {
+ public:
+  void begin(unsigned long) {}
+  void flush() {}
+  int availableForWrite() { return 128; }
+  size_t write(const uint8_t *data, size_t len) override;
+  using Print::write;
+};
+extern HardwareSerial Serial;
+
+/** @brief The ESP object: fixed heap figures, and a cycle counter derived from the virtual clock. */
+class EspClass {
+ public:
+  uint32_t getFreeHeap() { return 40000; }
+  uint32_t getMaxFreeBlockSize() { return 30000; }
+  uint8_t getHeapFragmentation() { return 5; }
+  uint32_t getCycleCount() { return (uint32_t)(hostMicros * 80); }
+  uint8_t getCpuFreqMHz() { return 80; }
+  uint32_t getChipId() { return 0x123456; }
+  uint32_t getFreeSketchSpace() { return 1 << 20; }
+  String getResetReason() { return String("Power On"); }
+  void restart();
+  void reset() { restart(); }
+};
+extern EspClass ESP;
+
+#endif
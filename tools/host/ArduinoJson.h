@@ -0,0 +1,288 @@
+/**
+ * @brief Host stand-in for the part of ArduinoJson 7 that parseConfig() uses.
+ *
+ * deserializeJson() builds a tree of Nodes in memory taken from the
+ * document's Allocator, like the library does, so the firmware's fixed arena
+ * and its NoMemory handling are exercised. Only read access is provided.
+ * Strings are copied as-is (no escape sequences).
+ */
+
+#ifndef HOST_ARDUINOJSON_H
+#define HOST_ARDUINOJSON_H
+
+#include <Arduino.h>
+#include <new>
+
+namespace ArduinoJson {
+
+class Allocator {
+ public:
+  virtual void *allocate(size_t size) = 0;
+  virtual void deallocate(void *pointer) = 0;
+  virtual void *reallocate(void *pointer, size_t newSize) = 0;
+
+ protected:
+  ~Allocator() {}
+};
+
+/** @brief A parsed value; children of arrays and objects form a linked list. */
+struct Node {
+  enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+  Type type = NUL;
+  bool boolean = false;
+  double number = 0;
+  const char *string = nullptr;
+  const char *key = nullptr; // Member name inside an object
+  Node *child = nullptr;
+  Node *next = nullptr;
+};
+
+class JsonString {
+ public:
+  explicit JsonString(const char *text) : text(text) {}
+  const char *c_str() const { return text; }
+
+ private:
+  const char *text;
+};
+
+class JsonObjectConst;
+class JsonArrayConst;
+
+class JsonVariantConst {
+ public:
+  JsonVariantConst(const Node *node = nullptr) : node(node) {}
+  bool isNull() const { return node == nullptr || node->type == Node::NUL; }
+  template <typename T> bool is() const;
+  template <typename T> T as() const;
+  JsonVariantConst operator[](const char *key) const {
+    if (node == nullptr || node->type != Node::OBJECT) return JsonVariantConst();
+    for (const Node *member = node->child; member != nullptr; member = member->next) {
+      if (strcmp(member->key, key) == 0) return JsonVariantConst(member);
+    }
+    return JsonVariantConst();
+  }
+
+  const Node *node;
+};
+
+template <> inline bool JsonVariantConst::is<int>() const {
+  return node != nullptr && node->type == Node::NUMBER && node->number == (int)node->number;
+}
+template <> inline bool JsonVariantConst::is<float>() const { return node != nullptr && node->type == Node::NUMBER; }
+template <> inline int JsonVariantConst::as<int>() const { return is<float>() ? (int)node->number : 0; }
+template <> inline double JsonVariantConst::as<double>() const { return is<float>() ? node->number : 0; }
+
+class JsonPairConst {
+ public:
+  explicit JsonPairConst(const Node *node) : node(node) {}
+  JsonString key() const { return JsonString(node->key); }
+  JsonVariantConst value() const { return JsonVariantConst(node); }
+
+ private:
+  const Node *node;
+};
+
+/** @brief Iterates the children of an array or object as T. */
+template <typename T>
+class NodeIterator {
+ public:
+  explicit NodeIterator(const Node *node) : node(node) {}
+  T operator*() const { return T(node); }
+  NodeIterator &operator++() {
+    node = node->next;
+    return *this;
+  }
+  bool operator!=(const NodeIterator &other) const { return node != other.node; }
+
+ private:
+  const Node *node;
+};
+
+class JsonArrayConst {
+ public:
+  JsonArrayConst(const Node *node = nullptr) : node(node != nullptr && node->type == Node::ARRAY ? node : nullptr) {}
+  bool isNull() const { return node == nullptr; }
+  NodeIterator<JsonVariantConst> begin() const { return NodeIterator<JsonVariantConst>(node ? node->child : nullptr); }
+  NodeIterator<JsonVariantConst> end() const { return NodeIterator<JsonVariantConst>(nullptr); }
+
+ private:
+  const Node *node;
+};
+
+class JsonObjectConst {
+ public:
+  JsonObjectConst(const Node *node = nullptr) : node(node != nullptr && node->type == Node::OBJECT ? node : nullptr) {}
+  bool isNull() const { return node == nullptr; }
+  JsonVariantConst operator[](const char *key) const { return JsonVariantConst(node)[key]; }
+  NodeIterator<JsonPairConst> begin() const { return NodeIterator<JsonPairConst>(node ? node->child : nullptr); }
+  NodeIterator<JsonPairConst> end() const { return NodeIterator<JsonPairConst>(nullptr); }
+
+ private:
+  const Node *node;
+};
+
+template <> inline JsonObjectConst JsonVariantConst::as<JsonObjectConst>() const { return JsonObjectConst(node); }
+template <> inline JsonArrayConst JsonVariantConst::as<JsonArrayConst>() const { return JsonArrayConst(node); }
+
+class JsonDocument {
+ public:
+  explicit JsonDocument(Allocator *allocator) : allocator(allocator), root(nullptr) {}
+  template <typename T> T as() const { return JsonVariantConst(root).as<T>(); }
+
+  Allocator *allocator;
+  Node *root;
+};
+
+class DeserializationError {
+ public:
+  enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+  DeserializationError(Code code = Ok) : errorCode(code) {}
+  explicit operator bool() const { return errorCode != Ok; }
+  Code code() const { return errorCode; }
+
+ private:
+  Code errorCode;
+};
+
+namespace DeserializationOption {
+struct NestingLimit {
+  explicit NestingLimit(int depth) : depth(depth) {}
+  int depth;
+};
+}
+
+/** @brief Recursive-descent parser writing Nodes into a JsonDocument. */
+class Parser {
+ public:
+  Parser(JsonDocument &doc, const char *input, size_t len)
+    : error(DeserializationError::Ok), doc(doc), p(input), end(input + len) {}
+
+  Node *value(int depth) {
+    skipSpace();
+    if (p == end) return fail(DeserializationError::IncompleteInput);
+    if (depth < 0) return fail(DeserializationError::TooDeep);
+    Node *node = newNode();
+    if (node == nullptr) return nullptr;
+    if (*p == '{' || *p == '[') return container(node, depth);
+    if (*p == '"') {
+      node->type = Node::STRING;
+      node->string = string();
+      return node->string != nullptr ? node : nullptr;
+    }
+    if (literal("true")) {
+      node->type = Node::BOOLEAN;
+      node->boolean = true;
+    } else if (literal("false")) {
+      node->type = Node::BOOLEAN;
+    } else if (!literal("null")) {
+      char *numberEnd;
+      node->number = strtod(p, &numberEnd);
+      if (numberEnd == p || numberEnd > end) return fail(DeserializationError::InvalidInput);
+      node->type = Node::NUMBER;
+      p = numberEnd;
+    }
+    return node;
+  }
+
+  DeserializationError::Code error;
+
+ private:
+  Node *container(Node *node, int depth) {
+    bool object = *p++ == '{';
+    char close = object ? '}' : ']';
+    node->type = object ? Node::OBJECT : Node::ARRAY;
+    Node **tail = &node->child;
+    skipSpace();
+    if (p != end && *p == close) {
+      p++;
+      return node;
+    }
+    for (;;) {
+      const char *key = nullptr;
+      if (object) {
+        skipSpace();
+        key = string();
+        if (key == nullptr) return nullptr;
+        skipSpace();
+        if (p == end || *p++ != ':') return fail(DeserializationError::InvalidInput);
+      }
+      Node *child = value(depth - 1);
+      if (child == nullptr) return nullptr;
+      child->key = key;
+      *tail = child;
+      tail = &child->next;
+      skipSpace();
+      if (p == end) return fail(DeserializationError::IncompleteInput);
+      if (*p == ',') {
+        p++;
+      } else if (*p++ == close) {
+        return node;
+      } else {
+        return fail(DeserializationError::InvalidInput);
+      }
+    }
+  }
+
+  const char *string() {
+    if (p == end || *p != '"') {
+      fail(DeserializationError::InvalidInput);
+      return nullptr;
+    }
+    const char *start = ++p;
+    while (p != end && *p != '"') p++;
+    if (p == end) {
+      fail(DeserializationError::IncompleteInput);
+      return nullptr;
+    }
+    size_t len = p++ - start;
+    char *copy = (char *)doc.allocator->allocate(len + 1);
+    if (copy == nullptr) {
+      fail(DeserializationError::NoMemory);
+      return nullptr;
+    }
+    memcpy(copy, start, len);
+    copy[len] = '\0';
+    return copy;
+  }
+
+  Node *newNode() {
+    void *memory = doc.allocator->allocate(sizeof(Node));
+    if (memory == nullptr) return fail(DeserializationError::NoMemory);
+    return new (memory) Node();
+  }
+
+  bool literal(const char *word) {
+    size_t len = strlen(word);
+    if ((size_t)(end - p) < len || strncmp(p, word, len) != 0) return false;
+    p += len;
+    return true;
+  }
+
+  void skipSpace() {
+    while (p != end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+  }
+
+  Node *fail(DeserializationError::Code code) {
+    if (error == DeserializationError::Ok) error = code;
+    return nullptr;
+  }
+
+  JsonDocument &doc;
+  const char *p;
+  const char *end;
+};
+
+inline DeserializationError deserializeJson(JsonDocument &doc, const char *input, size_t len,
+                                            DeserializationOption::NestingLimit limit) {
+  if (len == 0) return DeserializationError::EmptyInput;
+  Parser parser(doc, input, len);
+  doc.root = parser.value(limit.depth);
+  return parser.error;
+}
+
+} // namespace ArduinoJson
+
+using namespace ArduinoJson;
+
+#endif
@@ -0,0 +1,17 @@
+/**
+ * @brief Host stand-in for the captive-portal DNS server: answers nothing.
+ */
+
+#ifndef HOST_DNSSERVER_H
+#define HOST_DNSSERVER_H
+
+#include <Arduino.h>
+
+class DNSServer {
+ public:
+  bool start(uint16_t, const char *, const IPAddress &) { return true; }
+  void stop() {}
+  void processNextRequest() {}
+};
+
+#endif
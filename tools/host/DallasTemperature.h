@@ -0,0 +1,119 @@
+/**
+ * @brief Host DallasTemperature: the library's sensor code, over the host OneWire bus.
+ *
+ * With virtual sensors on the bus (see OneWire.h) the calls run the same
+ * transactions as the library: begin() searches the bus, requestTemperatures()
+ * starts a conversion on all sensors with Skip ROM, and getTempC() reads one
+ * sensor's scratchpad and rejects it on a failed CRC. A reading of 85 °C is
+ * passed on, as by the library. With no sensors on the bus, readings come
+ * from hostReadTemperature.
+ */
+
+#ifndef HOST_DALLASTEMPERATURE_H
+#define HOST_DALLASTEMPERATURE_H
+
+#include <OneWire.h>
+
+#define DEVICE_DISCONNECTED_C -127
+
+typedef uint8_t DeviceAddress[8];
+typedef uint8_t ScratchPad[9];
+
+class DallasTemperature {
+ public:
+  explicit DallasTemperature(OneWire *wire) : wire(wire) {}
+
+  /** @brief Counts the DS18B20s on the bus and whether any is parasite powered. */
+  void begin() {
+    devices = 0;
+    parasite = false;
+    if (!emulated()) return;
+    DeviceAddress address;
+    wire->reset_search();
+    while (wire->search(address)) {
+      if (OneWire::crc8(address, 7) == address[7] && address[0] == 0x28) devices++;
+    }
+    parasite = !readPowerSupply();
+  }
+
+  uint8_t getDeviceCount() const { return devices; }
+  void setWaitForConversion(bool wait) { waitForConversion = wait; }
+  bool getWaitForConversion() const { return waitForConversion; }
+
+  /** @brief Starts a conversion on every sensor; waits for it unless setWaitForConversion(false). */
+  void requestTemperatures() {
+    if (!emulated()) return;
+    wire->reset();
+    wire->skip();
+    wire->write(0x44, parasite);
+    if (!waitForConversion) return;
+    for (uint64_t deadline = hostMicros + 750000; !isConversionComplete() && hostMicros < deadline;) yield();
+  }
+
+  /** @brief True once a running conversion has finished (the sensors release the line). */
+  bool isConversionComplete() { return wire->read_bit() == 1; }
+
+  float getTempC(const uint8_t *address) {
+    if (!emulated()) return hostReadTemperature != nullptr ? hostReadTemperature(address) : 25.0f;
+    ScratchPad scratchPad;
+    if (!isConnected(address, scratchPad)) return DEVICE_DISCONNECTED_C;
+    int16_t raw = (int16_t)(((uint16_t)scratchPad[1] << 8) | scratchPad[0]);
+    return raw * 0.0625f;
+  }
+
+  /** @brief Reads the scratchpad; false if the sensor did not answer or its CRC is wrong. */
+  bool isConnected(const uint8_t *address, uint8_t *scratchPad) {
+    if (!readScratchPad(address, scratchPad)) return false;
+    bool allZeros = true;
+    for (int i = 0; i < 9; i++) allZeros = allZeros && scratchPad[i] == 0;
+    return !allZeros && OneWire::crc8(scratchPad, 8) == scratchPad[8];
+  }
+
+  bool readScratchPad(const uint8_t *address, uint8_t *scratchPad) {
+    if (wire->reset() == 0) return false;
+    wire->select(address);
+    wire->write(0xBE);
+    wire->read_bytes(scratchPad, 9);
+    return wire->reset() == 1;
+  }
+
+  /** @brief Resolution from the configuration register; 0 if the sensor does not answer. */
+  uint8_t getResolution(const uint8_t *address) {
+    ScratchPad scratchPad;
+    return isConnected(address, scratchPad) ? (uint8_t)(9 + ((scratchPad[4] >> 5) & 3)) : 0;
+  }
+
+  /** @brief Writes the configuration register; the alarm bytes are kept. */
+  bool setResolution(const uint8_t *address, uint8_t bits) {
+    ScratchPad scratchPad;
+    if (!isConnected(address, scratchPad)) return false;
+    bits = bits < 9 ? 9 : bits > 12 ? 12 : bits;
+    wire->reset();
+    wire->select(address);
+    wire->write(0x4E);
+    wire->write(scratchPad[2]);
+    wire->write(scratchPad[3]);
+    wire->write((uint8_t)(((bits - 9) << 5) | 0x1F));
+    return wire->reset() == 1;
+  }
+
+ private:
+  bool emulated() { return wire->bus().deviceCount() > 0; }
+
+  /** @brief True if every sensor is powered externally (none holds the line low). */
+  bool readPowerSupply() {
+    if (wire->reset() == 0) return true;
+    wire->skip();
+    wire->write(0xB4);
+    bool external = wire->read_bit() == 1;
+    wire->reset();
+    return external;
+  }
+
+  OneWire *wire;
+  uint8_t devices = 0;
+  bool parasite = false;
+  bool waitForConversion = true;
+};
+
+#endif
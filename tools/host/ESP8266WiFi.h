@@ -0,0 +1,50 @@
+/**
+ * @brief Host stand-in for the ESP8266 WiFi library: the station connects at once.
+ */
+
+#ifndef HOST_ESP8266WIFI_H
+#define HOST_ESP8266WIFI_H
+
+#include <Arduino.h>
+
+enum WiFiMode_t { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 };
+enum WiFiSleepType_t { WIFI_NONE_SLEEP = 0, WIFI_LIGHT_SLEEP = 1, WIFI_MODEM_SLEEP = 2 };
+enum wl_status_t {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6
+};
+
+class WiFiClass {
+ public:
+  bool mode(WiFiMode_t) { return true; }
+  bool persistent(bool) { return true; }
+  bool setAutoReconnect(bool) { return true; }
+  bool setSleepMode(WiFiSleepType_t, uint8_t = 0) { return true; }
+  wl_status_t begin(const char *, const char * = nullptr, int32_t = 0, const uint8_t * = nullptr, bool = true) {
+    return WL_CONNECTED;
+  }
+  bool disconnect(bool = false) { return true; }
+  wl_status_t status() { return WL_CONNECTED; }
+  IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+  int32_t RSSI() { return -50; }
+  int32_t channel() { return 6; }
+  const uint8_t *BSSID() {
+    static const uint8_t bssid[6] = {0x02, 0, 0, 0, 0, 1};
+    return bssid;
+  }
+  uint8_t *macAddress(uint8_t *mac) {
+    static const uint8_t station[6] = {0x02, 0, 0, 0, 0, 2};
+    memcpy(mac, station, sizeof(station));
+    return mac;
+  }
+  bool softAP(const char *, const char * = nullptr) { return true; }
+  bool softAPdisconnect(bool = false) { return true; }
+  IPAddress softAPIP() { return IPAddress(192, 168, 4, 1); }
+  uint8_t softAPgetStationNum() { return 0; }
+};
+extern WiFiClass WiFi;
+
+#endif
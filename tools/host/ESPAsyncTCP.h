@@ -0,0 +1,3 @@
+/**
+ * @brief Host stand-in for ESPAsyncTCP; ESPAsyncWebServer.h has everything main.cpp needs.
+ */
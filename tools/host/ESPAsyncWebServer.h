@@ -0,0 +1,241 @@
+/**
+ * @brief Host stand-in for ESPAsyncWebServer: routes requests to the handlers in memory or over TCP.
+ *
+ * AsyncWebServer::on() registers handlers as on the board. A tool builds an
+ * AsyncWebServerRequest (method, URL, parameters, headers, body) and passes it
+ * to AsyncWebServer::handle(), which runs the matching handlers and leaves
+ * the status, content type and complete body of the response in the request.
+ * Chunked responses are rendered in HOST_CHUNK_SIZE pieces, like one TCP
+ * segment at a time on the board.
+ *
+ * With hostHttpPort set, begin() also listens on that port and poll() serves
+ * HTTP/1.1 from an epoll loop, the way the library serves it on the board:
+ * form bodies become POST parameters, other bodies go to the body handler,
+ * chunked responses are rendered one chunk at a time as the socket drains,
+ * and every connection closes after its response.
+ */
+
+#ifndef HOST_ESPASYNCWEBSERVER_H
+#define HOST_ESPASYNCWEBSERVER_H
+
+#include <Arduino.h>
+#include <memory>
+#include <vector>
+
+const size_t HOST_CHUNK_SIZE = 1436; // Typical lwIP TCP_MSS minus headers
+
+extern uint16_t hostHttpPort; // TCP port begin() listens on; 0 (default): none
+
+extern bool heapGuardArmed; // main.cpp: the host build's allocation hook
+
+/**
+ * @brief Lets the library allocate while a handler holds a HeapGuardScope.
+ * @details On the board the library's own buffers are not the firmware's
+ * allocations; the host guard only reports those.
+ */
+class LibraryAllocation {
+ public:
+  LibraryAllocation() : wasArmed(heapGuardArmed) { heapGuardArmed = false; }
+  ~LibraryAllocation() { heapGuardArmed = wasArmed; }
+
+ private:
+  bool wasArmed;
+};
+
+enum WebRequestMethod { HTTP_GET = 0b01, HTTP_POST = 0b10, HTTP_ANY = 0b11 };
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebServerRequest;
+typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, const String &filename, size_t index,
+                           uint8_t *data, size_t len, bool final)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, uint8_t *data, size_t len,
+                           size_t index, size_t total)> ArBodyHandlerFunction;
+typedef std::function<size_t(uint8_t *buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+typedef std::function<void()> ArDisconnectHandler;
+
+class AsyncWebParameter {
+ public:
+  AsyncWebParameter(const String &name, const String &value, bool post)
+    : paramName(name), paramValue(value), post(post) {}
+  const String &name() const { return paramName; }
+  const String &value() const { return paramValue; }
+  bool isPost() const { return post; }
+
+ private:
+  String paramName;
+  String paramValue;
+  bool post;
+};
+
+class AsyncWebHeader {
+ public:
+  AsyncWebHeader(const String &name, const String &value) : headerName(name), headerValue(value) {}
+  const String &name() const { return headerName; }
+  const String &value() const { return headerValue; }
+
+ private:
+  String headerName;
+  String headerValue;
+};
+
+class AsyncWebServerResponse {
+ public:
+  AsyncWebServerResponse(int code, const String &contentType, const String &content, AwsResponseFiller filler)
+    : code(code), contentType(contentType), content(content), filler(filler) {}
+  void addHeader(const char *name, const char *value) {
+    LibraryAllocation library;
+    headers.push_back(AsyncWebHeader(name, value));
+  }
+
+  int code;
+  String contentType;
+  String content;
+  AwsResponseFiller filler; // Set for chunked responses
+  std::vector<AsyncWebHeader> headers;
+};
+
+class AsyncWebServerRequest {
+ public:
+  AsyncWebServerRequest(WebRequestMethod method, const String &url) : requestMethod(method), requestUrl(url) {}
+  ~AsyncWebServerRequest() {
+    if (disconnectHandler) disconnectHandler();
+  }
+
+  // --- Request, as the handlers see it ---
+  WebRequestMethod method() const { return requestMethod; }
+  const String &url() const { return requestUrl; }
+  size_t params() const { return parameters.size(); }
+  const AsyncWebParameter *getParam(size_t i) const { return &parameters[i]; }
+  const AsyncWebParameter *getParam(const char *name) const {
+    for (size_t i = 0; i < parameters.size(); i++) {
+      if (parameters[i].name() == name) return &parameters[i];
+    }
+    return nullptr;
+  }
+  bool hasParam(const char *name) const { return getParam(name) != nullptr; }
+  const AsyncWebHeader *getHeader(const char *name) const {
+    for (size_t i = 0; i < headers.size(); i++) {
+      if (strcasecmp(headers[i].name().c_str(), name) == 0) return &headers[i];
+    }
+    return nullptr;
+  }
+  /** @brief HTTP basic authentication: the Authorization header must carry user:password. */
+  bool authenticate(const char *user, const char *pass) const {
+    static const char BASE64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const AsyncWebHeader *header = getHeader("Authorization");
+    if (header == nullptr) return false;
+    LibraryAllocation library;
+    std::string credentials = std::string(user) + ":" + pass;
+    std::string expected = "Basic ";
+    for (size_t i = 0; i < credentials.size(); i += 3) {
+      size_t left = credentials.size() - i;
+      uint32_t n = (uint32_t)(uint8_t)credentials[i] << 16;
+      if (left > 1) n |= (uint32_t)(uint8_t)credentials[i + 1] << 8;
+      if (left > 2) n |= (uint8_t)credentials[i + 2];
+      expected += BASE64[n >> 18 & 63];
+      expected += BASE64[n >> 12 & 63];
+      expected += left > 1 ? BASE64[n >> 6 & 63] : '=';
+      expected += left > 2 ? BASE64[n & 63] : '=';
+    }
+    return expected == header->value().c_str();
+  }
+  void requestAuthentication() { send(401, "text/plain", "Unauthorized"); }
+  /** @brief Sets the disconnect handler; like the library, a later call replaces an earlier one. */
+  void onDisconnect(ArDisconnectHandler handler) {
+    LibraryAllocation library;
+    disconnectHandler = handler;
+  }
+
+  // --- Response ---
+  AsyncWebServerResponse *beginResponse(int code, const char *contentType, const char *content) {
+    LibraryAllocation library;
+    return new AsyncWebServerResponse(code, contentType, content, nullptr);
+  }
+  AsyncWebServerResponse *beginChunkedResponse(const char *contentType, AwsResponseFiller filler) {
+    LibraryAllocation library;
+    return new AsyncWebServerResponse(200, contentType, String(), filler);
+  }
+  void send(int code, const char *contentType, const char *content) {
+    send(beginResponse(code, contentType, content));
+  }
+  void send(AsyncWebServerResponse *sent) { response.reset(sent); }
+  void redirect(const char *location) {
+    AsyncWebServerResponse *sent = beginResponse(302, "text/plain", "");
+    sent->addHeader("Location", location);
+    send(sent);
+  }
+
+  // --- Host side ---
+  void addParam(const String &name, const String &value, bool post) {
+    parameters.push_back(AsyncWebParameter(name, value, post));
+  }
+  void addHeader(const String &name, const String &value) { headers.push_back(AsyncWebHeader(name, value)); }
+
+  /** @brief Renders the response the handlers sent; status 0 if they sent none. */
+  int render(std::string &body) {
+    body.clear();
+    if (!response) return 0;
+    if (!response->filler) {
+      body = response->content.c_str();
+      return response->code;
+    }
+    uint8_t chunk[HOST_CHUNK_SIZE];
+    size_t len;
+    while ((len = response->filler(chunk, sizeof(chunk), body.size())) > 0) body.append((const char *)chunk, len);
+    return response->code;
+  }
+
+  /** @brief The response the handlers sent, or nullptr. */
+  const AsyncWebServerResponse *sentResponse() const { return response.get(); }
+
+ private:
+  WebRequestMethod requestMethod;
+  String requestUrl;
+  std::vector<AsyncWebParameter> parameters;
+  std::vector<AsyncWebHeader> headers;
+  ArDisconnectHandler disconnectHandler;
+  std::unique_ptr<AsyncWebServerResponse> response;
+};
+
+struct HostHttpSockets;
+
+class AsyncWebServer {
+ public:
+  explicit AsyncWebServer(uint16_t) : sockets(nullptr) {}
+  void begin();
+
+  /** @brief Serves the TCP connections for up to timeoutMs; host side, needs hostHttpPort. */
+  void poll(int timeoutMs);
+  void on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+          ArUploadHandlerFunction /*onUpload*/ = nullptr, ArBodyHandlerFunction onBody = nullptr) {
+    Route route = {uri, method, onRequest, onBody};
+    routes.push_back(route);
+  }
+  void onNotFound(ArRequestHandlerFunction onRequest) { notFound = onRequest; }
+
+  /** @brief Runs the handlers for a request, passing body to the body handler in one piece. */
+  void handle(AsyncWebServerRequest *request, const uint8_t *body = nullptr, size_t len = 0) {
+    for (size_t i = 0; i < routes.size(); i++) {
+      const Route &route = routes[i];
+      if (!(route.method & request->method()) || !(request->url() == route.uri.c_str())) continue;
+      if (route.onBody && len > 0) route.onBody(request, (uint8_t *)body, len, 0, len);
+      route.onRequest(request);
+      return;
+    }
+    if (notFound) notFound(request);
+  }
+
+ private:
+  struct Route {
+    std::string uri;
+    WebRequestMethodComposite method;
+    ArRequestHandlerFunction onRequest;
+    ArBodyHandlerFunction onBody;
+  };
+  std::vector<Route> routes;
+  ArRequestHandlerFunction notFound;
+  HostHttpSockets *sockets;
+};
+
+#endif
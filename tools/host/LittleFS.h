@@ -0,0 +1,33 @@
+/**
+ * @brief Host stand-in for LittleFS: files live below hostFsRoot.
+ */
+
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include <Arduino.h>
+
+class File {
+ public:
+  File(FILE *file = nullptr) : file(file) {}
+  explicit operator bool() const { return file != nullptr; }
+  size_t read(uint8_t *data, size_t len) { return fread(data, 1, len, file); }
+  size_t write(const uint8_t *data, size_t len) { return fwrite(data, 1, len, file); }
+  void close() {
+    if (file != nullptr) fclose(file);
+    file = nullptr;
+  }
+
+ private:
+  FILE *file;
+};
+
+class LittleFSClass {
+ public:
+  bool begin() { return true; }
+  File open(const char *path, const char *mode);
+  bool remove(const char *path);
+};
+extern LittleFSClass LittleFS;
+
+#endif
@@ -0,0 +1,158 @@
+/**
+ * @brief Host OneWire: the library's interface over an emulated bus of virtual DS18B20s.
+ *
+ * Every pin has its own bus, hostOneWireBuses[pin]. A tool attaches virtual
+ * sensors to it before setup(); the bus then runs the protocol slot by slot,
+ * as the sensors see it: reset and presence pulses, the ROM commands (search,
+ * match, skip, read) and the DS18B20 function commands, with the scratchpad,
+ * its CRC and the conversion time of each resolution. Each slot advances the
+ * virtual clock by its length on the wire, as the library's busy-waits do on
+ * the board, and is counted in the bus statistics.
+ *
+ * With no sensors attached, DallasTemperature.h skips the bus and reports
+ * hostReadTemperature directly.
+ */
+
+#ifndef HOST_ONEWIRE_H
+#define HOST_ONEWIRE_H
+
+#include <Arduino.h>
+
+//==============================================================================
+// Emulated Bus
+//==============================================================================
+const int HOST_ONEWIRE_MAX_DEVICES = 16;
+
+/** @brief Faults a virtual sensor can be given (HostDs18b20::faults); they can change at any time. */
+enum HostOneWireFault : uint8_t {
+  HOST_FAULT_CRC = 1 << 0,         // Scratchpad reads end in a wrong CRC byte, as with noise on the line
+  HOST_FAULT_NO_PRESENCE = 1 << 1, // Ignores the bus: no presence pulse, as if unplugged
+  HOST_FAULT_POWER_ON = 1 << 2,    // Conversions leave the 85 °C power-on value, as after a brown-out
+};
+
+/** @brief One virtual DS18B20. The first four fields are the configuration; the rest is its state. */
+struct HostDs18b20 {
+  uint8_t rom[8];       // Family code 0x28, serial number, CRC; taken as given
+  float temperatureC;   // What the next Convert T measures
+  uint8_t resolution;   // 9 to 12 bits at power-up
+  uint8_t faults;       // HostOneWireFault bits
+  uint8_t scratchpad[9];
+  int16_t convertedRaw;          // Result of the running conversion, in 1/16 °C
+  uint64_t conversionDoneMicros; // 0 when no conversion is running
+  bool selected;                 // Takes part in the current transaction
+};
+
+/** @brief What a transaction did, from the first command after its reset. */
+enum HostOneWireTransaction : uint8_t {
+  HOST_ONEWIRE_SEARCH,
+  HOST_ONEWIRE_CONVERT,
+  HOST_ONEWIRE_READ_SCRATCHPAD,
+  HOST_ONEWIRE_WRITE_SCRATCHPAD,
+  HOST_ONEWIRE_READ_POWER,
+  HOST_ONEWIRE_OTHER,
+  HOST_ONEWIRE_RESET, // A reset with nothing after it, such as the one ending a scratchpad read
+  HOST_ONEWIRE_TRANSACTIONS
+};
+
+/** @brief Counters of one bus; transactions run from a reset to the next one. */
+struct HostOneWireStats {
+  uint32_t resets;
+  uint32_t presences;   // Resets that found at least one device
+  uint32_t writeSlots;
+  uint32_t readSlots;
+  uint64_t busyMicros;  // Time spent in resets and slots
+  uint32_t count[HOST_ONEWIRE_TRANSACTIONS];
+  uint64_t totalMicros[HOST_ONEWIRE_TRANSACTIONS];
+  uint32_t maxMicros[HOST_ONEWIRE_TRANSACTIONS];
+};
+
+/**
+ * @brief The wire and the devices on it.
+ *
+ * Slots are the unit of the protocol: the master releases the line (a read,
+ * or writing a 1) or holds it low (writing a 0), and a device that is sending
+ * pulls a released line low for a 0. Several senders give the wired AND of
+ * their bits, which the search relies on. The bus state follows the commands.
+ */
+class HostOneWireBus {
+ public:
+  /** @brief Adds a sensor; returns it for setting temperature and faults later, or nullptr when full. */
+  HostDs18b20 *attach(const uint8_t rom[8], float temperatureC, uint8_t resolution = 12);
+  int deviceCount() const { return count; }
+  HostDs18b20 *device(int i) { return &devices[i]; }
+
+  /** @brief Reset pulse; true if a device answered with a presence pulse. */
+  bool reset();
+  /** @brief Write slot: 65 µs for a 1, 70 µs for a 0, as the library times them. */
+  void writeSlot(bool bit) { slot(bit, bit ? 65 : 70); stats.writeSlots++; }
+  /** @brief Read slot (66 µs): the master releases the line and samples it. */
+  bool readSlot() { stats.readSlots++; return slot(true, 66); }
+
+  /** @brief Counters so far, with the open transaction included. */
+  const HostOneWireStats &statistics();
+  static const char *transactionName(int kind);
+
+ private:
+  enum State : uint8_t {
+    IDLE, ROM_COMMAND, MATCH_ROM, SEARCH_ROM, READ_ROM, FUNCTION_COMMAND,
+    READ_SCRATCHPAD, WRITE_SCRATCHPAD, READ_POWER, CONVERTING
+  };
+
+  bool slot(bool release, uint32_t micros);
+  void finishConversions();
+  bool deviceBit(const HostDs18b20 &device) const;
+  void received(bool bit);
+  void command(uint8_t value);
+  void closeTransaction();
+
+  HostDs18b20 devices[HOST_ONEWIRE_MAX_DEVICES];
+  int count = 0;
+  State state = IDLE;
+  uint8_t bitIndex = 0;   // Bit position within the current state
+  uint8_t shift = 0;      // Bits received so far
+  uint8_t searchStep = 0; // 0: id bit, 1: complement, 2: direction
+  HostOneWireStats stats = {};
+  int transaction = -1;   // Kind of the open transaction; -1 when none
+  uint64_t transactionStart = 0;
+  uint64_t transactionEnd = 0;
+};
+
+/** @brief The bus on every pin. */
+extern HostOneWireBus hostOneWireBuses[64];
+
+//==============================================================================
+// Library Interface
+//==============================================================================
+/** @brief The OneWire library's interface, over hostOneWireBuses[pin]. */
+class OneWire {
+ public:
+  explicit OneWire(uint8_t pin) : pin(pin) { reset_search(); }
+
+  HostOneWireBus &bus() { return hostOneWireBuses[pin & 63]; }
+
+  uint8_t reset() { return bus().reset() ? 1 : 0; }
+  void select(const uint8_t rom[8]);
+  void skip() { write(0xCC); }
+  void write(uint8_t v, uint8_t power = 0);
+  void write_bytes(const uint8_t *buf, uint16_t count, bool power = 0);
+  uint8_t read();
+  void read_bytes(uint8_t *buf, uint16_t count);
+  void write_bit(uint8_t v) { bus().writeSlot(v & 1); }
+  uint8_t read_bit() { return bus().readSlot() ? 1 : 0; }
+  void depower() {}
+
+  void reset_search();
+  void target_search(uint8_t family_code);
+  bool search(uint8_t *newAddr, bool search_mode = true);
+
+  static uint8_t crc8(const uint8_t *addr, uint8_t len);
+
+ private:
+  uint8_t pin;
+  uint8_t searchRom[8];
+  uint8_t lastDiscrepancy;
+  uint8_t lastFamilyDiscrepancy;
+  bool lastDeviceFlag;
+};
+
+#endif
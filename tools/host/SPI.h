@@ -0,0 +1,27 @@
+/**
+ * @brief Host stand-in for the SPI bus: transfers go nowhere.
+ */
+
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include <Arduino.h>
+
+#define MSBFIRST 1
+#define SPI_MODE0 0x00
+
+class SPISettings {
+ public:
+  SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+class SPIClass {
+ public:
+  void begin() {}
+  void beginTransaction(SPISettings) {}
+  uint8_t transfer(uint8_t) { return 0; }
+  void endTransaction() {}
+};
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,27 @@
+/**
+ * @brief Host stand-in for the flash updater: accepts and discards the image.
+ */
+
+#ifndef HOST_UPDATER_H
+#define HOST_UPDATER_H
+
+#include <Arduino.h>
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+class UpdaterClass {
+ public:
+  void runAsync(bool) {}
+  bool begin(size_t) { running = true; return true; }
+  bool setMD5(const char *) { return true; }
+  size_t write(uint8_t *, size_t len) { return len; }
+  bool end(bool = false) { running = false; return true; }
+  bool isRunning() { return running; }
+  uint8_t getError() { return 0; }
+
+ private:
+  bool running = false;
+};
+extern UpdaterClass Update;
+
+#endif
@@ -0,0 +1,664 @@
+/**
+ * @brief Definitions behind the host stand-ins in tools/host (see Arduino.h).
+ */
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <ESPAsyncWebServer.h>
+#include <LittleFS.h>
+#include <OneWire.h>
+#include <SPI.h>
+#include <Updater.h>
+#include <Wire.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <map>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//==============================================================================
+// Host Controls
+//==============================================================================
+uint64_t hostMicros = 0;
+FILE *hostSerial = stdout;
+const char *hostFsRoot = ".";
+uint8_t hostPinLevels[64];
+float (*hostReadTemperature)(const uint8_t *address) = nullptr;
+uint16_t hostHttpPort = 0;
+
+//==============================================================================
+// Core API
+//==============================================================================
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+LittleFSClass LittleFS;
+UpdaterClass Update;
+SPIClass SPI;
+TwoWire Wire;
+
+unsigned long millis() { return (unsigned long)(hostMicros / 1000); }
+unsigned long micros() { return (unsigned long)hostMicros; }
+void delay(unsigned long ms) { hostMicros += (uint64_t)ms * 1000; }
+void delayMicroseconds(unsigned int us) { hostMicros += us; }
+void yield() {}
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t pin, uint8_t level) { hostPinLevels[pin & 63] = level; }
+int digitalRead(uint8_t pin) { return hostPinLevels[pin & 63]; }
+
+size_t Print::printf(const char *format, ...) {
+  char text[512];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  if (len <= 0) return 0;
+  return write((const uint8_t *)text, (size_t)len < sizeof(text) ? (size_t)len : sizeof(text) - 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t len) {
+  return hostSerial != nullptr ? fwrite(data, 1, len, hostSerial) : len;
+}
+
+void EspClass::restart() {
+  fprintf(stderr, "ESP.restart() called at %lu ms\n", millis());
+  exit(3);
+}
+
+//==============================================================================
+// LittleFS
+//==============================================================================
+static std::string hostPath(const char *path) { return std::string(hostFsRoot) + path; }
+
+File LittleFSClass::open(const char *path, const char *mode) {
+  return File(fopen(hostPath(path).c_str(), mode[0] == 'w' ? "wb" : "rb"));
+}
+
+bool LittleFSClass::remove(const char *path) { return ::remove(hostPath(path).c_str()) == 0; }
+
+//==============================================================================
+// AsyncWebServer over TCP
+//==============================================================================
+const size_t HOST_MAX_REQUEST = 64 * 1024; // Larger requests are answered with 413
+
+/** @brief One client connection: the request as it arrives, then the response as it drains. */
+struct HostConnection {
+  int fd;
+  std::string in;          // Bytes received so far
+  size_t bodyStart;        // Offset of the body in `in`; 0 until the headers are complete
+  size_t contentLength;
+  AsyncWebServerRequest *request; // Set once the request is complete; deleting it runs the disconnect handlers
+  bool started;            // Response headers queued
+  bool chunked;            // Response body comes from the filler
+  bool finished;           // Whole response queued
+  size_t index;            // Document offset for the next filler call
+  std::string out;         // Queued bytes not yet written
+};
+
+struct HostHttpSockets {
+  int listenFd;
+  int epollFd;
+  std::map<int, HostConnection *> connections;
+};
+
+static const char *reasonPhrase(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 302: return "Found";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 404: return "Not Found";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 503: return "Service Unavailable";
+    default: return "Status";
+  }
+}
+
+/** @brief Decodes %XX escapes and '+' of a URL or form component. */
+static std::string urlDecode(const std::string &text) {
+  std::string decoded;
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '+') {
+      decoded += ' ';
+    } else if (text[i] == '%' && i + 2 < text.size()) {
+      decoded += (char)strtol(text.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    } else {
+      decoded += text[i];
+    }
+  }
+  return decoded;
+}
+
+/** @brief Adds the name=value pairs of a query string or form body as parameters. */
+static void addParams(AsyncWebServerRequest *request, const std::string &pairs, bool post) {
+  size_t start = 0;
+  while (start < pairs.size()) {
+    size_t end = pairs.find('&', start);
+    if (end == std::string::npos) end = pairs.size();
+    std::string pair = pairs.substr(start, end - start);
+    size_t equals = pair.find('=');
+    if (!pair.empty()) {
+      std::string name = urlDecode(pair.substr(0, equals));
+      std::string value = equals == std::string::npos ? "" : urlDecode(pair.substr(equals + 1));
+      request->addParam(String(name), String(value), post);
+    }
+    start = end + 1;
+  }
+}
+
+static void closeConnection(HostHttpSockets *sockets, HostConnection *connection) {
+  epoll_ctl(sockets->epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+  close(connection->fd);
+  sockets->connections.erase(connection->fd);
+  delete connection->request;
+  delete connection;
+}
+
+/** @brief Sends a response without running a handler (malformed or oversized requests). */
+static void rejectConnection(HostConnection *connection, int code) {
+  char head[128];
+  snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", code,
+           reasonPhrase(code));
+  connection->out = head;
+  connection->started = true;
+  connection->finished = true;
+}
+
+/**
+ * @brief Parses the headers once they are complete, and runs the handlers once the body is.
+ * @return False if the connection is to be closed.
+ */
+static bool receive(AsyncWebServer *server, HostConnection *connection) {
+  if (connection->bodyStart == 0) {
+    size_t headerEnd = connection->in.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) {
+      if (connection->in.size() > HOST_MAX_REQUEST) rejectConnection(connection, 413);
+      return true;
+    }
+    connection->bodyStart = headerEnd + 4;
+    const char *length = strcasestr(connection->in.c_str(), "\r\nContent-Length:");
+    connection->contentLength = length != nullptr && (size_t)(length - connection->in.c_str()) < headerEnd
+                              ? strtoul(length + 17, nullptr, 10) : 0;
+    if (connection->contentLength > HOST_MAX_REQUEST) {
+      rejectConnection(connection, 413);
+      return true;
+    }
+  }
+  if (connection->in.size() < connection->bodyStart + connection->contentLength) return true;
+
+  // Request line: METHOD URL VERSION
+  std::string head = connection->in.substr(0, connection->bodyStart - 4);
+  size_t lineEnd = head.find("\r\n");
+  std::string line = head.substr(0, lineEnd);
+  size_t space1 = line.find(' ');
+  size_t space2 = line.find(' ', space1 + 1);
+  if (space1 == std::string::npos || space2 == std::string::npos) {
+    rejectConnection(connection, 400);
+    return true;
+  }
+  std::string method = line.substr(0, space1);
+  std::string target = line.substr(space1 + 1, space2 - space1 - 1);
+  size_t question = target.find('?');
+  WebRequestMethod requestMethod = method == "POST" ? HTTP_POST : HTTP_GET;
+  AsyncWebServerRequest *request = new AsyncWebServerRequest(requestMethod, String(urlDecode(target.substr(0, question))));
+  connection->request = request;
+  if (question != std::string::npos) addParams(request, target.substr(question + 1), false);
+
+  bool form = false;
+  size_t start = lineEnd == std::string::npos ? head.size() : lineEnd + 2;
+  while (start < head.size()) {
+    size_t end = head.find("\r\n", start);
+    if (end == std::string::npos) end = head.size();
+    std::string header = head.substr(start, end - start);
+    size_t colon = header.find(':');
+    if (colon != std::string::npos) {
+      std::string name = header.substr(0, colon);
+      std::string value = header.substr(colon + 1);
+      value.erase(0, value.find_first_not_of(' '));
+      request->addHeader(String(name), String(value));
+      if (strcasecmp(name.c_str(), "Content-Type") == 0) {
+        form = value.compare(0, 33, "application/x-www-form-urlencoded") == 0;
+      }
+    }
+    start = end + 2;
+  }
+
+  const uint8_t *body = (const uint8_t *)connection->in.data() + connection->bodyStart;
+  if (form) {
+    addParams(request, std::string((const char *)body, connection->contentLength), true);
+    server->handle(request);
+  } else {
+    server->handle(request, body, connection->contentLength);
+  }
+  return true;
+}
+
+/** @brief Queues the response headers, then the body chunk by chunk while little is queued. */
+static void produce(HostConnection *connection) {
+  const AsyncWebServerResponse *response = connection->request ? connection->request->sentResponse() : nullptr;
+  if (!connection->started) {
+    if (response == nullptr) return; // The handler has not answered yet
+    connection->started = true;
+    connection->chunked = (bool)response->filler;
+    char head[256];
+    snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nConnection: close\r\n", response->code,
+             reasonPhrase(response->code), response->contentType.c_str());
+    connection->out += head;
+    for (size_t i = 0; i < response->headers.size(); i++) {
+      connection->out += std::string(response->headers[i].name().c_str()) + ": " + response->headers[i].value().c_str() + "\r\n";
+    }
+    if (connection->chunked) {
+      connection->out += "Transfer-Encoding: chunked\r\n\r\n";
+    } else {
+      snprintf(head, sizeof(head), "Content-Length: %zu\r\n\r\n", response->content.length());
+      connection->out += head;
+      connection->out += response->content.c_str();
+      connection->finished = true;
+    }
+  }
+  // One chunk at a time, like the library filling the TCP window.
+  while (connection->chunked && !connection->finished && connection->out.size() < HOST_CHUNK_SIZE) {
+    uint8_t chunk[HOST_CHUNK_SIZE];
+    size_t len = response->filler(chunk, sizeof(chunk), connection->index);
+    char size[16];
+    snprintf(size, sizeof(size), "%zx\r\n", len);
+    connection->out += size;
+    connection->out.append((const char *)chunk, len);
+    connection->out += "\r\n";
+    connection->index += len;
+    if (len == 0) connection->finished = true;
+  }
+}
+
+/**
+ * @brief Writes until the socket is full (the next EPOLLOUT continues) or the response is sent.
+ * @return False once the response is sent or the peer is gone.
+ */
+static bool transmit(HostConnection *connection) {
+  for (;;) {
+    produce(connection);
+    if (connection->out.empty()) return !connection->finished;
+    ssize_t sent = send(connection->fd, connection->out.data(), connection->out.size(), MSG_NOSIGNAL);
+    if (sent < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+    connection->out.erase(0, sent);
+  }
+}
+
+void AsyncWebServer::begin() {
+  if (hostHttpPort == 0 || sockets != nullptr) return;
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(hostHttpPort);
+  if (bind(fd, (sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 128) != 0) {
+    fprintf(stderr, "AsyncWebServer: cannot listen on port %u: %s\n", hostHttpPort, strerror(errno));
+    exit(2);
+  }
+  sockets = new HostHttpSockets;
+  sockets->listenFd = fd;
+  sockets->epollFd = epoll_create1(0);
+  epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  epoll_ctl(sockets->epollFd, EPOLL_CTL_ADD, fd, &event);
+}
+
+void AsyncWebServer::poll(int timeoutMs) {
+  if (sockets == nullptr) return;
+  epoll_event events[64];
+  int count = epoll_wait(sockets->epollFd, events, 64, timeoutMs);
+  for (int e = 0; e < count; e++) {
+    int fd = events[e].data.fd;
+    if (fd == sockets->listenFd) {
+      int client;
+      while ((client = accept4(sockets->listenFd, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+        int on = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        HostConnection *connection = new HostConnection();
+        connection->fd = client;
+        sockets->connections[client] = connection;
+        epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        event.data.fd = client;
+        epoll_ctl(sockets->epollFd, EPOLL_CTL_ADD, client, &event);
+      }
+      continue;
+    }
+    std::map<int, HostConnection *>::iterator it = sockets->connections.find(fd);
+    if (it == sockets->connections.end()) continue;
+    HostConnection *connection = it->second;
+    bool open = true;
+    if (events[e].events & EPOLLIN) {
+      char buffer[4096];
+      ssize_t received;
+      while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0) connection->in.append(buffer, received);
+      if (received == 0 && connection->request == nullptr) open = false; // Closed before the request was complete
+      if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK) open = false;
+      if (open && connection->request == nullptr && !connection->started) open = receive(this, connection);
+    }
+    if (events[e].events & (EPOLLERR | EPOLLHUP)) open = false;
+    if (open) open = transmit(connection);
+    if (!open) closeConnection(sockets, connection);
+  }
+
+  // Requests whose handler answers later, or whose socket has room again
+  // without a new event (edge-triggered), are moved on here.
+  std::vector<HostConnection *> waiting;
+  for (std::map<int, HostConnection *>::iterator it = sockets->connections.begin(); it != sockets->connections.end(); ++it) {
+    if (it->second->request != nullptr && !it->second->started) waiting.push_back(it->second);
+  }
+  for (size_t i = 0; i < waiting.size(); i++) {
+    if (!transmit(waiting[i])) closeConnection(sockets, waiting[i]);
+  }
+}
+
+//==============================================================================
+// OneWire Bus
+//==============================================================================
+HostOneWireBus hostOneWireBuses[64];
+
+static const uint32_t RESET_MICROS = 960;           // 480 µs low, then the presence window and recovery
+static const uint32_t CONVERSION_MICROS_12_BIT = 750000;
+
+/** @brief Puts the DS18B20's power-up values in its scratchpad. */
+static void powerUp(HostDs18b20 &device) {
+  static const uint8_t initial[8] = {0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10}; // 85 °C, TH, TL, config
+  memcpy(device.scratchpad, initial, 8);
+  device.scratchpad[4] = (uint8_t)(((device.resolution - 9) << 5) | 0x1F);
+  device.scratchpad[8] = OneWire::crc8(device.scratchpad, 8);
+}
+
+HostDs18b20 *HostOneWireBus::attach(const uint8_t rom[8], float temperatureC, uint8_t resolution) {
+  if (count == HOST_ONEWIRE_MAX_DEVICES) return nullptr;
+  HostDs18b20 &device = devices[count++];
+  memset(&device, 0, sizeof(device));
+  memcpy(device.rom, rom, 8);
+  device.temperatureC = temperatureC;
+  device.resolution = resolution < 9 ? 9 : resolution > 12 ? 12 : resolution;
+  powerUp(device);
+  return &device;
+}
+
+bool HostOneWireBus::reset() {
+  closeTransaction();
+  finishConversions();
+  bool present = false;
+  for (int i = 0; i < count; i++) {
+    devices[i].selected = (devices[i].faults & HOST_FAULT_NO_PRESENCE) == 0;
+    present = present || devices[i].selected;
+  }
+  state = present ? ROM_COMMAND : IDLE;
+  bitIndex = 0;
+  shift = 0;
+  transaction = HOST_ONEWIRE_RESET;
+  transactionStart = hostMicros;
+  hostMicros += RESET_MICROS;
+  transactionEnd = hostMicros;
+  stats.resets++;
+  if (present) stats.presences++;
+  stats.busyMicros += RESET_MICROS;
+  return present;
+}
+
+/** @brief Finished conversions move their result into the scratchpad. */
+void HostOneWireBus::finishConversions() {
+  for (int i = 0; i < count; i++) {
+    HostDs18b20 &device = devices[i];
+    if (device.conversionDoneMicros == 0 || hostMicros < device.conversionDoneMicros) continue;
+    device.scratchpad[0] = (uint8_t)(device.convertedRaw & 0xFF);
+    device.scratchpad[1] = (uint8_t)((uint16_t)device.convertedRaw >> 8);
+    device.scratchpad[8] = OneWire::crc8(device.scratchpad, 8);
+    device.conversionDoneMicros = 0;
+  }
+}
+
+/** @brief The bit a selected device sends in the current slot; 1 (released) when it is listening. */
+bool HostOneWireBus::deviceBit(const HostDs18b20 &device) const {
+  switch (state) {
+    case SEARCH_ROM:
+      if (searchStep == 2) return true;
+      return (((device.rom[bitIndex / 8] >> (bitIndex % 8)) & 1) != 0) != (searchStep == 1);
+    case READ_ROM:
+      return (device.rom[bitIndex / 8] >> (bitIndex % 8)) & 1;
+    case READ_SCRATCHPAD: {
+      if (bitIndex >= 72) return true;
+      uint8_t value = device.scratchpad[bitIndex / 8];
+      if (bitIndex / 8 == 8 && (device.faults & HOST_FAULT_CRC)) value ^= 0xFF;
+      return (value >> (bitIndex % 8)) & 1;
+    }
+    case CONVERTING:
+      return device.conversionDoneMicros == 0; // Reads 0 until the conversion is done
+    default:
+      return true; // Listening, or powered externally (Read Power Supply)
+  }
+}
+
+bool HostOneWireBus::slot(bool release, uint32_t micros) {
+  finishConversions();
+  bool level = release;
+  for (int i = 0; i < count && level; i++) {
+    if (devices[i].selected && !deviceBit(devices[i])) level = false;
+  }
+  received(level);
+  hostMicros += micros;
+  transactionEnd = hostMicros;
+  stats.busyMicros += micros;
+  return level;
+}
+
+/** @brief Moves the bus state on by the level of one slot. */
+void HostOneWireBus::received(bool bit) {
+  switch (state) {
+    case ROM_COMMAND:
+    case FUNCTION_COMMAND:
+    case WRITE_SCRATCHPAD:
+      if (bit) shift |= (uint8_t)(1 << (bitIndex % 8));
+      bitIndex++;
+      if (bitIndex % 8 != 0) break;
+      if (state != WRITE_SCRATCHPAD) {
+        command(shift);
+      } else {
+        int field = 2 + bitIndex / 8 - 1; // TH, TL, then the configuration register
+        for (int i = 0; i < count; i++) {
+          if (!devices[i].selected) continue;
+          devices[i].scratchpad[field] = field == 4 ? (uint8_t)((shift & 0x60) | 0x1F) : shift;
+          devices[i].scratchpad[8] = OneWire::crc8(devices[i].scratchpad, 8);
+        }
+        if (field == 4) state = IDLE;
+      }
+      shift = 0;
+      break;
+    case MATCH_ROM:
+      for (int i = 0; i < count; i++) {
+        if (((devices[i].rom[bitIndex / 8] >> (bitIndex % 8)) & 1) != bit) devices[i].selected = false;
+      }
+      if (++bitIndex == 64) state = FUNCTION_COMMAND, bitIndex = 0;
+      break;
+    case SEARCH_ROM:
+      if (searchStep < 2) {
+        searchStep++;
+        break;
+      }
+      for (int i = 0; i < count; i++) {
+        if (((devices[i].rom[bitIndex / 8] >> (bitIndex % 8)) & 1) != bit) devices[i].selected = false;
+      }
+      searchStep = 0;
+      if (++bitIndex == 64) state = FUNCTION_COMMAND, bitIndex = 0;
+      break;
+    case READ_ROM:
+      if (++bitIndex == 64) state = FUNCTION_COMMAND, bitIndex = 0;
+      break;
+    case READ_SCRATCHPAD:
+      if (bitIndex < 72) bitIndex++;
+      break;
+    default:
+      break;
+  }
+}
+
+/** @brief Starts a ROM command or a function command on the selected devices. */
+void HostOneWireBus::command(uint8_t value) {
+  bitIndex = 0;
+  searchStep = 0;
+  if (state == ROM_COMMAND) {
+    transaction = HOST_ONEWIRE_OTHER;
+    switch (value) {
+      case 0xF0: state = SEARCH_ROM, transaction = HOST_ONEWIRE_SEARCH; break;
+      case 0xEC: state = IDLE, transaction = HOST_ONEWIRE_SEARCH; break; // Alarm search: no alarms are set
+      case 0x55: state = MATCH_ROM; break;
+      case 0xCC: state = FUNCTION_COMMAND; break;
+      case 0x33: state = READ_ROM; break;
+      default: state = IDLE; break;
+    }
+    return;
+  }
+  // The transaction is named after the command even when no device is
+  // left to answer it (a Match ROM for an absent sensor).
+  bool anySelected = false;
+  for (int i = 0; i < count; i++) anySelected = anySelected || devices[i].selected;
+  state = IDLE;
+  switch (value) {
+    case 0x44: // Convert T
+      transaction = HOST_ONEWIRE_CONVERT;
+      state = anySelected ? CONVERTING : IDLE;
+      for (int i = 0; i < count; i++) {
+        HostDs18b20 &device = devices[i];
+        if (!device.selected) continue;
+        int bits = 9 + ((device.scratchpad[4] >> 5) & 3);
+        float t = device.temperatureC < -55.0f ? -55.0f : device.temperatureC > 125.0f ? 125.0f : device.temperatureC;
+        int16_t raw = (int16_t)lroundf(t * 16.0f) & (int16_t)(0xFFFF << (12 - bits)); // Unused low bits read 0
+        device.convertedRaw = (device.faults & HOST_FAULT_POWER_ON) ? 0x0550 : raw;
+        device.conversionDoneMicros = hostMicros + (CONVERSION_MICROS_12_BIT >> (12 - bits));
+      }
+      break;
+    case 0xBE: state = READ_SCRATCHPAD, transaction = HOST_ONEWIRE_READ_SCRATCHPAD; break;
+    case 0x4E: state = WRITE_SCRATCHPAD, transaction = HOST_ONEWIRE_WRITE_SCRATCHPAD; break;
+    case 0xB4: state = READ_POWER, transaction = HOST_ONEWIRE_READ_POWER; break;
+    default: break; // Copy and recall: nothing to emulate without EEPROM
+  }
+  if (!anySelected) state = IDLE;
+}
+
+void HostOneWireBus::closeTransaction() {
+  if (transaction < 0) return;
+  uint32_t micros = (uint32_t)(transactionEnd - transactionStart);
+  stats.count[transaction]++;
+  stats.totalMicros[transaction] += micros;
+  if (micros > stats.maxMicros[transaction]) stats.maxMicros[transaction] = micros;
+  transaction = -1;
+}
+
+const HostOneWireStats &HostOneWireBus::statistics() {
+  closeTransaction();
+  return stats;
+}
+
+const char *HostOneWireBus::transactionName(int kind) {
+  static const char *const NAMES[HOST_ONEWIRE_TRANSACTIONS] = {
+    "search", "convert", "read scratchpad", "write scratchpad", "read power", "other", "reset only"
+  };
+  return kind >= 0 && kind < HOST_ONEWIRE_TRANSACTIONS ? NAMES[kind] : "?";
+}
+
+void OneWire::select(const uint8_t rom[8]) {
+  write(0x55);
+  for (int i = 0; i < 8; i++) write(rom[i]);
+}
+
+void OneWire::write(uint8_t v, uint8_t) {
+  for (int i = 0; i < 8; i++) bus().writeSlot((v >> i) & 1);
+}
+
+void OneWire::write_bytes(const uint8_t *buf, uint16_t count, bool) {
+  for (uint16_t i = 0; i < count; i++) write(buf[i]);
+}
+
+uint8_t OneWire::read() {
+  uint8_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    if (bus().readSlot()) value |= (uint8_t)(1 << i);
+  }
+  return value;
+}
+
+void OneWire::read_bytes(uint8_t *buf, uint16_t count) {
+  for (uint16_t i = 0; i < count; i++) buf[i] = read();
+}
+
+void OneWire::reset_search() {
+  memset(searchRom, 0, sizeof(searchRom));
+  lastDiscrepancy = 0;
+  lastFamilyDiscrepancy = 0;
+  lastDeviceFlag = false;
+}
+
+void OneWire::target_search(uint8_t family_code) {
+  memset(searchRom, 0, sizeof(searchRom));
+  searchRom[0] = family_code;
+  lastDiscrepancy = 64;
+  lastFamilyDiscrepancy = 0;
+  lastDeviceFlag = false;
+}
+
+/** @brief The library's search (Maxim application note 187): one ROM code per call. */
+bool OneWire::search(uint8_t *newAddr, bool search_mode) {
+  if (lastDeviceFlag || !reset()) {
+    reset_search();
+    return false;
+  }
+  write(search_mode ? 0xF0 : 0xEC);
+  uint8_t lastZero = 0;
+  int bit = 1;
+  for (; bit <= 64; bit++) {
+    uint8_t id = read_bit();
+    uint8_t complement = read_bit();
+    if (id && complement) break; // No device is left in the search
+    uint8_t &romByte = searchRom[(bit - 1) / 8];
+    uint8_t mask = (uint8_t)(1 << ((bit - 1) % 8));
+    bool direction;
+    if (id != complement) {
+      direction = id;
+    } else {
+      direction = bit < lastDiscrepancy ? (romByte & mask) != 0 : bit == lastDiscrepancy;
+      if (!direction) {
+        lastZero = (uint8_t)bit;
+        if (lastZero < 9) lastFamilyDiscrepancy = lastZero;
+      }
+    }
+    romByte = direction ? (romByte | mask) : (romByte & ~mask);
+    write_bit(direction);
+  }
+  if (bit <= 64 || searchRom[0] == 0) {
+    reset_search();
+    return false;
+  }
+  lastDiscrepancy = lastZero;
+  lastDeviceFlag = lastDiscrepancy == 0;
+  memcpy(newAddr, searchRom, 8);
+  return true;
+}
+
+uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len) {
+  uint8_t crc = 0;
+  while (len--) {
+    uint8_t value = *addr++;
+    for (int i = 0; i < 8; i++) {
+      uint8_t mix = (crc ^ value) & 1;
+      crc >>= 1;
+      if (mix) crc ^= 0x8C;
+      value >>= 1;
+    }
+  }
+  return crc;
+}
@@ -0,0 +1,375 @@
+/**
+ * @brief Times the firmware's hot paths on the host and estimates their cost on the board.
+ *
+ * Build and run on the host; main.cpp is compiled in unchanged against the
+ * stand-ins in tools/host:
+ *
+ *   g++ -std=gnu++11 -O2 -DHOST_BUILD -Itools/host -o hotpath_bench tools/hotpath_bench.cpp tools/host/host.cpp
+ *   ./hotpath_bench
+ *
+ * Options:
+ *   --target esp8266|esp32   Board the estimates are for (default esp8266).
+ *   --calibrate NAME=US      Board time of benchmark NAME in µs, e.g. the p50 of
+ *                            the matching /profile section (control=120).
+ *   --out FILE               Write the results as CSV.
+ *   --compare FILE           Compare with an earlier --out file; exit 1 if a
+ *                            benchmark got slower by more than --tolerance.
+ *   --tolerance PERCENT      Default 15.
+ *
+ * Benchmarks (the /profile section they correspond to in brackets):
+ *   loop_idle       A loop() pass with no task due.
+ *   control         A loop() pass running the control tick, no heater changes [control].
+ *   control_switch  The same with every heater switching, including the log, trace and recording writes.
+ *   acquisition     A loop() pass running the sensor task for all channels [acquisition].
+ *   data_json       The complete /data document, in 1436-byte chunks as it is sent [http_data].
+ *   table_rows      generateTableRows() for all channels.
+ *   update_parse    /update form parsing: every field of every channel, then validation [http_update].
+ *   reading         Converting one DS18B20 reading: raw to °C as the library does, then the
+ *                   firmware's checks, trace and recording values.
+ *
+ * Estimates for the board: host time is converted to host cycles with the
+ * measured host clock, then multiplied by a host-to-board cycle ratio. The
+ * default ratios (about 10 for the ESP8266's single-issue core without an
+ * FPU, 4 for the ESP32) are only an order of magnitude. --calibrate replaces
+ * the ratio with the one that makes the named benchmark match a board
+ * measurement, which then carries over to the other benchmarks.
+ */
+
+#include "../main.cpp"
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+//==============================================================================
+// Measurement
+//==============================================================================
+typedef std::chrono::steady_clock Clock;
+
+const int BATCHES = 15;               // The fastest batch is reported: other load only adds time
+const double BATCH_SECONDS = 0.02;    // Minimum length of a batch
+
+struct Target {
+  const char *name;
+  double mhz;
+  double cyclesPerHostCycle; // Default ratio, replaced by --calibrate
+};
+
+const Target TARGETS[] = {
+  {"esp8266", 80, 10.0},
+  {"esp32", 240, 4.0},
+};
+
+/**
+ * @brief Host clock in GHz, from a chain of dependent adds (one per cycle).
+ * @note The adds are register to register: newer cores merge chains of
+ * constant adds and would read too fast.
+ */
+double hostGigahertz() {
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+  const uint64_t iterations = 20000000;
+  uint64_t x = 0;
+  Clock::time_point start = Clock::now();
+  for (uint64_t i = 0; i < iterations; i++) {
+#if defined(__aarch64__)
+    asm volatile("add %0, %0, %0\n\tadd %0, %0, %0\n\tadd %0, %0, %0\n\tadd %0, %0, %0\n\t"
+                 "add %0, %0, %0\n\tadd %0, %0, %0\n\tadd %0, %0, %0\n\tadd %0, %0, %0" : "+r"(x));
+#else
+    asm volatile("add %0, %0\n\tadd %0, %0\n\tadd %0, %0\n\tadd %0, %0\n\t"
+                 "add %0, %0\n\tadd %0, %0\n\tadd %0, %0\n\tadd %0, %0" : "+r"(x));
+#endif
+  }
+  double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+  return iterations * 8 / ns;
+#else
+  return 3.0; // Unknown architecture: assume 3 GHz
+#endif
+}
+
+/** @brief A benchmark: prepare() once, then run() repeatedly; run() does one operation. */
+struct Benchmark {
+  const char *name;
+  void (*prepare)();
+  void (*run)();
+};
+
+/** @brief Time of one run() in ns, from the fastest of BATCHES batches. */
+double measure(const Benchmark &benchmark) {
+  benchmark.prepare();
+  // Find a batch size that takes at least BATCH_SECONDS.
+  uint64_t batch = 1;
+  for (;;) {
+    Clock::time_point start = Clock::now();
+    for (uint64_t i = 0; i < batch; i++) benchmark.run();
+    if (std::chrono::duration<double>(Clock::now() - start).count() >= BATCH_SECONDS) break;
+    batch *= 2;
+  }
+  double fastest = 0;
+  for (int b = 0; b < BATCHES; b++) {
+    Clock::time_point start = Clock::now();
+    for (uint64_t i = 0; i < batch; i++) benchmark.run();
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / batch;
+    if (b == 0 || ns < fastest) fastest = ns;
+  }
+  return fastest;
+}
+
+//==============================================================================
+// Benchmarks
+//==============================================================================
+// Each loop() pass advances the virtual clock; the task timestamps are moved
+// so that exactly the task under test is due.
+uint8_t chunk[HOST_CHUNK_SIZE];
+volatile size_t sink; // Keeps results alive
+
+/** @brief Sets every channel's temperature below (true) or above its setpoint. */
+void placeTemperatures(bool below) {
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    controller.lastTemperatures[i] = controller.liveSetpoints[i] + (below ? -5.0f : HYSTERESIS + 5.0f);
+  }
+}
+
+/** @brief Runs one loop() pass dt_ms after the previous one, with the given tasks due. */
+void loopPass(uint32_t dtMs, bool sensorDue, bool controlDue) {
+  hostMicros += (uint64_t)dtMs * 1000;
+  unsigned long now = millis();
+  tasks.lastSensorRead = sensorDue ? now - 2000 : now;
+  tasks.lastLogicUpdate = controlDue ? now - 500 : now;
+  loop();
+}
+
+void prepareLoop() {
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    controller.holdPhaseActive[i] = false;
+    controller.coolingPhaseActive[i] = false;
+  }
+  placeTemperatures(true);
+  loopPass(500, false, true); // Heaters on
+}
+
+void runLoopIdle() { loopPass(1, false, false); }
+void runControl() { loopPass(1, false, true); }
+
+bool heatersOn = true;
+void runControlSwitch() {
+  heatersOn = !heatersOn;
+  placeTemperatures(heatersOn);
+  loopPass(1, false, true);
+}
+
+void runAcquisition() { loopPass(1, true, false); }
+
+/** @brief Renders a complete document chunk by chunk, as sendRendered() does. */
+size_t renderDocument(Renderer render) {
+  size_t index = 0;
+  for (;;) {
+    WindowWriter out(chunk, sizeof(chunk), index);
+    render(out);
+    index += out.length();
+    if (out.length() < sizeof(chunk)) return index;
+  }
+}
+
+void prepareRender() {
+  // Hold phase on half of the channels, so /data formats remaining times.
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    controller.holdPhaseActive[i] = i % 2 == 0;
+    controller.phaseStartMillis[i] = millis();
+    controller.lastTemperatures[i] = 55.4375f + i;
+  }
+}
+
+void runDataJson() { sink = renderDocument(renderSensorData); }
+void runTableRows() { sink = renderDocument(generateTableRows); }
+
+// The /update form as the web interface posts it: every field of every channel.
+char formNames[NUM_SENSORS * SETTING_FIELD_COUNT][16];
+char formValues[NUM_SENSORS * SETTING_FIELD_COUNT][16];
+
+void prepareUpdate() {
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    for (int f = 0; f < SETTING_FIELD_COUNT; f++) {
+      int n = i * SETTING_FIELD_COUNT + f;
+      snprintf(formNames[n], sizeof(formNames[n]), "%s%d", SETTING_FIELDS[f].formName, i);
+      int32_t value = currentField(i, (SettingField)f);
+      if (SETTING_FIELDS[f].decimals == 2) {
+        snprintf(formValues[n], sizeof(formValues[n]), "%.2f", value / 100.0);
+      } else {
+        snprintf(formValues[n], sizeof(formValues[n]), "%ld", (long)value);
+      }
+    }
+  }
+}
+
+void runUpdateParse() {
+  SettingsCommand command;
+  clearCommand(command);
+  CommandError error = COMMAND_OK;
+  for (int n = 0; n < NUM_SENSORS * SETTING_FIELD_COUNT && error == COMMAND_OK; n++) {
+    error = addFormField(command, formNames[n], formValues[n]);
+  }
+  int channel;
+  if (error == COMMAND_OK) error = validateCommand(command, channel);
+  sink = error;
+}
+
+void prepareNothing() {}
+
+// DS18B20 scratchpad values in 1/16 °C, as read from the bus.
+const int16_t RAW_READINGS[] = {0x0191, 0x07D0, -0x00A2, 0x0550, 0x0000, 0x03A2, 0x0650};
+size_t readingIndex = 0;
+
+void runReading() {
+  int16_t raw = RAW_READINGS[readingIndex++ % (sizeof(RAW_READINGS) / sizeof(RAW_READINGS[0]))];
+  // DallasTemperature: 12-bit value to 1/128 °C, then to °C.
+  int32_t fixed = (int32_t)raw << 3;
+  float temp = fixed * 0.0078125f;
+  // The acquisition task's checks and conversions.
+  bool valid = temp != DEVICE_DISCONNECTED_C && temp != 85.0;
+  sink = valid + traceCentiDegrees(temp) + recordReading(temp);
+}
+
+const Benchmark BENCHMARKS[] = {
+  {"loop_idle", prepareLoop, runLoopIdle},
+  {"control", prepareLoop, runControl},
+  {"control_switch", prepareLoop, runControlSwitch},
+  {"acquisition", prepareLoop, runAcquisition},
+  {"data_json", prepareRender, runDataJson},
+  {"table_rows", prepareRender, runTableRows},
+  {"update_parse", prepareUpdate, runUpdateParse},
+  {"reading", prepareNothing, runReading},
+};
+const size_t BENCHMARK_COUNT = sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]);
+
+//==============================================================================
+// Main
+//==============================================================================
+/** @brief Reads "name,ns_per_op,..." lines written by --out. */
+std::map<std::string, double> readBaseline(const char *path) {
+  std::map<std::string, double> baseline;
+  FILE *in = fopen(path, "r");
+  if (in == nullptr) {
+    perror(path);
+    return baseline;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), in)) {
+    char *comma = strchr(line, ',');
+    if (comma == nullptr) continue;
+    *comma = '\0';
+    char *end;
+    double ns = strtod(comma + 1, &end);
+    if (end != comma + 1) baseline[line] = ns;
+  }
+  fclose(in);
+  return baseline;
+}
+
+int usage(const char *program) {
+  fprintf(stderr, "usage: %s [--target esp8266|esp32] [--calibrate NAME=US] [--out FILE] [--compare FILE] "
+                  "[--tolerance PERCENT]\n", program);
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  const Target *target = &TARGETS[0];
+  const char *calibrateName = nullptr;
+  double calibrateMicros = 0;
+  const char *outPath = nullptr;
+  const char *comparePath = nullptr;
+  double tolerance = 15;
+  for (int a = 1; a + 1 < argc; a += 2) {
+    const char *value = argv[a + 1];
+    if (strcmp(argv[a], "--target") == 0) {
+      target = nullptr;
+      for (const Target &t : TARGETS) {
+        if (strcmp(t.name, value) == 0) target = &t;
+      }
+      if (target == nullptr) return usage(argv[0]);
+    } else if (strcmp(argv[a], "--calibrate") == 0) {
+      static char name[32];
+      if (sscanf(value, "%31[^=]=%lf", name, &calibrateMicros) != 2 || calibrateMicros <= 0) return usage(argv[0]);
+      calibrateName = name;
+    } else if (strcmp(argv[a], "--out") == 0) {
+      outPath = value;
+    } else if (strcmp(argv[a], "--compare") == 0) {
+      comparePath = value;
+    } else if (strcmp(argv[a], "--tolerance") == 0) {
+      tolerance = atof(value);
+    } else {
+      return usage(argv[0]);
+    }
+  }
+  if (argc % 2 == 0) return usage(argv[0]);
+
+  // Boot the firmware on the virtual clock, with its flash in a scratch directory.
+  char fsRoot[] = "/tmp/hotpath-XXXXXX";
+  if (mkdtemp(fsRoot) == nullptr) {
+    perror("mkdtemp");
+    return 2;
+  }
+  hostFsRoot = fsRoot;
+  hostSerial = nullptr;
+  setup();
+  for (int i = 0; i < 10; i++) loopPass(500, true, true);
+
+  double ghz = hostGigahertz();
+  double nanos[BENCHMARK_COUNT];
+  for (size_t b = 0; b < BENCHMARK_COUNT; b++) nanos[b] = measure(BENCHMARKS[b]);
+
+  double ratio = target->cyclesPerHostCycle;
+  if (calibrateName != nullptr) {
+    size_t b = 0;
+    while (b < BENCHMARK_COUNT && strcmp(BENCHMARKS[b].name, calibrateName) != 0) b++;
+    if (b == BENCHMARK_COUNT) {
+      fprintf(stderr, "unknown benchmark %s\n", calibrateName);
+      return 2;
+    }
+    ratio = calibrateMicros * target->mhz / (nanos[b] * ghz);
+  }
+
+  printf("host %.2f GHz; %s at %.0f MHz, %.1f board cycles per host cycle (%s)\n", ghz, target->name, target->mhz,
+         ratio, calibrateName ? "calibrated" : "default, uncalibrated");
+  printf("%-16s %10s %12s %14s %12s\n", "benchmark", "host ns", "host cycles", "board cycles", "board us");
+  for (size_t b = 0; b < BENCHMARK_COUNT; b++) {
+    double hostCycles = nanos[b] * ghz;
+    printf("%-16s %10.1f %12.0f %14.0f %12.2f\n", BENCHMARKS[b].name, nanos[b], hostCycles, hostCycles * ratio,
+           hostCycles * ratio / target->mhz);
+  }
+
+  if (outPath != nullptr) {
+    FILE *out = fopen(outPath, "w");
+    if (out == nullptr) {
+      perror(outPath);
+      return 2;
+    }
+    fprintf(out, "benchmark,host_ns,board_cycles\n");
+    for (size_t b = 0; b < BENCHMARK_COUNT; b++) {
+      fprintf(out, "%s,%.1f,%.0f\n", BENCHMARKS[b].name, nanos[b], nanos[b] * ghz * ratio);
+    }
+    fclose(out);
+  }
+
+  int status = 0;
+  if (comparePath != nullptr) {
+    std::map<std::string, double> baseline = readBaseline(comparePath);
+    printf("\n%-16s %10s %10s %8s\n", "benchmark", "before", "now", "change");
+    for (size_t b = 0; b < BENCHMARK_COUNT; b++) {
+      std::map<std::string, double>::const_iterator it = baseline.find(BENCHMARKS[b].name);
+      if (it == baseline.end()) continue;
+      double change = (nanos[b] / it->second - 1) * 100;
+      bool regressed = change > tolerance;
+      printf("%-16s %10.1f %10.1f %+7.1f%%%s\n", BENCHMARKS[b].name, it->second, nanos[b], change,
+             regressed ? "  REGRESSION" : "");
+      if (regressed) status = 1;
+    }
+  }
+
+  for (const char *file : {"/settings.1", "/settings.2", "/wifi.1", "/wifi.2", "/channels.1", "/channels.2"}) {
+    remove((std::string(fsRoot) + file).c_str());
+  }
+  rmdir(fsRoot);
+  return status;
+}
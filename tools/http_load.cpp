@@ -0,0 +1,265 @@
+/**
+ * @brief Load generator: N dashboards polling the controller, with throughput and latency.
+ *
+ * Build and run on the host, against a controller or tools/serve.cpp:
+ *
+ *   g++ -std=c++11 -O2 -o http_load tools/http_load.cpp
+ *   ./http_load --port 8080 --dashboards 1,4,16,64 --seconds 10
+ *
+ * Every dashboard behaves like an open web interface: it loads / once, then
+ * requests /data every --interval-ms (2000, as the page does; 0 polls again
+ * as soon as the answer is in). Like the browser it opens one connection per
+ * request. For each dashboard count the program reports the completed
+ * requests per second, the p50, p99 and maximum latency (connect to the last
+ * byte), and how many answers were 503 (admission control) or failed.
+ *
+ * Options: --host ADDRESS (default 127.0.0.1), --port P (default 80),
+ * --dashboards LIST, --interval-ms MS, --seconds S (per dashboard count),
+ * --path PATH (polled path, default /data), --strict 1 (exit with 1 unless
+ * every request got 200).
+ *
+ * With --strict and a load inside the endpoint's admission limit, the run is
+ * a check of the admission bookkeeping: every refused request there is a slot
+ * that was not given back. For /metrics (2 concurrent scrapes):
+ *
+ *   ./http_load --port 8080 --path /metrics --dashboards 1,2 --interval-ms 0 --seconds 5 --strict 1
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+//==============================================================================
+// Setup
+//==============================================================================
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+  sockaddr_in address;
+  std::vector<int> dashboards;
+  int intervalMs;
+  double seconds;
+  std::string path;
+  bool strict;
+};
+
+/** @brief One simulated dashboard: at most one request in flight. */
+struct Dashboard {
+  int fd;                   // -1 while idle
+  bool pageLoaded;          // The first request fetches /
+  Clock::time_point sent;   // Start of the current request (connect)
+  Clock::time_point next;   // When the next request starts
+  std::string request;
+  size_t written;
+  std::string response;
+};
+
+/** @brief Results of one dashboard count. */
+struct Round {
+  std::vector<double> latenciesMs; // Successful requests
+  uint32_t rejected;               // 503
+  uint32_t failed;                 // Connection errors and other statuses
+};
+
+double millisBetween(Clock::time_point a, Clock::time_point b) {
+  return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+//==============================================================================
+// Client
+//==============================================================================
+/** @brief Opens a connection and queues the request; the request is sent when it connects. */
+bool startRequest(Dashboard &d, const Options &options, int epollFd) {
+  d.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (d.fd < 0) return false;
+  int on = 1;
+  setsockopt(d.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  d.sent = Clock::now();
+  const char *path = d.pageLoaded ? options.path.c_str() : "/";
+  d.request = std::string("GET ") + path + " HTTP/1.1\r\nHost: controller\r\nConnection: close\r\n\r\n";
+  d.written = 0;
+  d.response.clear();
+  if (connect(d.fd, (const sockaddr *)&options.address, sizeof(options.address)) != 0 && errno != EINPROGRESS) {
+    close(d.fd);
+    d.fd = -1;
+    return false;
+  }
+  epoll_event event;
+  event.events = EPOLLIN | EPOLLOUT;
+  event.data.ptr = &d;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, d.fd, &event);
+  return true;
+}
+
+/** @brief Closes the request and schedules the next one. */
+void finishRequest(Dashboard &d, const Options &options, int epollFd, Round *round, bool ok) {
+  Clock::time_point now = Clock::now();
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, d.fd, nullptr);
+  close(d.fd);
+  d.fd = -1;
+  if (round != nullptr) {
+    int status = ok && d.response.compare(0, 9, "HTTP/1.1 ") == 0 ? atoi(d.response.c_str() + 9) : 0;
+    if (status == 200) {
+      round->latenciesMs.push_back(millisBetween(d.sent, now));
+    } else if (status == 503) {
+      round->rejected++;
+    } else {
+      round->failed++;
+    }
+  }
+  d.pageLoaded = true;
+  // Fixed-rate polling, like setInterval(): the next poll is due one interval
+  // after the previous one started, or at once if that has passed.
+  d.next = d.sent + std::chrono::milliseconds(options.intervalMs);
+  if (d.next < now) d.next = now;
+}
+
+/** @brief Runs count dashboards for the configured time and collects their results. */
+Round runRound(int count, const Options &options) {
+  Round round = {std::vector<double>(), 0, 0};
+  int epollFd = epoll_create1(0);
+  std::vector<Dashboard> dashboards(count);
+  Clock::time_point start = Clock::now();
+  Clock::time_point end = start + std::chrono::microseconds((int64_t)(options.seconds * 1e6));
+  for (int i = 0; i < count; i++) {
+    Dashboard &d = dashboards[i];
+    d.fd = -1;
+    d.pageLoaded = false;
+    // Spread the first page loads over one interval, as dashboards opened at different times.
+    d.next = start + std::chrono::microseconds((int64_t)options.intervalMs * 1000 * i / count);
+  }
+
+  for (;;) {
+    Clock::time_point now = Clock::now();
+    bool running = now < end;
+    bool inFlight = false;
+    Clock::time_point wake = end;
+    for (size_t i = 0; i < dashboards.size(); i++) {
+      Dashboard &d = dashboards[i];
+      if (d.fd < 0 && running && d.next <= now && !startRequest(d, options, epollFd)) round.failed++;
+      if (d.fd >= 0) inFlight = true;
+      if (d.fd < 0 && d.next < wake) wake = d.next;
+    }
+    if (!running && !inFlight) break;
+
+    int timeoutMs = running ? (int)std::max(0.0, millisBetween(Clock::now(), wake)) : 100;
+    epoll_event events[256];
+    int ready = epoll_wait(epollFd, events, 256, timeoutMs);
+    for (int e = 0; e < ready; e++) {
+      Dashboard &d = *(Dashboard *)events[e].data.ptr;
+      if (d.fd < 0) continue;
+      if (events[e].events & EPOLLERR) {
+        finishRequest(d, options, epollFd, &round, false);
+        continue;
+      }
+      if ((events[e].events & EPOLLOUT) && d.written < d.request.size()) {
+        ssize_t n = send(d.fd, d.request.data() + d.written, d.request.size() - d.written, MSG_NOSIGNAL);
+        if (n > 0) d.written += n;
+        if (d.written == d.request.size()) {
+          epoll_event event;
+          event.events = EPOLLIN;
+          event.data.ptr = &d;
+          epoll_ctl(epollFd, EPOLL_CTL_MOD, d.fd, &event);
+        }
+      }
+      if (events[e].events & (EPOLLIN | EPOLLHUP)) {
+        char buffer[8192];
+        ssize_t n;
+        while ((n = recv(d.fd, buffer, sizeof(buffer), 0)) > 0) d.response.append(buffer, n);
+        if (n == 0) {
+          finishRequest(d, options, epollFd, d.sent < end ? &round : nullptr, true); // Server closed: response complete
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          finishRequest(d, options, epollFd, &round, false);
+        }
+      }
+    }
+  }
+  close(epollFd);
+  return round;
+}
+
+//==============================================================================
+// Main
+//==============================================================================
+double percentile(std::vector<double> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t rank = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[rank];
+}
+
+int usage(const char *program) {
+  fprintf(stderr, "usage: %s [--host ADDRESS] [--port P] [--dashboards 1,4,16] [--interval-ms MS] [--seconds S] "
+                  "[--path PATH] [--strict 1]\n", program);
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  memset(&options.address, 0, sizeof(options.address));
+  options.address.sin_family = AF_INET;
+  options.address.sin_port = htons(80);
+  inet_pton(AF_INET, "127.0.0.1", &options.address.sin_addr);
+  options.intervalMs = 2000;
+  options.seconds = 10;
+  options.path = "/data";
+  options.strict = false;
+  const char *dashboardList = "1,4,16,64";
+
+  for (int a = 1; a + 1 < argc; a += 2) {
+    const char *value = argv[a + 1];
+    if (strcmp(argv[a], "--host") == 0) {
+      if (inet_pton(AF_INET, value, &options.address.sin_addr) != 1) return usage(argv[0]);
+    } else if (strcmp(argv[a], "--port") == 0) {
+      options.address.sin_port = htons((uint16_t)atoi(value));
+    } else if (strcmp(argv[a], "--dashboards") == 0) {
+      dashboardList = value;
+    } else if (strcmp(argv[a], "--interval-ms") == 0) {
+      options.intervalMs = atoi(value);
+    } else if (strcmp(argv[a], "--seconds") == 0) {
+      options.seconds = atof(value);
+    } else if (strcmp(argv[a], "--path") == 0) {
+      options.path = value;
+    } else if (strcmp(argv[a], "--strict") == 0) {
+      options.strict = atoi(value) != 0;
+    } else {
+      return usage(argv[0]);
+    }
+  }
+  if (argc % 2 == 0) return usage(argv[0]);
+  for (const char *p = dashboardList; *p != '\0';) {
+    int count = (int)strtol(p, (char **)&p, 10);
+    if (count <= 0) return usage(argv[0]);
+    options.dashboards.push_back(count);
+    if (*p == ',') p++;
+  }
+
+  bool unanswered = false;
+  printf("%10s %9s %10s %9s %9s %9s %8s %7s\n", "dashboards", "requests", "req/s", "p50 ms", "p99 ms", "max ms",
+         "503", "failed");
+  for (size_t r = 0; r < options.dashboards.size(); r++) {
+    Round round = runRound(options.dashboards[r], options);
+    std::vector<double> &latencies = round.latenciesMs;
+    std::sort(latencies.begin(), latencies.end());
+    printf("%10d %9zu %10.1f %9.2f %9.2f %9.2f %8u %7u\n", options.dashboards[r], latencies.size(),
+           latencies.size() / options.seconds, percentile(latencies, 0.5), percentile(latencies, 0.99),
+           latencies.empty() ? 0.0 : latencies.back(), round.rejected, round.failed);
+    if (latencies.empty() || round.rejected != 0 || round.failed != 0) unanswered = true;
+  }
+  if (options.strict && unanswered) {
+    fprintf(stderr, "not every request was answered with 200\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,197 @@
+/**
+ * @brief Runs the firmware's sensor code against an emulated OneWire bus of virtual DS18B20s.
+ *
+ * Build and run on the host; main.cpp and its DallasTemperature calls are
+ * compiled in unchanged against the stand-ins in tools/host, whose OneWire
+ * bus is emulated slot by slot (see tools/host/OneWire.h):
+ *
+ *   g++ -std=gnu++11 -O2 -DHOST_BUILD -Itools/host -o onewire_sim tools/onewire_sim.cpp tools/host/host.cpp
+ *   ./onewire_sim --seconds 120 --resolution 12 --fault 2:crc:10-20 --fault 4:absent:30-45 --fault 1:85:50-60
+ *
+ * One virtual sensor is attached for every channel, with the channel's ROM
+ * code, on the oneWireBus pin. Sensor i measures --temp + 0.37 * i °C, rising
+ * by --ramp °C per minute. A --fault CHANNEL:KIND:FROM-TO gives the sensor of
+ * channel CHANNEL (index in CHANNELS) a fault from FROM to TO seconds: crc (bad
+ * scratchpad CRC), absent (no presence pulse) or 85 (conversions leave the
+ * power-on value).
+ *
+ * loop() runs every millisecond of virtual time, and the bus adds the time
+ * its slots take on the wire. After every sensor task each channel's reading
+ * is checked against the scratchpad the firmware read: the value at the
+ * sensor's resolution, or the error value for a fault. The program prints the
+ * readings and errors per channel, the bus utilization, the time of each kind
+ * of transaction and the longest time the sensor task held the bus in one
+ * loop() pass, and exits with 1 if any reading was wrong.
+ */
+
+#include "../main.cpp"
+
+#include <dirent.h>
+#include <unistd.h>
+#include <vector>
+
+//==============================================================================
+// Scenario
+//==============================================================================
+const uint32_t LOOP_US = 1000;          // Virtual time between loop() passes
+const float CHANNEL_OFFSET_C = 0.37f;   // Sensor i measures this much more than sensor i - 1
+
+struct Fault {
+  int channel;
+  uint8_t kind;      // HostOneWireFault bit
+  float from, to;    // Seconds
+};
+
+struct ChannelCheck {
+  uint32_t reads;
+  uint32_t errors;   // Error values the firmware reported
+  uint32_t wrong;    // Readings that differ from the scratchpad
+};
+
+/** @brief Parses CHANNEL:KIND:FROM-TO. */
+bool parseFault(const char *text, Fault &fault) {
+  char kind[8];
+  if (sscanf(text, "%d:%7[^:]:%f-%f", &fault.channel, kind, &fault.from, &fault.to) != 4) return false;
+  if (fault.channel < 0 || fault.channel >= NUM_SENSORS || fault.to < fault.from) return false;
+  if (strcmp(kind, "crc") == 0) {
+    fault.kind = HOST_FAULT_CRC;
+  } else if (strcmp(kind, "absent") == 0) {
+    fault.kind = HOST_FAULT_NO_PRESENCE;
+  } else if (strcmp(kind, "85") == 0) {
+    fault.kind = HOST_FAULT_POWER_ON;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/** @brief What the firmware should have stored for a sensor after reading it. */
+float expectedReading(const HostDs18b20 &sensor) {
+  if (sensor.faults & (HOST_FAULT_CRC | HOST_FAULT_NO_PRESENCE)) return CHANNEL_NO_READING;
+  float t = (int16_t)(((uint16_t)sensor.scratchpad[1] << 8) | sensor.scratchpad[0]) / 16.0f;
+  return t == 85.0f ? CHANNEL_NO_READING : t;
+}
+
+/** @brief Removes the files the firmware wrote, then the directory. */
+void removeDirectory(const char *path) {
+  DIR *dir = opendir(path);
+  if (dir == nullptr) return;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (entry->d_name[0] == '.') continue;
+    std::string file = std::string(path) + "/" + entry->d_name;
+    unlink(file.c_str());
+  }
+  closedir(dir);
+  rmdir(path);
+}
+
+//==============================================================================
+// Main
+//==============================================================================
+int usage(const char *program) {
+  fprintf(stderr, "usage: %s [--seconds S] [--resolution 9..12] [--temp C] [--ramp C_PER_MIN] "
+                  "[--fault CHANNEL:crc|absent|85:FROM-TO]...\n", program);
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  float seconds = 120, baseC = 40, rampCPerMinute = 1;
+  int resolution = 12;
+  std::vector<Fault> faults;
+  for (int a = 1; a + 1 < argc; a += 2) {
+    const char *value = argv[a + 1];
+    if (strcmp(argv[a], "--seconds") == 0) {
+      seconds = atof(value);
+    } else if (strcmp(argv[a], "--resolution") == 0) {
+      resolution = atoi(value);
+      if (resolution < 9 || resolution > 12) return usage(argv[0]);
+    } else if (strcmp(argv[a], "--temp") == 0) {
+      baseC = atof(value);
+    } else if (strcmp(argv[a], "--ramp") == 0) {
+      rampCPerMinute = atof(value);
+    } else if (strcmp(argv[a], "--fault") == 0) {
+      Fault fault;
+      if (!parseFault(value, fault)) return usage(argv[0]);
+      faults.push_back(fault);
+    } else {
+      return usage(argv[0]);
+    }
+  }
+  if (argc % 2 == 0) return usage(argv[0]);
+
+  HostOneWireBus &bus = hostOneWireBuses[oneWireBus];
+  HostDs18b20 *sensorsOnBus[NUM_SENSORS];
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    sensorsOnBus[i] = bus.attach(CHANNELS[i].address, baseC + CHANNEL_OFFSET_C * i, (uint8_t)resolution);
+  }
+
+  // Boot the firmware on the virtual clock, with its flash in a scratch directory.
+  char fsRoot[] = "/tmp/onewire-XXXXXX";
+  if (mkdtemp(fsRoot) == nullptr) {
+    perror("mkdtemp");
+    return 2;
+  }
+  hostFsRoot = fsRoot;
+  hostSerial = nullptr;
+  setup();
+  printf("%d sensors on GPIO %d, %d-bit, %d found by search, %.0f s simulated\n", NUM_SENSORS, oneWireBus,
+         resolution, sensors.getDeviceCount(), seconds);
+
+  ChannelCheck checks[NUM_SENSORS] = {};
+  uint32_t sensorPasses = 0;
+  uint64_t longestSensorPass = 0;
+  uint64_t end = (uint64_t)(seconds * 1e6f);
+  while (hostMicros < end) {
+    float now = hostMicros / 1e6f;
+    for (int i = 0; i < NUM_SENSORS; i++) {
+      sensorsOnBus[i]->temperatureC = baseC + CHANNEL_OFFSET_C * i + rampCPerMinute * now / 60.0f;
+      sensorsOnBus[i]->faults = 0;
+    }
+    for (size_t f = 0; f < faults.size(); f++) {
+      if (now >= faults[f].from && now < faults[f].to) sensorsOnBus[faults[f].channel]->faults |= faults[f].kind;
+    }
+
+    unsigned long lastSensorRead = tasks.lastSensorRead;
+    uint64_t passStart = hostMicros;
+    loop();
+    uint64_t passMicros = hostMicros - passStart;
+    if (tasks.lastSensorRead != lastSensorRead) {
+      sensorPasses++;
+      longestSensorPass = std::max(longestSensorPass, passMicros);
+      for (int i = 0; i < NUM_SENSORS; i++) {
+        if (!controller.channelEnabled(i)) continue;
+        float expected = expectedReading(*sensorsOnBus[i]);
+        checks[i].reads++;
+        if (controller.lastTemperatures[i] == CHANNEL_NO_READING) checks[i].errors++;
+        if (controller.lastTemperatures[i] != expected) checks[i].wrong++;
+      }
+    }
+    hostMicros += LOOP_US;
+  }
+
+  printf("\n%-8s %-10s %7s %7s %7s %9s\n", "channel", "name", "reads", "errors", "wrong", "last °C");
+  uint32_t wrong = 0;
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    printf("%-8d %-10s %7u %7u %7u %9.4f\n", i, CHANNELS[i].name, checks[i].reads, checks[i].errors, checks[i].wrong,
+           controller.lastTemperatures[i]);
+    wrong += checks[i].wrong;
+  }
+
+  const HostOneWireStats &stats = bus.statistics();
+  printf("\nbus busy %.2f s of %.2f s (%.2f%%), %u resets (%u answered), %u write and %u read slots\n",
+         stats.busyMicros / 1e6, hostMicros / 1e6, 100.0 * stats.busyMicros / hostMicros, stats.resets,
+         stats.presences, stats.writeSlots, stats.readSlots);
+  printf("%-18s %7s %10s %10s\n", "transaction", "count", "mean us", "max us");
+  for (int k = 0; k < HOST_ONEWIRE_TRANSACTIONS; k++) {
+    if (stats.count[k] == 0) continue;
+    printf("%-18s %7u %10.0f %10u\n", HostOneWireBus::transactionName(k), stats.count[k],
+           (double)stats.totalMicros[k] / stats.count[k], stats.maxMicros[k]);
+  }
+  printf("\nsensor task: %u runs, up to %.1f ms on the bus in one loop() pass\n", sensorPasses,
+         longestSensorPass / 1e3);
+  if (wrong != 0) printf("%u readings differ from the sensors' scratchpads\n", wrong);
+
+  removeDirectory(fsRoot);
+  return wrong != 0 ? 1 : 0;
+}
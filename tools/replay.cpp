@@ -0,0 +1,356 @@
+/**
+ * @brief Replays a /recording dump through the real loop() and checks that the run repeats.
+ *
+ * Download the recording from the controller, then build and run the replay
+ * on the host; main.cpp is compiled in unchanged against the stand-ins in
+ * tools/host:
+ *
+ *   curl -o run.rec http://<controller-ip>/recording
+ *   g++ -std=gnu++11 -O2 -DHOST_BUILD -Itools/host -o replay tools/replay.cpp tools/host/host.cpp
+ *   ./replay run.rec
+ *
+ * Several dumps may be given, or concatenated into one file (polling
+ * /recording during a long run); they are joined by record sequence number.
+ *
+ * The replay starts at the first keyframe: the controller is booted on a
+ * virtual clock, the keyframe's channel state is restored, and loop() is run
+ * once for every recorded loop() pass with the recorded sensor readings,
+ * settings changes and channel changes as input. The records the replayed
+ * firmware writes are compared with the recorded ones; the first differences
+ * are printed as a timeline and the program exits with 1 if there are any.
+ *
+ * The record layout is RunRecord/RecordingHeader in main.cpp.
+ */
+
+#include "../main.cpp"
+
+#include <chrono>
+#include <dirent.h>
+#include <map>
+#include <unistd.h>
+#include <vector>
+
+//==============================================================================
+// Loading
+//==============================================================================
+const uint32_t MAX_REPORTED = 10; // Differing passes printed in full
+
+/** @brief Reads every dump in a file into records, keyed by sequence number. */
+bool loadDumps(const char *path, std::map<uint32_t, RunRecord> &records) {
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) {
+    perror(path);
+    return false;
+  }
+  RecordingHeader header;
+  int dumps = 0;
+  while (fread(&header, sizeof(header), 1, file) == 1) {
+    if (header.magic != RECORDING_MAGIC || header.version != RECORDING_VERSION ||
+        header.recordSize != sizeof(RunRecord)) {
+      fprintf(stderr, "%s: dump %d is not a version %u recording\n", path, dumps + 1, RECORDING_VERSION);
+      fclose(file);
+      return false;
+    }
+    for (uint32_t i = 0; i < header.count; i++) {
+      RunRecord r;
+      if (fread(&r, sizeof(r), 1, file) != 1) {
+        fprintf(stderr, "warning: %s: dump %d is cut off after %lu records\n", path, dumps + 1, (unsigned long)i);
+        fclose(file);
+        return true;
+      }
+      records[header.first + i] = r;
+    }
+    dumps++;
+  }
+  fclose(file);
+  if (dumps == 0) fprintf(stderr, "%s: empty file\n", path);
+  return dumps > 0;
+}
+
+/** @brief True for the records that form a keyframe. */
+bool isKeyframe(const RunRecord &r) {
+  return r.type >= RECORD_KEYFRAME && r.type <= RECORD_KEY_TEMPERATURE;
+}
+
+/**
+ * @brief Order of a record's source within one loop() pass.
+ * @details loop() applies channel changes, then settings, then writes a due
+ * keyframe, reads the sensors and runs the control tick. Passes within the same
+ * millisecond share a time, so a record of an earlier stage than the one
+ * before it starts a new pass. Output and phase records follow their cause.
+ */
+int passStage(const RunRecord &r, int current) {
+  switch (r.type) {
+    case RECORD_CHANNEL: return 0;
+    case RECORD_KEYFRAME: return 2;
+    case RECORD_READING: return 3;
+    case RECORD_TICK: return 4;
+    case RECORD_OUTPUT:
+    case RECORD_PHASE: return current;
+    default: return r.type >= RECORD_SETTING ? 1 : current;
+  }
+}
+
+//==============================================================================
+// Replay
+//==============================================================================
+// Sensor readings for the pass being replayed, per channel; NAN if none.
+float pendingReadings[NUM_SENSORS];
+
+float replayReading(const uint8_t *address) {
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    if (memcmp(address, CHANNELS[i].address, sizeof(DeviceAddress)) == 0 && !std::isnan(pendingReadings[i])) {
+      return pendingReadings[i];
+    }
+  }
+  return DEVICE_DISCONNECTED_C;
+}
+
+float floatFromBits(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/** @brief Loads the state stored in a keyframe (records[0] is RECORD_KEYFRAME) into the controller. */
+void restoreKeyframe(const RunRecord *records, size_t count) {
+  for (size_t k = 1; k < count; k++) {
+    const RunRecord &r = records[k];
+    uint32_t value = r.time;
+    int i = r.channel;
+    switch (r.type) {
+      case RECORD_KEY_SCHEDULE:
+        (i == 0 ? tasks.lastSensorRead : tasks.lastLogicUpdate) = value;
+        if (i == 1) tasks.controlStarted = r.arg;
+        break;
+      case RECORD_KEY_ENABLED:
+        controller.setEnabled(value);
+        break;
+      case RECORD_KEY_SETTING:
+        if (r.arg == FIELD_HOLD_DURATION) {
+          controller.setting_HoldDurations[i] = value;
+        } else {
+          float *fields[] = {controller.setting_HoldTemps, controller.setting_CoolingSpeeds, controller.setting_LowerLimits};
+          fields[r.arg][i] = floatFromBits(value);
+        }
+        break;
+      case RECORD_KEY_PHASE:
+        controller.holdPhaseActive[i] = (r.arg & 0xFF) == TRACE_PHASE_HOLD;
+        controller.coolingPhaseActive[i] = (r.arg & 0xFF) == TRACE_PHASE_COOLING;
+        controller.outputState[i] = r.arg >> 8;
+        controller.phaseStartMillis[i] = value;
+        outputSet(i, controller.outputState[i]);
+        break;
+      case RECORD_KEY_SETPOINT:
+        controller.liveSetpoints[i] = floatFromBits(value);
+        break;
+      case RECORD_KEY_TEMPERATURE:
+        controller.lastTemperatures[i] = floatFromBits(value);
+        break;
+    }
+  }
+  outputCommit();
+  recording.ticksToKeyframe = RECORDING_KEYFRAME_TICKS;
+}
+
+/** @brief Runs loop() once at time with the inputs among records. */
+void replayPass(uint32_t time, const std::vector<RunRecord> &records) {
+  SettingsCommand command;
+  clearCommand(command);
+  bool settings = false;
+  for (int i = 0; i < NUM_SENSORS; i++) pendingReadings[i] = NAN;
+  for (size_t k = 0; k < records.size(); k++) {
+    const RunRecord &r = records[k];
+    if (r.channel >= NUM_SENSORS) continue;
+    if (r.type == RECORD_READING) {
+      pendingReadings[r.channel] = r.arg / 128.0f;
+    } else if (r.type == RECORD_CHANNEL) {
+      // The pass applies the whole new mask at once.
+      uint32_t mask = channelsRequest.load() != 0 ? channelsRequest.load() : controller.enabled;
+      mask = r.arg ? mask | 1UL << r.channel : mask & ~(1UL << r.channel);
+      channelsRequest.store(mask);
+    } else if (r.type >= RECORD_SETTING && r.type < RECORD_SETTING + SETTING_FIELD_COUNT) {
+      command.fieldMask[r.channel] |= 1 << (r.type - RECORD_SETTING);
+      command.values[r.channel][r.type - RECORD_SETTING] = r.arg;
+      settings = true;
+    }
+  }
+  if (settings && submitCommand(command) != COMMAND_OK) fprintf(stderr, "replay: settings at %lu ms refused\n", (unsigned long)time);
+  hostMicros = (uint64_t)time * 1000;
+  loop();
+}
+
+//==============================================================================
+// Comparison
+//==============================================================================
+const char *describe(const RunRecord &r, char *text, size_t size) {
+  int type = r.type;
+  if (type == RECORD_READING) {
+    snprintf(text, size, "reading %.4f C", r.arg / 128.0);
+  } else if (type == RECORD_TICK) {
+    snprintf(text, size, "control tick");
+  } else if (type == RECORD_CHANNEL) {
+    snprintf(text, size, "channel %s", r.arg ? "enabled" : "disabled");
+  } else if (type == RECORD_OUTPUT) {
+    snprintf(text, size, "heater %s", r.arg ? "ON" : "OFF");
+  } else if (type == RECORD_PHASE) {
+    const char *phases[] = {"Idle", "Hold", "Cooling"};
+    snprintf(text, size, "phase %s", r.arg >= 0 && r.arg <= 2 ? phases[r.arg] : "?");
+  } else if (type >= RECORD_SETTING && type < RECORD_SETTING + SETTING_FIELD_COUNT) {
+    snprintf(text, size, "setting %s = %d", SETTING_FIELDS[type - RECORD_SETTING].formName, r.arg);
+  } else {
+    snprintf(text, size, "record type %d arg %d", type, r.arg);
+  }
+  return text;
+}
+
+void printTimelineLine(const char *label, const RunRecord *r) {
+  char text[48];
+  if (r == nullptr) {
+    printf("  %-9s (nothing)\n", label);
+    return;
+  }
+  char channel[8] = "-";
+  if (r->channel != RECORD_NO_CHANNEL) snprintf(channel, sizeof(channel), "%u", r->channel);
+  printf("  %-9s %10.3f s  ch %-2s %s\n", label, r->time / 1000.0, channel, describe(*r, text, sizeof(text)));
+}
+
+bool sameRecord(const RunRecord &a, const RunRecord &b) {
+  return a.time == b.time && a.type == b.type && a.channel == b.channel && a.arg == b.arg;
+}
+
+/**
+ * @brief Compares the records of one loop() pass.
+ * @details Passes are compared separately, so one extra or missing record
+ * does not shift the rest of the run out of line.
+ * @param report Print both sides of the pass as a timeline if they differ.
+ * @return Number of positions at which the two sides differ.
+ */
+size_t comparePass(const std::vector<RunRecord> &recorded, const std::vector<RunRecord> &replayed, bool report) {
+  size_t n = recorded.size() > replayed.size() ? recorded.size() : replayed.size();
+  size_t differing = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (i >= recorded.size() || i >= replayed.size() || !sameRecord(recorded[i], replayed[i])) differing++;
+  }
+  if (differing == 0 || !report) return differing;
+  printf("pass at %.3f s differs:\n", (recorded.empty() ? replayed[0] : recorded[0]).time / 1000.0);
+  for (size_t i = 0; i < n; i++) {
+    bool same = i < recorded.size() && i < replayed.size() && sameRecord(recorded[i], replayed[i]);
+    printTimelineLine(same ? "" : "recorded", i < recorded.size() ? &recorded[i] : nullptr);
+    if (!same) printTimelineLine("replayed", i < replayed.size() ? &replayed[i] : nullptr);
+  }
+  return differing;
+}
+
+/** @brief Removes the files the replayed firmware wrote, then the directory. */
+void removeDirectory(const char *path) {
+  DIR *dir = opendir(path);
+  if (dir == nullptr) return;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (entry->d_name[0] == '.') continue;
+    std::string file = std::string(path) + "/" + entry->d_name;
+    unlink(file.c_str());
+  }
+  closedir(dir);
+  rmdir(path);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s recording.rec [more.rec ...]\n", argv[0]);
+    return 2;
+  }
+  std::map<uint32_t, RunRecord> dumps;
+  for (int a = 1; a < argc; a++) {
+    if (!loadDumps(argv[a], dumps)) return 2;
+  }
+
+  // The contiguous run of records from the oldest one.
+  std::vector<RunRecord> recorded;
+  uint32_t expected = dumps.begin()->first;
+  for (std::map<uint32_t, RunRecord>::const_iterator it = dumps.begin(); it != dumps.end(); ++it) {
+    if (it->first != expected) {
+      fprintf(stderr, "warning: records %lu..%lu are missing; replaying up to the gap\n",
+              (unsigned long)expected, (unsigned long)it->first - 1);
+      break;
+    }
+    recorded.push_back(it->second);
+    expected++;
+  }
+
+  size_t start = 0;
+  while (start < recorded.size() && recorded[start].type != RECORD_KEYFRAME) start++;
+  if (start == recorded.size() || start + 1 + recorded[start].arg > recorded.size()) {
+    fprintf(stderr, "no complete keyframe in the recording\n");
+    return 2;
+  }
+
+  // Boot the firmware on the virtual clock, with its flash in a scratch directory.
+  char fsRoot[] = "/tmp/replay-XXXXXX";
+  if (mkdtemp(fsRoot) == nullptr) {
+    perror("mkdtemp");
+    return 2;
+  }
+  hostFsRoot = fsRoot;
+  hostSerial = nullptr;
+  hostReadTemperature = replayReading;
+  const RunRecord &keyframe = recorded[start];
+  hostMicros = (uint64_t)keyframe.time * 1000;
+  setup();
+  restoreKeyframe(&recorded[start], 1 + keyframe.arg);
+
+  // Run one loop() pass per recorded pass and compare what the firmware records in it.
+  std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+  std::vector<RunRecord> pass, replayed;
+  size_t k = start + 1 + keyframe.arg;
+  int stage = 2;
+  uint32_t passTime = keyframe.time;
+  uint32_t drained = recordingHead.load();
+  uint32_t passes = 0, differingPasses = 0;
+  size_t recordCount = 0, replayedCount = 0, differences = 0;
+  for (;;) {
+    bool done = k == recorded.size();
+    if (!done) {
+      const RunRecord &r = recorded[k];
+      int next = passStage(r, stage);
+      if (r.time == passTime && next >= stage) {
+        if (r.type == RECORD_KEYFRAME) {
+          k = k + 1 + r.arg < recorded.size() ? k + 1 + r.arg : recorded.size();
+        } else {
+          pass.push_back(r);
+          k++;
+        }
+        stage = next;
+        continue;
+      }
+    }
+    if (passes == 0 || !pass.empty()) {
+      replayPass(passTime, pass);
+      passes++;
+      replayed.clear();
+      for (uint32_t head = recordingHead.load(); drained != head; drained++) {
+        const RunRecord &r = recordingRing[drained % RECORDING_CAPACITY];
+        if (!isKeyframe(r)) replayed.push_back(r);
+      }
+      size_t differing = comparePass(pass, replayed, differingPasses < MAX_REPORTED);
+      if (differing > 0) differingPasses++;
+      differences += differing;
+      recordCount += pass.size();
+      replayedCount += replayed.size();
+      pass.clear();
+    }
+    if (done) break;
+    passTime = recorded[k].time;
+    stage = 0;
+  }
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  removeDirectory(fsRoot);
+
+  double runSeconds = (recorded.back().time - keyframe.time) / 1000.0;
+  printf("replayed %u loop() passes, %.1f s of run time from %.3f s, in %.3f s (%.0fx real time)\n", passes,
+         runSeconds, keyframe.time / 1000.0, wallSeconds, wallSeconds > 0 ? runSeconds / wallSeconds : 0.0);
+  printf("%zu records recorded, %zu replayed, %zu differences in %u passes\n", recordCount, replayedCount, differences,
+         differingPasses);
+  return differences == 0 ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+/**
+ * @brief Runs the firmware on Linux and serves its web interface over HTTP.
+ *
+ * Build and run on the host; main.cpp is compiled in unchanged against the
+ * stand-ins in tools/host, and the handlers registered in setup() answer real
+ * HTTP requests:
+ *
+ *   g++ -std=gnu++11 -O2 -DHOST_BUILD -Itools/host -o serve tools/serve.cpp tools/host/host.cpp
+ *   ./serve --port 8080
+ *
+ * Then open http://localhost:8080/ or point tools/http_load.cpp at it.
+ *
+ * The firmware runs on the real clock: loop() runs between network events,
+ * at least every LOOP_MS. The sensors read a first-order heater model of each
+ * channel (time constant TAU_S, LOOP_GAIN_C above ambient at full power), so
+ * the heaters switch and the phases advance as with samples attached.
+ * The firmware's flash files go to a scratch directory that is removed on
+ * exit, or to --fs DIR to keep settings between runs.
+ * Options: --port P (default 8080), --fs DIR, --quiet (no serial output).
+ */
+
+#include "../main.cpp"
+
+#include <chrono>
+#include <csignal>
+#include <dirent.h>
+#include <unistd.h>
+
+//==============================================================================
+// Heater Model
+//==============================================================================
+const int LOOP_MS = 5;          // Longest wait for network events between loop() passes
+const float TAU_S = 120.0f;     // Time constant of every channel
+const float LOOP_GAIN_C = 80.0f; // Rise above ambient with the heater on
+const float AMBIENT_C = 20.0f;
+
+float plantTemperatures[NUM_SENSORS];
+
+/** @brief The model's temperature, in the DS18B20's 1/16 °C steps. */
+float plantReading(const uint8_t *address) {
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    if (memcmp(address, CHANNELS[i].address, sizeof(DeviceAddress)) == 0) {
+      return roundf(plantTemperatures[i] * 16.0f) / 16.0f;
+    }
+  }
+  return DEVICE_DISCONNECTED_C;
+}
+
+/** @brief Advances every channel's model by dt seconds. */
+void plantStep(float dt) {
+  float decay = expf(-dt / TAU_S);
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    float target = AMBIENT_C + (controller.outputState[i] ? LOOP_GAIN_C : 0.0f);
+    plantTemperatures[i] = target + (plantTemperatures[i] - target) * decay;
+  }
+}
+
+//==============================================================================
+// Main
+//==============================================================================
+volatile sig_atomic_t stopRequested = 0;
+
+void requestStop(int) { stopRequested = 1; }
+
+/** @brief Removes the files the firmware wrote, then the directory. */
+void removeDirectory(const char *path) {
+  DIR *dir = opendir(path);
+  if (dir == nullptr) return;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (entry->d_name[0] == '.') continue;
+    std::string file = std::string(path) + "/" + entry->d_name;
+    unlink(file.c_str());
+  }
+  closedir(dir);
+  rmdir(path);
+}
+
+int main(int argc, char **argv) {
+  hostHttpPort = 8080;
+  const char *fsDirectory = nullptr;
+  for (int a = 1; a < argc; a++) {
+    if (strcmp(argv[a], "--port") == 0 && a + 1 < argc) {
+      hostHttpPort = (uint16_t)atoi(argv[++a]);
+    } else if (strcmp(argv[a], "--fs") == 0 && a + 1 < argc) {
+      fsDirectory = argv[++a];
+    } else if (strcmp(argv[a], "--quiet") == 0) {
+      hostSerial = nullptr;
+    } else {
+      fprintf(stderr, "usage: %s [--port P] [--fs DIR] [--quiet]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  // Keep the firmware's flash out of the working directory.
+  char fsRoot[] = "/tmp/serve-XXXXXX";
+  if (fsDirectory != nullptr) {
+    hostFsRoot = fsDirectory;
+  } else if (mkdtemp(fsRoot) != nullptr) {
+    hostFsRoot = fsRoot;
+  } else {
+    perror("mkdtemp");
+    return 2;
+  }
+  signal(SIGINT, requestStop);
+  signal(SIGTERM, requestStop);
+  for (int i = 0; i < NUM_SENSORS; i++) plantTemperatures[i] = AMBIENT_C;
+  hostReadTemperature = plantReading;
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  setup();
+  fprintf(stderr, "serving on http://localhost:%u/\n", hostHttpPort);
+  uint64_t lastPlantMicros = 0;
+  while (!stopRequested) {
+    server.poll(LOOP_MS);
+    hostMicros = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    plantStep((hostMicros - lastPlantMicros) / 1e6f);
+    lastPlantMicros = hostMicros;
+    loop();
+  }
+  if (fsDirectory == nullptr) removeDirectory(fsRoot);
+  return 0;
+}
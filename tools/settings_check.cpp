@@ -0,0 +1,83 @@
+/**
+ * @brief Checks the firmware's settings parser against a table of form fields.
+ *
+ * Build and run on the host; main.cpp is compiled in unchanged against the
+ * stand-ins in tools/host:
+ *
+ *   g++ -std=gnu++11 -O2 -DHOST_BUILD -Itools/host -o settings_check tools/settings_check.cpp tools/host/host.cpp
+ *   ./settings_check
+ *
+ * Every case is one /update form field, decoded with addFormField(): the
+ * error it must give and, when it is accepted, the fixed-point value it must
+ * store. The cases cover rounding, the range limits and numbers that only
+ * overflow once scaled to the field's decimals. The program prints the cases
+ * that failed and exits with 1 if there were any.
+ */
+
+#include "../main.cpp"
+
+//==============================================================================
+// Cases
+//==============================================================================
+struct FormCase {
+  const char *name;
+  const char *value;
+  CommandError error;
+  int32_t fixed; // Stored value when error == COMMAND_OK
+};
+
+const FormCase FORM_CASES[] = {
+  {"threshold0", "60",           COMMAND_OK,           6000},
+  {"threshold0", "60.5",         COMMAND_OK,           6050},
+  {"threshold0", "60.005",       COMMAND_OK,           6001},  // Rounded half away from zero
+  {"threshold0", "60.0049",      COMMAND_OK,           6000},
+  {"threshold0", "+125",         COMMAND_OK,           12500},
+  {"threshold0", "125.01",       COMMAND_OUT_OF_RANGE, 0},
+  {"lower0",     "-55",          COMMAND_OK,           -5500},
+  {"lower0",     "-55.01",       COMMAND_OUT_OF_RANGE, 0},
+  {"cooling0",   "0.01",         COMMAND_OK,           1},
+  {"cooling0",   "0",            COMMAND_OUT_OF_RANGE, 0},
+  {"hold0",      "10080",        COMMAND_OK,           10080},
+  {"hold0",      "10080.5",      COMMAND_OUT_OF_RANGE, 0},
+  // Within the digit limit, but beyond int32_t once multiplied by 100
+  {"cooling0",   "42949673",     COMMAND_BAD_NUMBER,   0},
+  {"threshold0", "42949673",     COMMAND_BAD_NUMBER,   0},
+  {"lower0",     "-42949673",    COMMAND_BAD_NUMBER,   0},
+  {"cooling0",   "21474836.47",  COMMAND_OUT_OF_RANGE, 0},  // INT32_MAX: parsed, then out of range
+  {"cooling0",   "21474836.48",  COMMAND_BAD_NUMBER,   0},
+  {"hold0",      "100000001",    COMMAND_BAD_NUMBER,   0},
+  {"threshold0", "",             COMMAND_BAD_NUMBER,   0},
+  {"threshold0", "-",            COMMAND_BAD_NUMBER,   0},
+  {"threshold0", "6e1",          COMMAND_BAD_NUMBER,   0},
+  {"threshold0", "60 ",          COMMAND_BAD_NUMBER,   0},
+  {"threshold00", "60",          COMMAND_BAD_CHANNEL,  0},
+  {"thresholdx", "60",           COMMAND_BAD_CHANNEL,  0},
+  {"setpoint0",  "60",           COMMAND_UNKNOWN_FIELD, 0},
+};
+
+//==============================================================================
+// Main
+//==============================================================================
+int main() {
+  int failed = 0;
+  int count = sizeof(FORM_CASES) / sizeof(FORM_CASES[0]);
+  for (int c = 0; c < count; c++) {
+    const FormCase &expected = FORM_CASES[c];
+    SettingsCommand command;
+    clearCommand(command);
+    CommandError error = addFormField(command, expected.name, expected.value);
+    int32_t fixed = 0;
+    if (error == COMMAND_OK) {
+      // The cases all use channel 0.
+      int f = 0;
+      while (!(command.fieldMask[0] & (1 << f))) f++;
+      fixed = command.values[0][f];
+    }
+    if (error == expected.error && fixed == expected.fixed) continue;
+    failed++;
+    printf("%s=%s: got \"%s\" %d, expected \"%s\" %d\n", expected.name, expected.value, COMMAND_ERROR_TEXT[error],
+           (int)fixed, COMMAND_ERROR_TEXT[expected.error], (int)expected.fixed);
+  }
+  printf("%d of %d form cases passed\n", count - failed, count);
+  return failed != 0 ? 1 : 0;
+}
@@ -0,0 +1,442 @@
+/**
+ * @brief Searches controller parameters against a first-order heater model on every host core.
+ *
+ * Build and run on the host:
+ *
+ *   g++ -std=c++11 -O3 -march=native -pthread -o sweep tools/sweep.cpp
+ *   ./sweep                      # grid search
+ *   ./sweep --random 2000        # random search, 2000 configurations x 16 cooling speeds
+ *
+ * Options: --grid | --random N, --seed S, --threads T (default: all cores),
+ * --out FILE (default sweep.csv), --top K (rows printed, default 10),
+ * --hold-temp C, --lower C, --hold-min M, --tau S, --gain C, --ambient C,
+ * --weights OVERSHOOT,HOLD,RAMP,SWITCHING.
+ *
+ * Every configuration runs one full process (heat-up, Hold, cooling ramp
+ * down to the lower limit) through ChannelEngine::step(), the control step
+ * loop() runs, with loop()'s two task timers: the sensors are read every
+ * sample period, each read returning the conversion requested at the
+ * previous one, and the control step runs every control period. loop() itself
+ * works on the controller's globals, one board per process, so it cannot run
+ * thousands of configurations side by side.
+ *
+ * The plant is first order: the temperature approaches ambient + gain while
+ * the heater is on and ambient while it is off, with time constant tau.
+ * Readings are rounded to the DS18B20's 1/16 °C.
+ *
+ * Searched: HYSTERESIS, the sensor sample period, the control period and
+ * the cooling speed. One work item is one (hysteresis, sample period, control
+ * period) with 16 cooling speeds in the engine's lanes. Items go to
+ * per-thread queues; a thread whose queue is empty steals from the others.
+ *
+ * Every result gets
+ *   overshoot  highest temperature above the hold temperature before cooling (°C)
+ *   hold_rms   RMS deviation from the hold temperature during Hold (°C)
+ *   ramp_rms   RMS deviation from the falling setpoint during cooling (°C)
+ *   cycle_s    mean heater on-to-on period during Hold (s; longer spares the relay)
+ * and is ranked by a weighted sum of overshoot, hold_rms, ramp_rms and heater
+ * switch-ons per minute (--weights). All rows go to the CSV file, best first.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../channel_engine.h"
+
+//==============================================================================
+// Search Space
+//==============================================================================
+const size_t LANES = 16; // Cooling speeds simulated together in one work item
+
+const float GRID_HYSTERESIS[] = {0.1f, 0.25f, 0.5f, 0.75f, 1.0f, 1.5f, 2.0f};
+const uint32_t GRID_SAMPLE_MS[] = {750, 1000, 2000, 3000, 5000}; // 750 ms: DS18B20 12-bit conversion time
+const uint32_t GRID_TICK_MS[] = {100, 250, 500, 1000};
+const float COOLING_MIN = 0.25f; // °C / minute
+const float COOLING_MAX = 8.0f;
+
+const uint32_t LOOP_MS = 10;                    // Time between simulated loop() passes
+const uint32_t MAX_RUN_MS = 6 * 3600 * 1000UL;  // Processes still running after this are cut off
+
+typedef ChannelEngine<LANES> Engine;
+
+/** @brief The process and heater model every configuration runs. */
+struct Scenario {
+  float holdTemp;      // °C
+  float lowerLimit;    // °C
+  uint32_t holdMinutes;
+  float tau;           // Plant time constant (s)
+  float gain;          // Steady-state rise above ambient with the heater on (°C)
+  float ambient;       // °C
+};
+
+/** @brief Ranking weights (see the file comment). */
+struct Weights {
+  float overshoot, hold, ramp, switching;
+};
+
+/** @brief One simulated configuration and its result. */
+struct Result {
+  float hysteresis;
+  uint32_t sampleMs;
+  uint32_t tickMs;
+  float coolingSpeed;
+  float overshoot;
+  float holdRms;
+  float rampRms;
+  float cycleSeconds; // 0 if the heater switched on fewer than twice during Hold
+  uint32_t switches;  // Heater switch-ons during Hold
+  float minutes;      // Duration of the whole process
+  bool finished;      // Cooling reached the lower limit within MAX_RUN_MS
+  float score;
+};
+
+/** @brief A work item: the scalar parameters shared by all lanes. */
+struct Item {
+  float hysteresis;
+  uint32_t sampleMs;
+  uint32_t tickMs;
+  float coolingSpeeds[LANES];
+};
+
+/** @brief Small deterministic generator, so a seed always gives the same search. */
+struct Random {
+  uint32_t state;
+  uint32_t next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+  float uniform(float low, float high) { return low + (high - low) * (next() >> 8) / 16777216.0f; }
+};
+
+//==============================================================================
+// Simulation
+//==============================================================================
+/** @brief Per-lane accumulators for the metrics. */
+struct LaneStats {
+  float overshoot;
+  double holdSquares;
+  uint32_t holdSamples;
+  double rampSquares;
+  uint32_t rampSamples;
+  uint32_t firstOn, lastOn, switches;
+  uint32_t finishedAt; // 0 while running
+};
+
+/** @brief Runs one work item to the end of the process and fills LANES results. */
+void simulate(const Item &item, const Scenario &scenario, Result *results) {
+  Engine engine;
+  LaneStats stats[LANES];
+  float plant[LANES];      // True temperature
+  float conversion[LANES]; // Reading requested at the last sensor read, returned by the next one
+  memset(stats, 0, sizeof(stats));
+  for (size_t i = 0; i < LANES; i++) {
+    engine.setting_HoldTemps[i] = scenario.holdTemp;
+    engine.setting_CoolingSpeeds[i] = item.coolingSpeeds[i];
+    engine.setting_LowerLimits[i] = scenario.lowerLimit;
+    engine.setting_HoldDurations[i] = scenario.holdMinutes;
+    engine.lastTemperatures[i] = CHANNEL_NO_READING; // No reading before the first sensor task
+    engine.outputState[i] = 0;
+    engine.holdPhaseActive[i] = 0;
+    engine.coolingPhaseActive[i] = 0;
+    engine.phaseStartMillis[i] = 0;
+    engine.sensorErrorCounts[i] = 0;
+    engine.liveSetpoints[i] = scenario.holdTemp;
+    engine.laneEnabled[i] = 1;
+    engine.events[i] = 0;
+    plant[i] = scenario.ambient;
+    conversion[i] = scenario.ambient; // setup() requests the first conversion
+  }
+
+  const float decay = expf(-(LOOP_MS / 1000.0f) / scenario.tau);
+  uint32_t lastSensorRead = 0, lastLogicUpdate = 0;
+  bool controlStarted = false;
+  size_t running = LANES;
+  for (uint32_t now = 0; now < MAX_RUN_MS && running > 0; now += LOOP_MS) {
+    // loop() task 1: read the previous conversion and request the next one.
+    if (now - lastSensorRead >= item.sampleMs) {
+      lastSensorRead = now;
+      for (size_t i = 0; i < LANES; i++) {
+        engine.lastTemperatures[i] = roundf(conversion[i] * 16.0f) / 16.0f;
+        conversion[i] = plant[i];
+      }
+    }
+
+    // loop() task 2: the control step.
+    if (now - lastLogicUpdate >= item.tickMs || !controlStarted) {
+      uint32_t elapsed = now - lastLogicUpdate;
+      lastLogicUpdate = now;
+      controlStarted = true;
+      if (engine.step(now, elapsed, true, item.hysteresis) != 0) {
+        for (size_t i = 0; i < LANES; i++) {
+          uint8_t events = engine.events[i];
+          LaneStats &s = stats[i];
+          if ((events & CHANNEL_HEATER_ON) && engine.holdPhaseActive[i]) {
+            if (s.switches == 0) s.firstOn = now;
+            s.lastOn = now;
+            s.switches++;
+          }
+          if (events & CHANNEL_COOLING_FINISHED) {
+            s.finishedAt = now;
+            engine.laneEnabled[i] = 0;
+            running--;
+          }
+        }
+      }
+    }
+
+    // Plant and metrics, every pass.
+    for (size_t i = 0; i < LANES; i++) {
+      LaneStats &s = stats[i];
+      if (s.finishedAt != 0) continue;
+      float target = scenario.ambient + (engine.outputState[i] ? scenario.gain : 0.0f);
+      plant[i] = target + (plant[i] - target) * decay;
+      float t = plant[i];
+      if (engine.coolingPhaseActive[i]) {
+        double e = t - engine.liveSetpoints[i];
+        s.rampSquares += e * e;
+        s.rampSamples++;
+      } else {
+        s.overshoot = std::max(s.overshoot, t - scenario.holdTemp);
+        if (engine.holdPhaseActive[i]) {
+          double e = t - scenario.holdTemp;
+          s.holdSquares += e * e;
+          s.holdSamples++;
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < LANES; i++) {
+    const LaneStats &s = stats[i];
+    Result &r = results[i];
+    r.hysteresis = item.hysteresis;
+    r.sampleMs = item.sampleMs;
+    r.tickMs = item.tickMs;
+    r.coolingSpeed = item.coolingSpeeds[i];
+    r.overshoot = s.overshoot;
+    r.holdRms = s.holdSamples ? (float)sqrt(s.holdSquares / s.holdSamples) : 0;
+    r.rampRms = s.rampSamples ? (float)sqrt(s.rampSquares / s.rampSamples) : 0;
+    r.switches = s.switches;
+    r.cycleSeconds = s.switches >= 2 ? (s.lastOn - s.firstOn) / 1000.0f / (s.switches - 1) : 0;
+    r.finished = s.finishedAt != 0;
+    r.minutes = (r.finished ? s.finishedAt : MAX_RUN_MS) / 60000.0f;
+  }
+}
+
+/** @brief Weighted sum the results are ranked by; lower is better. Unfinished runs rank last. */
+float score(const Result &r, const Scenario &scenario, const Weights &w) {
+  float switchesPerMinute = scenario.holdMinutes > 0 ? r.switches / (float)scenario.holdMinutes : 0;
+  float sum = w.overshoot * r.overshoot + w.hold * r.holdRms + w.ramp * r.rampRms + w.switching * switchesPerMinute;
+  return r.finished ? sum : sum + 1e6f;
+}
+
+//==============================================================================
+// Work-Stealing Pool
+//==============================================================================
+/** @brief A thread's own queue; the owner takes from the back, thieves from the front. */
+struct WorkQueue {
+  std::mutex lock;
+  std::deque<size_t> items;
+};
+
+/** @brief Per-thread counters, reported after the run. */
+struct WorkerStats {
+  uint32_t done;
+  uint32_t stolen;
+};
+
+/**
+ * @brief Runs work(i) for i in 0..count-1 on threads threads.
+ * @details Items are dealt round-robin to the threads' queues. A thread works
+ * through its own queue from the back; when it is empty it steals from the
+ * front of the next non-empty queue, so threads that drew slow items are
+ * relieved by the others. Items do not create new items, so a thread stops
+ * when every queue is empty.
+ */
+template <typename Work>
+std::vector<WorkerStats> runPool(size_t count, unsigned threads, Work work) {
+  std::vector<WorkQueue> queues(threads);
+  std::vector<WorkerStats> stats(threads, WorkerStats{0, 0});
+  for (size_t i = 0; i < count; i++) queues[i % threads].items.push_back(i);
+
+  auto worker = [&](unsigned self) {
+    for (;;) {
+      size_t item = 0;
+      bool found = false;
+      {
+        std::lock_guard<std::mutex> hold(queues[self].lock);
+        if (!queues[self].items.empty()) {
+          item = queues[self].items.back();
+          queues[self].items.pop_back();
+          found = true;
+        }
+      }
+      for (unsigned k = 1; k < threads && !found; k++) {
+        WorkQueue &victim = queues[(self + k) % threads];
+        std::lock_guard<std::mutex> hold(victim.lock);
+        if (!victim.items.empty()) {
+          item = victim.items.front();
+          victim.items.pop_front();
+          found = true;
+          stats[self].stolen++;
+        }
+      }
+      if (!found) return;
+      work(item);
+      stats[self].done++;
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; t++) pool.push_back(std::thread(worker, t));
+  worker(0);
+  for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+  return stats;
+}
+
+//==============================================================================
+// Main
+//==============================================================================
+std::vector<Item> gridItems() {
+  std::vector<Item> items;
+  for (float hysteresis : GRID_HYSTERESIS) {
+    for (uint32_t sampleMs : GRID_SAMPLE_MS) {
+      for (uint32_t tickMs : GRID_TICK_MS) {
+        Item item;
+        item.hysteresis = hysteresis;
+        item.sampleMs = sampleMs;
+        item.tickMs = tickMs;
+        // Cooling speeds evenly spaced on a log scale.
+        for (size_t i = 0; i < LANES; i++) {
+          item.coolingSpeeds[i] = COOLING_MIN * powf(COOLING_MAX / COOLING_MIN, i / (float)(LANES - 1));
+        }
+        items.push_back(item);
+      }
+    }
+  }
+  return items;
+}
+
+std::vector<Item> randomItems(size_t count, uint32_t seed) {
+  Random random = {seed ? seed : 1};
+  std::vector<Item> items(count);
+  for (size_t n = 0; n < count; n++) {
+    Item &item = items[n];
+    item.hysteresis = random.uniform(GRID_HYSTERESIS[0], GRID_HYSTERESIS[sizeof(GRID_HYSTERESIS) / sizeof(float) - 1]);
+    item.sampleMs = (uint32_t)random.uniform(750, 5000);
+    item.tickMs = (uint32_t)random.uniform(100, 1000);
+    for (size_t i = 0; i < LANES; i++) {
+      item.coolingSpeeds[i] = COOLING_MIN * powf(COOLING_MAX / COOLING_MIN, random.uniform(0, 1));
+    }
+  }
+  return items;
+}
+
+bool writeCsv(const char *path, const std::vector<Result> &results) {
+  FILE *out = fopen(path, "w");
+  if (out == nullptr) {
+    perror(path);
+    return false;
+  }
+  fprintf(out, "rank,score,hysteresis_c,sample_ms,tick_ms,cooling_c_per_min,overshoot_c,hold_rms_c,ramp_rms_c,"
+               "cycle_s,hold_switches,minutes,finished\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    fprintf(out, "%zu,%.4f,%.3f,%u,%u,%.3f,%.3f,%.3f,%.3f,%.1f,%u,%.1f,%d\n", i + 1, r.score, r.hysteresis,
+            r.sampleMs, r.tickMs, r.coolingSpeed, r.overshoot, r.holdRms, r.rampRms, r.cycleSeconds, r.switches,
+            r.minutes, r.finished ? 1 : 0);
+  }
+  fclose(out);
+  return true;
+}
+
+int usage(const char *program) {
+  fprintf(stderr, "usage: %s [--grid | --random N] [--seed S] [--threads T] [--out FILE] [--top K]\n"
+                  "       [--hold-temp C] [--lower C] [--hold-min M] [--tau S] [--gain C] [--ambient C]\n"
+                  "       [--weights OVERSHOOT,HOLD,RAMP,SWITCHING]\n", program);
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  Scenario scenario = {60.0f, 37.0f, 10, 120.0f, 80.0f, 20.0f};
+  Weights weights = {1.0f, 1.0f, 0.5f, 0.1f};
+  size_t randomCount = 0;
+  uint32_t seed = 12345;
+  unsigned threads = std::thread::hardware_concurrency();
+  const char *outPath = "sweep.csv";
+  size_t top = 10;
+
+  for (int a = 1; a < argc; a++) {
+    const char *arg = argv[a];
+    const char *value = a + 1 < argc ? argv[a + 1] : nullptr;
+    if (strcmp(arg, "--grid") == 0) {
+      randomCount = 0;
+      continue;
+    }
+    if (value == nullptr) return usage(argv[0]);
+    a++;
+    if (strcmp(arg, "--random") == 0) randomCount = strtoul(value, nullptr, 10);
+    else if (strcmp(arg, "--seed") == 0) seed = strtoul(value, nullptr, 10);
+    else if (strcmp(arg, "--threads") == 0) threads = strtoul(value, nullptr, 10);
+    else if (strcmp(arg, "--out") == 0) outPath = value;
+    else if (strcmp(arg, "--top") == 0) top = strtoul(value, nullptr, 10);
+    else if (strcmp(arg, "--hold-temp") == 0) scenario.holdTemp = strtof(value, nullptr);
+    else if (strcmp(arg, "--lower") == 0) scenario.lowerLimit = strtof(value, nullptr);
+    else if (strcmp(arg, "--hold-min") == 0) scenario.holdMinutes = strtoul(value, nullptr, 10);
+    else if (strcmp(arg, "--tau") == 0) scenario.tau = strtof(value, nullptr);
+    else if (strcmp(arg, "--gain") == 0) scenario.gain = strtof(value, nullptr);
+    else if (strcmp(arg, "--ambient") == 0) scenario.ambient = strtof(value, nullptr);
+    else if (strcmp(arg, "--weights") == 0) {
+      if (sscanf(value, "%f,%f,%f,%f", &weights.overshoot, &weights.hold, &weights.ramp, &weights.switching) != 4) {
+        return usage(argv[0]);
+      }
+    } else {
+      return usage(argv[0]);
+    }
+  }
+  if (threads == 0) threads = 1;
+  if (scenario.ambient + scenario.gain <= scenario.holdTemp + 2.0f) {
+    fprintf(stderr, "the heater cannot reach the hold temperature: ambient + gain must exceed it\n");
+    return 2;
+  }
+
+  std::vector<Item> items = randomCount > 0 ? randomItems(randomCount, seed) : gridItems();
+  std::vector<Result> results(items.size() * LANES);
+  std::atomic<size_t> completed(0);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<WorkerStats> workers = runPool(items.size(), threads, [&](size_t i) {
+    simulate(items[i], scenario, &results[i * LANES]);
+    completed++;
+  });
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for (size_t i = 0; i < results.size(); i++) results[i].score = score(results[i], scenario, weights);
+  std::stable_sort(results.begin(), results.end(), [](const Result &a, const Result &b) { return a.score < b.score; });
+  if (!writeCsv(outPath, results)) return 1;
+
+  fprintf(stderr, "%zu configurations (%zu work items) in %.2f s on %u threads; wrote %s\n", results.size(),
+          completed.load(), seconds, threads, outPath);
+  for (unsigned t = 0; t < threads; t++) {
+    fprintf(stderr, "  thread %u: %u items, %u stolen\n", t, workers[t].done, workers[t].stolen);
+  }
+  printf("%4s %8s %6s %7s %6s %9s %10s %9s %9s %8s\n", "rank", "score", "hyst", "sample", "tick", "cooling",
+         "overshoot", "hold_rms", "ramp_rms", "cycle_s");
+  for (size_t i = 0; i < top && i < results.size(); i++) {
+    const Result &r = results[i];
+    printf("%4zu %8.3f %6.2f %7u %6u %9.2f %10.2f %9.3f %9.3f %8.1f\n", i + 1, r.score, r.hysteresis, r.sampleMs,
+           r.tickMs, r.coolingSpeed, r.overshoot, r.holdRms, r.rampRms, r.cycleSeconds);
+  }
+  return 0;
+}
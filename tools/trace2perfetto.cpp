@@ -0,0 +1,254 @@
+/**
+ * @brief Converts a /trace dump from the controller into Chrome/Perfetto trace JSON.
+ *
+ * Download the dump from the controller and convert it on the host:
+ *
+ *   curl -o trace.bin http://<controller-ip>/trace
+ *   g++ -std=c++11 -O2 -o trace2perfetto tools/trace2perfetto.cpp
+ *   ./trace2perfetto trace.bin > trace.json
+ *
+ * Open trace.json in https://ui.perfetto.dev or chrome://tracing. Every
+ * channel gets a "heater" track (one slice per ON period), a "phase" track
+ * (Hold and Cooling slices) and a temperature counter. Sensor errors are
+ * instant events on the heater track and web commands are instant events on
+ * the "system" track.
+ *
+ * The record layout must match TraceRecord/TraceHeader in main.cpp.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+//==============================================================================
+// Dump Format (see "Event Trace" in main.cpp)
+//==============================================================================
+const uint32_t TRACE_MAGIC = 0x52545447; // "GTTR"
+const uint16_t TRACE_VERSION = 1;
+const size_t HEADER_SIZE = 16;
+const size_t RECORD_SIZE = 8;
+const uint8_t TRACE_NO_CHANNEL = 0xFF;
+
+enum TraceEvent {
+  TRACE_HEATER_ON = 1,
+  TRACE_HEATER_OFF = 2,
+  TRACE_PHASE = 3,
+  TRACE_TEMPERATURE = 4,
+  TRACE_SENSOR_ERROR = 5,
+  TRACE_WEB_COMMAND = 6
+};
+
+enum TracePhase { TRACE_PHASE_IDLE = 0, TRACE_PHASE_HOLD = 1, TRACE_PHASE_COOLING = 2 };
+
+/** @brief A decoded record with its timestamp unwrapped to 64 bits. */
+struct Record {
+  uint64_t timestamp; // Microseconds
+  uint8_t event;
+  uint8_t channel;
+  int16_t arg;
+};
+
+uint16_t readU16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+uint32_t readU32(const uint8_t *p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+//==============================================================================
+// JSON Output
+//==============================================================================
+const int PID = 1;
+const int TID_SYSTEM = 1;
+
+/** @brief Thread id of a channel's heater track. */
+int heaterTid(int channel) { return 100 + channel * 2; }
+
+/** @brief Thread id of a channel's phase track. */
+int phaseTid(int channel) { return 101 + channel * 2; }
+
+bool firstEvent = true;
+
+/** @brief Starts a new element of the traceEvents array. */
+void beginEvent() {
+  printf(firstEvent ? "\n    " : ",\n    ");
+  firstEvent = false;
+}
+
+void emitThreadName(int tid, const char *name, int channel) {
+  beginEvent();
+  if (channel >= 0) {
+    printf("{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"Channel %d %s\"}}", PID, tid, channel, name);
+  } else {
+    printf("{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}", PID, tid, name);
+  }
+}
+
+void emitSlice(int tid, const char *name, uint64_t start, uint64_t end, double startTemp) {
+  beginEvent();
+  printf("{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"name\":\"%s\",\"ts\":%llu,\"dur\":%llu",
+         PID, tid, name, (unsigned long long)start, (unsigned long long)(end - start));
+  if (!std::isnan(startTemp)) {
+    printf(",\"args\":{\"temp_c\":%.2f}", startTemp);
+  }
+  printf("}");
+}
+
+void emitInstant(int tid, const char *name, uint64_t ts, const char *argName, double argValue) {
+  beginEvent();
+  printf("{\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"name\":\"%s\",\"ts\":%llu,\"args\":{\"%s\":%g}}",
+         PID, tid, name, (unsigned long long)ts, argName, argValue);
+}
+
+void emitCounter(int channel, uint64_t ts, double celsius) {
+  beginEvent();
+  printf("{\"ph\":\"C\",\"pid\":%d,\"name\":\"Channel %d temperature\",\"ts\":%llu,\"args\":{\"temp_c\":%.2f}}",
+         PID, channel, (unsigned long long)ts, celsius);
+}
+
+const char *phaseName(int phase) {
+  switch (phase) {
+    case TRACE_PHASE_HOLD: return "Hold";
+    case TRACE_PHASE_COOLING: return "Cooling";
+    default: return "Idle";
+  }
+}
+
+const char *commandName(int command) {
+  switch (command) {
+    case 1: return "POST /update";
+    case 2: return "POST /api/config";
+    case 3: return "Apply preset";
+    case 4: return "Save preset";
+    case 5: return "Delete preset";
+    case 6: return "Set WiFi credentials";
+    case 7: return "Set power mode";
+    case 8: return "Firmware update";
+    case 9: return "Set enabled channels";
+    default: return "Web command";
+  }
+}
+
+//==============================================================================
+// Conversion
+//==============================================================================
+/** @brief Per-channel state needed to turn start/stop events into slices. */
+struct ChannelTrack {
+  bool seen = false;
+  bool heaterOn = false;
+  uint64_t heaterStart = 0;
+  double heaterStartTemp = 0;
+  int phase = TRACE_PHASE_IDLE;
+  uint64_t phaseStart = 0;
+};
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <trace.bin>\n", argv[0]);
+    return 2;
+  }
+  FILE *file = fopen(argv[1], "rb");
+  if (file == nullptr) {
+    perror(argv[1]);
+    return 1;
+  }
+  std::vector<uint8_t> dump;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) dump.insert(dump.end(), chunk, chunk + n);
+  fclose(file);
+
+  if (dump.size() < HEADER_SIZE || readU32(&dump[0]) != TRACE_MAGIC) {
+    fprintf(stderr, "%s: not a controller trace dump\n", argv[1]);
+    return 1;
+  }
+  if (readU16(&dump[4]) != TRACE_VERSION || readU16(&dump[6]) != RECORD_SIZE) {
+    fprintf(stderr, "%s: unsupported trace version %u\n", argv[1], readU16(&dump[4]));
+    return 1;
+  }
+  uint32_t count = readU32(&dump[8]);
+  size_t available = (dump.size() - HEADER_SIZE) / RECORD_SIZE;
+  if (count > available) {
+    fprintf(stderr, "warning: dump truncated, %zu of %u records present\n", available, count);
+    count = (uint32_t)available;
+  }
+
+  // Decode and unwrap micros(), which overflows every ~71 minutes.
+  std::vector<Record> records;
+  records.reserve(count);
+  uint64_t epoch = 0;
+  uint32_t previous = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const uint8_t *p = &dump[HEADER_SIZE + i * RECORD_SIZE];
+    uint32_t ts = readU32(p);
+    if (i > 0 && ts < previous && previous - ts > 0x80000000u) epoch += 0x100000000ull;
+    previous = ts;
+    Record record = {epoch + ts, p[4], p[5], (int16_t)readU16(p + 6)};
+    records.push_back(record);
+  }
+  uint64_t origin = records.empty() ? 0 : records.front().timestamp;
+  uint64_t last = records.empty() ? 0 : records.back().timestamp - origin;
+
+  printf("{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [");
+  beginEvent();
+  printf("{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\",\"args\":{\"name\":\"Gellan Turbo 3000\"}}", PID);
+  emitThreadName(TID_SYSTEM, "System", -1);
+
+  std::vector<ChannelTrack> tracks(TRACE_NO_CHANNEL);
+  for (const Record &record : records) {
+    uint64_t ts = record.timestamp - origin;
+    double celsius = record.arg / 100.0;
+
+    if (record.channel == TRACE_NO_CHANNEL) {
+      if (record.event == TRACE_WEB_COMMAND) emitInstant(TID_SYSTEM, commandName(record.arg), ts, "command", record.arg);
+      continue;
+    }
+
+    ChannelTrack &track = tracks[record.channel];
+    if (!track.seen) {
+      track.seen = true;
+      emitThreadName(heaterTid(record.channel), "heater", record.channel);
+      emitThreadName(phaseTid(record.channel), "phase", record.channel);
+    }
+
+    switch (record.event) {
+      case TRACE_HEATER_ON:
+        if (!track.heaterOn) {
+          track.heaterOn = true;
+          track.heaterStart = ts;
+          track.heaterStartTemp = celsius;
+        }
+        break;
+      case TRACE_HEATER_OFF:
+        // An OFF without a recorded ON means the ON fell out of the ring.
+        if (track.heaterOn) emitSlice(heaterTid(record.channel), "Heater ON", track.heaterStart, ts, track.heaterStartTemp);
+        track.heaterOn = false;
+        break;
+      case TRACE_PHASE:
+        if (track.phase != TRACE_PHASE_IDLE) {
+          emitSlice(phaseTid(record.channel), phaseName(track.phase), track.phaseStart, ts, NAN);
+        }
+        track.phase = record.arg;
+        track.phaseStart = ts;
+        break;
+      case TRACE_TEMPERATURE:
+        emitCounter(record.channel, ts, celsius);
+        break;
+      case TRACE_SENSOR_ERROR:
+        emitInstant(heaterTid(record.channel), "Sensor error", ts, "raw_c", celsius);
+        break;
+      default:
+        emitInstant(heaterTid(record.channel), "Unknown event", ts, "event", record.event);
+        break;
+    }
+  }
+
+  // Close slices that were still open when the dump was taken.
+  for (size_t channel = 0; channel < tracks.size(); channel++) {
+    ChannelTrack &track = tracks[channel];
+    if (track.heaterOn) emitSlice(heaterTid((int)channel), "Heater ON", track.heaterStart, last, track.heaterStartTemp);
+    if (track.phase != TRACE_PHASE_IDLE) emitSlice(phaseTid((int)channel), phaseName(track.phase), track.phaseStart, last, NAN);
+  }
+
+  printf("\n  ]\n}\n");
+  fprintf(stderr, "%u records, %.3f s\n", count, last / 1e6);
+  return 0;
+}